@@ -469,9 +469,27 @@ class Cups(ServerABC):
         logger.debug('x CUPS: Unable to encode matching signature!')
         return (b'\x00'*4,0)
 
+    def resumeOffset(self, req:Dict[str,Any], cfg:Dict[str,Any], r_sig:bytes, r_fwbin:bytes) -> int:
+        # Router asks to continue an interrupted download - only if it is still the same update
+        rs = req.get('updResume')
+        if not rs or len(r_fwbin) <= 4:
+            return 0
+        fwbin = cfg['fwBin']
+        sig = r_sig[8:]
+        keycrc = struct.unpack_from('<I', r_sig, 4)[0] if sig else 0
+        sigcrc = crc32(sig) & 0xFFFFFFFF if sig else 0
+        off = rs.get('offset', 0)
+        if rs.get('size') != len(fwbin) or rs.get('keyCrc') != keycrc or rs.get('sigCrc') != sigcrc or not 0 < off < len(fwbin):
+            logger.debug('  CUPS: Cannot resume update: %r' % (rs,))
+            return 0
+        return off
+
     def on_response(self, r_cupsUri:bytes, r_tcUri:bytes, r_cupsCred:bytes, r_tcCred:bytes, r_sig:bytes, r_fwbin:bytes) -> bytes:
         return r_cupsUri + r_tcUri + r_cupsCred + r_tcCred + r_sig + r_fwbin
 
+    async def send_response(self, request, body:bytes, headers:Dict[str,str]) -> web.StreamResponse:
+        return web.Response(body=body, headers=headers)
+
 
     async def handle_update_info(self, request) -> web.Response:
         req = await request.json()
@@ -497,6 +515,12 @@ class Cups(ServerABC):
         r_tcCred          = self.encodeCred('tc'  , req, cfg)
         (r_sig, r_sigCrc) = self.encodeSig(req, cfg)
         r_fwbin           = self.encodeFw(req, cfg)
+        headers = {}
+        r_fwoff = self.resumeOffset(req, cfg, r_sig, r_fwbin)
+        if r_fwoff:
+            # Segment length stays the full size - only the missing tail is sent
+            r_fwbin = r_fwbin[0:4] + r_fwbin[4+r_fwoff:]
+            headers['X-Update-Offset'] = str(r_fwoff)
 
         logger.debug('< CUPS Response:\n'
               '  cupsUri : %s %s\n'
@@ -505,15 +529,16 @@ class Cups(ServerABC):
               '  tcCred  : %3d bytes -- %s\n'
               '  sigCrc  : %08X\n'
               '  sig     : %3d bytes\n'
-              '  fw      : %3d bytes -- %s'
+              '  fw      : %3d bytes -- %s%s'
               ,  r_cupsUri[1:], ("<- " if r_cupsUri[1:] else "-- ") + "[%s]" % cupsUri,
                  r_tcUri[1:], ("<- " if r_tcUri[1:] else "-- ") + "[%s]" % tcUri,
                  len(r_cupsCred)-2, ("[%08X] <- " % cfg['cupsCredCrc'] if len(r_cupsCred)-2 else "") + "[%08X]" % (cupsCrc),
                  len(r_tcCred)-2  , ("[%08X] <- " % cfg['tcCredCrc'] if len(r_tcCred)-2 else "") + "[%08X]" % (tcCrc),
                  r_sigCrc,
                  len(r_sig)-4, # includes CRC
-                 len(r_fwbin)-4, ("[%s] <- " % cfg.get('version') if len(r_fwbin)-4 else "") + "[%s]" % (req['version']))
+                 len(r_fwbin)-4, ("[%s] <- " % cfg.get('version') if len(r_fwbin)-4 else "") + "[%s]" % (req['version']),
+                 " (resumed at %d)" % r_fwoff if r_fwoff else "")
 
         body = self.on_response(r_cupsUri, r_tcUri, r_cupsCred, r_tcCred, r_sig, r_fwbin)
-        return web.Response(body=body)
+        return await self.send_response(request, body, headers)
 
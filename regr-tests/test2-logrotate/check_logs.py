@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Verify a set of rotated log files:
+#   check_logs.py PATH MAXSIZE ROTATE NLINES SUFFIX
+# Lines 'seq-N' 1..NLINES were fed into the station log. Rotated files must
+# be within size bounds and together with PATH contain an uninterrupted
+# tail of the sequence - no torn, lost, or duplicated lines. Unless all
+# ROTATE slots are used, the whole sequence must be present. With ROTATE=0
+# PATH is truncated in place and must hold the tail of the sequence.
+
+import glob
+import gzip
+import re
+import sys
+
+LOG_OUTSIZ = 8192   # max bytes written in one batch
+
+path, maxsize, rotate, nlines, suffix = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4]), sys.argv[5]
+
+def fail(msg):
+    print('[FAILED] %s' % msg)
+    sys.exit(1)
+
+rotated = sorted(glob.glob(path + '.*'))
+for fn in rotated:
+    if not re.fullmatch(re.escape(path) + r'\.\d+' + re.escape(suffix), fn):
+        fail('Unexpected file: %s' % fn)
+if rotate == 0 and rotated:
+    fail('No rotated files expected - found %s' % rotated)
+if rotate > 0 and not 0 < len(rotated) <= rotate:
+    fail('Expected 1..%d rotated files - found %d: %s' % (rotate, len(rotated), rotated))
+
+files = []
+for fn in rotated + [path]:
+    data = gzip.open(fn).read() if fn.endswith('.gz') else open(fn, 'rb').read()
+    if fn != path and not maxsize <= len(data) < maxsize + LOG_OUTSIZ:
+        fail('%s: size %d out of range' % (fn, len(data)))
+    if fn == path and not len(data) < maxsize + LOG_OUTSIZ:
+        fail('%s: size %d exceeds limit' % (fn, len(data)))
+    if data and not data.endswith(b'\n'):
+        fail('%s: torn last line' % fn)
+    lines = data.decode().splitlines()
+    seqs = [int(m.group(1)) for m in (re.search(r'Unknown fifo command: seq-(\d+)$', l) for l in lines) if m]
+    files.append((lines[0] if lines else '', fn, seqs))
+    print('%-20s %7d bytes %5d lines %5d seqs' % (fn, len(data), len(lines), len(seqs)))
+
+# Order by first log line (timestamp) - rotation slots are reused round robin
+files.sort()
+seqs = [s for f in files for s in f[2]]
+if not seqs or seqs[-1] != nlines:
+    fail('Last sequence number %s - expected %d' % (seqs[-1:] or None, nlines))
+if seqs != list(range(seqs[0], nlines+1)):
+    fail('Sequence has gaps/duplicates/reordering')
+if len(rotated) < rotate and seqs[0] != 1:
+    fail('Lost head of sequence - starts at %d' % seqs[0])
+if len(rotated) == rotate and seqs[0] == 1:
+    fail('All rotation slots used but nothing dropped - test load too small')
+print('OK: %d files, seq %d..%d' % (len(files), seqs[0], nlines))
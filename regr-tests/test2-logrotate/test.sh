@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+. ../testlib.sh
+
+NLINES=3000
+
+function feed_fifo () {
+    # Log lines arrive as 'Unknown fifo command: seq-N' - in bursts to create load.
+    # Keep the FIFO open (station reopens it only after a delay on EOF) and keep
+    # bursts below the log buffer high water mark - overflowing it drops lines.
+    exec 3>cmd.fifo
+    for ((n=1;n<=$NLINES;n+=50)); do
+        seq -f 'seq-%g' $n $((n+49 < NLINES ? n+49 : NLINES)) >&3
+        sleep 0.05
+    done
+    exec 3>&-
+}
+
+function run_station () {
+    # $1 -> rotate count
+    rm -f station.log*
+    station -k
+    station --home . --temp . -L station.log,10000,$1 &
+    sleep 1
+    feed_fifo
+    sleep 0.5
+    kill -SIGTERM $(cat station.pid)
+    sleep 0.5
+}
+
+rm -f cmd.fifo
+mkfifo cmd.fifo
+
+banner "Rotation - keep all"
+run_station 30
+python3 check_logs.py station.log 10000 30 $NLINES ""
+
+banner "Rotation - drop oldest"
+run_station 4
+python3 check_logs.py station.log 10000 4 $NLINES ""
+
+banner "Rotation - truncate in place"
+run_station 0
+python3 check_logs.py station.log 10000 0 $NLINES ""
+
+banner "Rotation - compressed"
+export LOGFILE_COMPRESS=true
+run_station 4
+python3 check_logs.py station.log 10000 4 $NLINES ".gz"
+unset LOGFILE_COMPRESS
+
+collect_gcda
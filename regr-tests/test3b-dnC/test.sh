@@ -31,3 +31,10 @@
 python test.py
 banner class C scheduling done
 collect_gcda
+
+# Same with a static TX lead time
+cleanup
+banner 'class C scheduling - static TX lead time'
+TX_AIM_ADAPT=0 python test.py
+banner class C scheduling static done
+collect_gcda _static
@@ -0,0 +1,180 @@
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import sys
+import time
+import json
+import random
+import asyncio
+from asyncio import subprocess
+
+import logging
+logger = logging.getLogger('test3b-dnC_pacing')
+
+import tcutils as tu
+import simutils as su
+import testutils as tstu
+
+
+station = None
+infos = None
+muxs = None
+sim = None
+
+
+DEVA = '00-00-00-00-11-00-00-01'
+DEVB = '00-00-00-00-11-00-00-02'
+DEVM = '00-00-00-00-11-00-00-FF'   # multicast group
+NA = 8      # bulk burst of device A (e.g. FUOTA fragments)
+NB = 3      # frames of device B arriving behind A's burst
+PLEN = 20   # airtime @DR5: ~57ms
+
+
+class TestMuxs(tu.Muxs):
+    exp_seqno = {}
+    dntxed = []
+    seqno = 0
+    ws = None
+    send_task = None
+    ev = None
+
+    async def handle_connection(self, ws):
+        self.ws = ws
+        self.ev = asyncio.Event()
+        self.send_task = asyncio.ensure_future(self.send_classC())
+        await super().handle_connection(ws)
+
+    async def testDone(self, status):
+        global station
+        if station:
+            station.terminate()
+            await station.wait()
+            station = None
+        os._exit(status)
+
+    async def handle_dntxed(self, ws, msg):
+        deveui = msg['DevEui']
+        exp = self.exp_seqno.get(deveui, [])
+        if [msg['seqno']] != exp[0:1]:
+            logger.error('DNTXED: %r\nbut expected seqno=%r' % (msg, exp))
+            await self.testDone(2)
+        del exp[0]
+        self.dntxed.append(msg)
+        self.ev.set()
+
+
+    def make_dnmsgC(self, deveui, rx2dr=5, rx2freq=869.525, plen=PLEN):
+        dnmsg = {
+            'msgtype' : 'dnmsg',
+            'dC'      : 2,          # device class C
+            'dnmode'  : 'dn',
+            'priority': 0,
+            'RX2DR'   : rx2dr,
+            'RX2Freq' : int(rx2freq*1e6),
+            'DevEui'  : deveui,
+            'seqno'   : self.seqno,
+            'MuxTime' : time.time(),
+            'rctx'    : 0,                   # antenna#0
+            'pdu'     : bytes(range(plen)).hex(),
+        }
+        self.exp_seqno.setdefault(deveui, []).append(self.seqno)
+        self.seqno += 1
+        return dnmsg
+
+    async def send_classC(self):
+        # Wait a while until station has synced time with SX130x
+        # otherwise class C gets rejected
+        await asyncio.sleep(3.0)
+        try:
+            # Burst of device A followed by a few frames of device B - without pacing
+            # most of these would run out of backoff retries.
+            burst = [ self.make_dnmsgC(DEVA) for i in range(NA) ] + [ self.make_dnmsgC(DEVB) for i in range(NB) ]
+            for dnmsg in burst:
+                await self.ws.send(json.dumps(dnmsg))
+
+            while len(self.dntxed) < NA+NB:
+                self.ev.clear()
+                await asyncio.wait_for(self.ev.wait(), 5.0)
+            assert all(not q for q in self.exp_seqno.values())
+
+            # Fair sharing: device B must not wait for the whole burst of A
+            order = [ m['DevEui'] for m in self.dntxed ]
+            logger.info('TX order: %s', ' '.join('A' if d == DEVA else 'B' for d in order))
+            assert order.index(DEVB) < len(order) - 1 - order[::-1].index(DEVA), 'device B starved by A'
+
+            t0 = self.dntxed[0]['txtime']
+            t1 = self.dntxed[-1]['txtime']
+            span = t1 - t0
+            logger.info('Class C throughput: %d frames / %d bytes in %.3fs - %.1f frames/s %.0f bytes/s',
+                        len(self.dntxed), len(self.dntxed)*PLEN, span,
+                        (len(self.dntxed)-1)/span, (len(self.dntxed)-1)*PLEN/span)
+
+            # Bulk downlink - FUOTA style fragments for a multicast group, payloads sent once
+            await asyncio.sleep(1.0)
+            self.dntxed = []
+            frags = [ bytes([i]*PLEN).hex() for i in range(2) ]
+            frames = []
+            for i in range(6):
+                frames.append({ 'DevEui': DEVM, 'diid': self.seqno, 'DR': 5, 'Freq': 869525000,
+                                'rctx': 0, 'pdu': i % len(frags) })
+                self.exp_seqno.setdefault(DEVM, []).append(self.seqno)
+                self.seqno += 1
+            await self.ws.send(json.dumps({ 'msgtype': 'dnbulk', 'MuxTime': time.time(),
+                                            'pdus': frags, 'frames': frames }))
+            while len(self.dntxed) < len(frames):
+                self.ev.clear()
+                await asyncio.wait_for(self.ev.wait(), 5.0)
+            assert all(not q for q in self.exp_seqno.values())
+
+            await asyncio.sleep(2.0)     # make sure previous frames are done with TX
+            await self.testDone(0)
+        except Exception as exc:
+            logger.error('send_classC failed: %s', exc, exc_info=True)
+            await self.testDone(1)
+
+
+with open("tc.uri","w") as f:
+    f.write('ws://localhost:6038')
+
+async def test_start():
+    global station, infos, muxs, sim
+    infos = tu.Infos()
+    muxs = TestMuxs()
+    sim = su.LgwSimServer()
+
+    await infos.start_server()
+    await muxs.start_server()
+    await sim.start_server()
+
+    # 'valgrind', '--leak-check=full',
+    station_args = ['station','-p', '--temp', '.']
+    station = await subprocess.create_subprocess_exec(*station_args)
+
+tstu.setup_logging()
+
+asyncio.ensure_future(test_start())
+asyncio.get_event_loop().run_forever()
@@ -0,0 +1,162 @@
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import re
+import sys
+import time
+import json
+import asyncio
+from asyncio import subprocess
+
+import logging
+logger = logging.getLogger('test3e-deflate')
+
+import tcutils as tu
+import simutils as su
+import testutils as tstu
+
+
+station = None
+infos = None
+muxs = None
+sim = None
+
+NUP = 150          # uplinks to send - station logs deflate stats every 100 messages
+MAX_RATIO = 50.0   # compressed size in percent of raw JSON we expect at most
+
+# Station log line with compression stats (see zsLogStats in net.c)
+STATS_RE = re.compile(r'WS deflate: tx (\d+) msgs (\d+)->(\d+) bytes \(([\d.]+)%\) ([\d.]+)us/msg - '
+                      r'rx (\d+) msgs (\d+)->(\d+) bytes \(([\d.]+)%\) ([\d.]+)us/msg')
+
+
+async def testDone(status):
+    global station
+    if station:
+        station.terminate()
+        await station.wait()
+        station = None
+    os._exit(status)
+
+
+class TestLgwSimServer(su.LgwSimServer):
+    fcnt = 0
+    updf_task = None
+
+    async def on_connected(self, lgwsim:su.LgwSim) -> None:
+        self.updf_task = asyncio.ensure_future(self.send_updf())
+
+    async def on_close(self):
+        self.updf_task.cancel()
+        self.updf_task = None
+        logger.debug('LGWSIM - close')
+
+    async def send_updf(self) -> None:
+        try:
+            await asyncio.sleep(2.0)
+            while self.fcnt < NUP:
+                if 0 not in self.units:
+                    return
+                lgwsim = self.units[0]
+                await lgwsim.send_rx(rps=(7,125), freq=869.525,
+                                     frame=su.makeDF(fcnt=self.fcnt, port=1, payload=bytes([self.fcnt&0xFF])*8))
+                self.fcnt += 1
+                await asyncio.sleep(0.02)
+        except asyncio.CancelledError:
+            logger.debug('send_updf canceled.')
+        except Exception as exc:
+            logger.error('send_updf failed!', exc_info=True)
+
+
+class TestMuxs(tu.Muxs):
+    updf = 0
+
+    async def handle_connection(self, ws):
+        exts = [ e.name for e in ws.extensions ]
+        logger.info('MUXS: negotiated extensions: %r', exts)
+        if 'permessage-deflate' not in exts:
+            logger.error('permessage-deflate not negotiated')
+            await testDone(2)
+        await super().handle_connection(ws)
+
+    async def handle_updf(self, ws, msg):
+        # Message arrived intact through inflate - check content
+        if msg['FCnt'] != self.updf or msg['FRMPayload'] != ('%02X' % (self.updf&0xFF))*8:
+            logger.error('UPDF: unexpected %r - expected FCnt=%d', msg, self.updf)
+            await testDone(3)
+        self.updf += 1
+
+
+async def watch_station_log(stream):
+    # Forward station log and evaluate compression stats
+    while True:
+        line = await stream.readline()
+        if not line:
+            break
+        line = line.decode(errors='replace')
+        sys.stderr.write(line)
+        m = STATS_RE.search(line)
+        if not m:
+            continue
+        txmsgs, txraw, txzip = int(m.group(1)), int(m.group(2)), int(m.group(3))
+        ratio, txus = float(m.group(4)), float(m.group(5))
+        rxmsgs, rxzip, rxraw = int(m.group(6)), int(m.group(7)), int(m.group(8))
+        rxus = float(m.group(10))
+        logger.info('Compression: tx %d msgs %d -> %d bytes (%.1f%%) %.1fus/msg - rx %d msgs %d -> %d bytes %.1fus/msg',
+                    txmsgs, txraw, txzip, ratio, txus, rxmsgs, rxraw, rxzip, rxus)
+        if rxmsgs < 1:
+            logger.error('No compressed messages received by station (router_config)')
+            await testDone(4)
+        if ratio > MAX_RATIO:
+            logger.error('Compression ratio %.1f%% worse than expected %.1f%%', ratio, MAX_RATIO)
+            await testDone(5)
+        if muxs.updf >= 100:
+            await testDone(0)
+
+
+with open("tc.uri","w") as f:
+    f.write('ws://localhost:6038')
+
+async def test_start():
+    global station, infos, muxs, sim
+    infos = tu.Infos()
+    muxs = TestMuxs()
+    sim = TestLgwSimServer()
+
+    await infos.start_server()
+    await muxs.start_server()
+    await sim.start_server()
+
+    a = os.environ.get('STATION_ARGS','')
+    args = [] if not a else a.split(' ')
+    station_args = ['station','-p', '--temp', '.'] + args
+    station = await subprocess.create_subprocess_exec(*station_args, stderr=subprocess.PIPE)
+    asyncio.ensure_future(watch_station_log(station.stderr))
+
+tstu.setup_logging()
+
+asyncio.ensure_future(test_start())
+asyncio.get_event_loop().run_forever()
@@ -0,0 +1,134 @@
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+import os
+import re
+import sys
+import asyncio
+from asyncio import subprocess
+
+import logging
+logger = logging.getLogger('test3f-tls-resume')
+
+import tcutils as tu
+import simutils as su
+import testutils as tstu
+
+
+station = None
+infos = None
+muxs = None
+sim = None
+
+NCLOSE = 3         # MUXS drops the connection this many times - each reconnect should resume
+
+# Station log line for completed TLS handshakes (see tlsHandshakeDone in net.c)
+HSHAKE_RE = re.compile(r'TLS handshake with (\S+) (full|resumed) in ([\d.]+)ms')
+
+handshakes = []    # (peer, kind, ms)
+
+
+async def testDone(status):
+    global station
+    if station:
+        station.terminate()
+        await station.wait()
+        station = None
+    os._exit(status)
+
+
+class TestMuxs(tu.Muxs):
+    nconn = 0
+
+    async def handle_version(self, ws, msg):
+        self.nconn += 1
+        logger.info('MUXS: connection #%d', self.nconn)
+        if self.nconn <= NCLOSE:
+            await asyncio.sleep(0.5)
+            await ws.close()
+
+
+def evaluate():
+    muxs_hs = [ h for h in handshakes if h[0].endswith(':6039') ]
+    full    = [ h[2] for h in muxs_hs if h[1] == 'full' ]
+    resumed = [ h[2] for h in muxs_hs if h[1] == 'resumed' ]
+    for peer,kind,ms in handshakes:
+        logger.info('TLS handshake %-20s %-8s %8.1fms', peer, kind, ms)
+    if full:
+        logger.info('MUXS full handshake    avg %8.1fms (%d)', sum(full)/len(full), len(full))
+    if resumed:
+        logger.info('MUXS resumed handshake avg %8.1fms (%d)', sum(resumed)/len(resumed), len(resumed))
+    if len(muxs_hs) < NCLOSE+1:
+        return None
+    if muxs_hs[0][1] != 'full' or len(resumed) != NCLOSE:
+        logger.error('Expected first MUXS handshake to be full and all reconnects resumed: %r', muxs_hs)
+        return 2
+    if not os.path.exists('tls-tc.session'):
+        logger.error('TLS_SESSION_PERSIST set but no session file written')
+        return 3
+    return 0
+
+
+async def watch_station_log(stream):
+    while True:
+        line = await stream.readline()
+        if not line:
+            break
+        line = line.decode(errors='replace')
+        sys.stderr.write(line)
+        m = HSHAKE_RE.search(line)
+        if not m:
+            continue
+        handshakes.append((m.group(1), m.group(2), float(m.group(3))))
+        status = evaluate()
+        if status is not None:
+            await testDone(status)
+
+
+with open("tc.uri","w") as f:
+    f.write('wss://localhost:6038')
+
+async def test_start():
+    global station, infos, muxs, sim
+    infos = tu.Infos(muxsuri='wss://localhost:6039/router', tlsidentity='infos-0')
+    muxs = TestMuxs(tlsidentity='muxs-0')
+    sim = su.LgwSimServer()
+
+    await infos.start_server()
+    await muxs.start_server()
+    await sim.start_server()
+
+    a = os.environ.get('STATION_ARGS','')
+    args = [] if not a else a.split(' ')
+    station_args = ['station','-p', '--temp', '.'] + args
+    station = await subprocess.create_subprocess_exec(*station_args, stderr=subprocess.PIPE)
+    asyncio.ensure_future(watch_station_log(station.stderr))
+
+tstu.setup_logging()
+
+asyncio.ensure_future(test_start())
+asyncio.get_event_loop().run_forever()
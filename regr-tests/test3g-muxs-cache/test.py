@@ -0,0 +1,141 @@
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+import os
+import sys
+import asyncio
+from asyncio import subprocess
+
+import logging
+logger = logging.getLogger('test3g-muxs-cache')
+
+import tcutils as tu
+import simutils as su
+import testutils as tstu
+
+
+station = None
+infos = None
+muxs = None
+sim = None
+
+DOWNTIME = 2.5     # MUXS refuses connections for this long after dropping the station
+
+# MUXS_GONE=1: MUXS stays down - after one failed direct reconnect station
+# must go back to INFOS within the INFOS backoff and not keep retrying the muxs.
+MUXS_GONE = os.environ.get('MUXS_GONE','') == '1'
+GONE_DEADLINE = 16  # 1s+2s muxs backoff, 10s INFOS backoff + slack
+
+
+async def testDone(status):
+    global station
+    if station:
+        station.terminate()
+        await station.wait()
+        station = None
+    os._exit(status)
+
+
+class TestInfos(tu.Infos):
+    nconn = 0
+
+    async def handle_ws(self, ws, path):
+        self.nconn += 1
+        logger.info('INFOS: connection #%d', self.nconn)
+        if self.nconn > 1:
+            if not MUXS_GONE:
+                logger.error('Station asked INFOS again after losing MUXS')
+                await testDone(2)
+            dt = asyncio.get_event_loop().time() - muxs.dropped
+            logger.info('INFOS: station back after %.1fs', dt)
+            await testDone(0 if dt < GONE_DEADLINE else 5)
+        await super().handle_ws(ws, path)
+
+
+class TestMuxs(tu.Muxs):
+    nconn = 0
+    dropped = None
+
+    async def handle_version(self, ws, msg):
+        self.nconn += 1
+        logger.info('MUXS: connection #%d', self.nconn)
+        if self.nconn == 1:
+            # Drop the station and refuse reconnects for a while -
+            # station must retry the muxs URI it has and not go back to INFOS.
+            await asyncio.sleep(0.5)
+            self.dropped = asyncio.get_event_loop().time()
+            asyncio.ensure_future(self.restart())
+            await ws.close()
+            return
+        if MUXS_GONE:
+            logger.error('MUXS came back although it was gone')
+            await testDone(6)
+        if infos.nconn != 1:
+            logger.error('Expected exactly one INFOS request - got %d', infos.nconn)
+            await testDone(3)
+        await testDone(0)
+
+    async def restart(self):
+        self.server.close()
+        await self.server.wait_closed()
+        if MUXS_GONE:
+            logger.info('MUXS: gone')
+            return
+        logger.info('MUXS: down for %.1fs', DOWNTIME)
+        await asyncio.sleep(DOWNTIME)
+        await self.start_server()
+
+
+async def timeout():
+    await asyncio.sleep(30)
+    logger.error('Station did not reconnect to MUXS')
+    await testDone(4)
+
+
+with open("tc.uri","w") as f:
+    f.write('ws://localhost:6038')
+
+async def test_start():
+    global station, infos, muxs, sim
+    infos = TestInfos()
+    muxs = TestMuxs()
+    sim = su.LgwSimServer()
+
+    await infos.start_server()
+    await muxs.start_server()
+    await sim.start_server()
+
+    a = os.environ.get('STATION_ARGS','')
+    args = [] if not a else a.split(' ')
+    station_args = ['station','-p', '--temp', '.'] + args
+    station = await subprocess.create_subprocess_exec(*station_args)
+    asyncio.ensure_future(timeout())
+
+tstu.setup_logging()
+
+asyncio.ensure_future(test_start())
+asyncio.get_event_loop().run_forever()
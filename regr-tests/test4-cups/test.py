@@ -31,6 +31,7 @@ import time
 import json
 import asyncio
 from asyncio import subprocess
+from aiohttp import web
 
 import logging
 logger = logging.getLogger('test4-cups')
@@ -98,6 +99,9 @@ class TestMuxs(tu.Muxs):
     restart_station_handle = None
 
     async def testDone(self, status):
+        if status == 0 and resume_mode and not TestCups.resumed:
+            logger.error('Update download was cut but never resumed')
+            status = 1
         if self.restart_station_handle:
             self.restart_station_handle.cancel()
             self.restart_station_handle = None
@@ -162,6 +166,10 @@ class TestMuxs(tu.Muxs):
 
 class TestCups(tu.Cups):
     qcnt = 0
+    fwlen = 0
+    # Shared by all CUPS instances - in resume mode the first update transfer is cut halfway
+    cut = False
+    resumed = False
 
     def on_response(self, r_cupsUri:bytes, r_tcUri:bytes, r_cupsCred:bytes, r_tcCred:bytes, r_sig:bytes, r_updbin:bytes) -> bytes:
         logger.debug("cupsUri={}, cupsCred={} ({})".format(r_cupsUri, r_cupsCred[2:6].hex(), r_cupsCred[0:2].hex()))
@@ -170,13 +178,33 @@ class TestCups(tu.Cups):
             b = super().on_response(r_cupsUri, r_tcUri, r_cupsCred, r_tcCred, r_sig, r_updbin)
             if b == b'\x00'*14:
                 self.qcnt += 1
+            self.fwlen = len(r_updbin)-4
             return b
         except Exception as exc:
             logger.error('on_response failed: %s', exc, exc_info=True)
 
+    async def send_response(self, request, body:bytes, headers):
+        if 'X-Update-Offset' in headers:
+            logger.debug('CUPS resuming update at offset %s', headers['X-Update-Offset'])
+            TestCups.resumed = True
+        if not resume_mode or TestCups.cut or self.fwlen <= 0:
+            return await super().send_response(request, body, headers)
+        # Drop the connection in the middle of the update segment
+        TestCups.cut = True
+        cut = len(body) - self.fwlen//2
+        logger.debug('CUPS cutting connection after %d of %d bytes', cut, len(body))
+        resp = web.StreamResponse(headers=headers)
+        resp.content_length = len(body)
+        await resp.prepare(request)
+        await resp.write(body[0:cut])
+        await asyncio.sleep(0.5)
+        request.transport.close()
+        return resp
+
 
 tls_mode  = (sys.argv[1:2] == ['tls'])
 tls_no_ca = (sys.argv[2:3] == ['no_ca'])
+resume_mode = (sys.argv[1:2] == ['resume'])
 
 isTLS = 's' if tls_mode else ''
 
@@ -187,8 +215,8 @@ with open("_cups/cups-router-1.cfg","w") as f:
         ('{'
         '"cupsUri": "http%s://localhost:6040",'
         '"tcUri"  : "ws%s://localhost:6038",'
-        '"version": "v1"'
-        '}') % (isTLS, isTLS))
+        '"version": "%s"'
+        '}') % (isTLS, isTLS, 'v2' if resume_mode else 'v1'))
 
 async def test_start():
     global station, infos, muxs, cups, sim
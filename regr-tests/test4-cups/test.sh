@@ -114,6 +114,28 @@ function test_tls_auth() {
     check_updtest TLS
 }
 
+function test_resume() {
+    # Update download interrupted halfway - must resume and verify signature ====
+    banner Resume update - Starting...
+    setup_A
+    # Update spanning many CUPS_BUFSZ chunks - signed with a throw-away key
+    sed -e 's/v1/v2/' v1.bin > _cups/v2.bin
+    head -c 65536 /dev/zero | tr '\0' '#' | fold -w 64 >> _cups/v2.bin
+    echo >> _cups/v2.bin
+    openssl ecparam -name prime256v1 -genkey -noout -out _cups/sig-0.pem
+    openssl ec -in _cups/sig-0.pem -pubout -outform DER 2>/dev/null | tail -c 64 > _cups/sig-0.key
+    openssl dgst -sha512 -sign _cups/sig-0.pem -out _cups/v2.bin.sig-0 _cups/v2.bin
+    cp _cups/sig-0.key _shome/
+
+    echo "v0" > _shome/version.txt
+    rm -f _shome/updtest.txt /tmp/update.bin
+    python test.py resume
+    banner Resume update - DONE
+    collect_gcda _resume
+    check_updtest RESUME
+}
+
 test_plain
+test_resume
 test_tls_noauth
 test_tls_auth
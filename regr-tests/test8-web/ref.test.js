@@ -1,5 +1,6 @@
 HTTP/1.1 200 OK
 Content-Type: application/javascript
 Content-Encoding: identity
+Content-Length: 15
 
 function () {}
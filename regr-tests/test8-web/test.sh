@@ -33,7 +33,7 @@ function curlit () {
     local path=$2
     local ref=ref.$(echo $path | tr / .)
     local msg=" CURL    $path vs $ref"
-    local resp=`curl --noproxy 127.0.0.1 -sD - http://127.0.0.1:8080/$path`
+    local resp=`curl --noproxy 127.0.0.1 -sD - http://127.0.0.1:8080/$path | sed -e '/^ETag:/d'`
     if [ "$resp" != "" ]; then
         echo "$resp" | diff - $ref \
             || (echo "[FAILED] $msg" && (cat station.log) && false)
@@ -62,11 +62,42 @@ curl --noproxy 127.0.0.1 -sD - http://127.0.0.1:8080/version -o /dev/null
 curl --noproxy 127.0.0.1 -sD - -X POST http://127.0.0.1:8080/version -o /dev/null
 curl --noproxy 127.0.0.1 -sD - http://127.0.0.1:8080/api -o /dev/null
 
+echo "---- Testing Metrics"
+metrics=`curl --noproxy 127.0.0.1 -s http://127.0.0.1:8080/metrics`
+for m in station_rx_frames_total station_ws_tx_bytes_total station_ral_rx_crcbad_total station_ral_startup_seconds_count station_ral_startup_lgwstart_us station_lns_connected; do
+    echo "$metrics" | grep -q "^$m " || (echo "[FAILED] metric $m missing" && echo "$metrics" && false)
+done
+echo "$metrics" | grep -q '^station_ral_tx_seconds_bucket{le="+Inf"} ' || (echo "[FAILED] metric station_ral_tx_seconds missing" && echo "$metrics" && false)
+code=`curl --noproxy 127.0.0.1 -s -o /dev/null -w '%{http_code}' -X POST http://127.0.0.1:8080/metrics`
+[ "$code" == "405" ] || (echo "[FAILED] POST /metrics: $code" && false)
+
 
 echo "---- Testing Big Resource HTTP Requests"
-head -c 60k /dev/urandom | gzip > web/toobig.gz
-curlit false toobig.gz
-rm web/toobig.gz
+# Files are streamed - size is not limited by the connection buffer
+head -c 60k /dev/urandom | gzip > web/big.gz
+curl --noproxy 127.0.0.1 -s http://127.0.0.1:8080/big.gz -o _big.gz
+cmp web/big.gz _big.gz || (echo "[FAILED] big.gz corrupted" && false)
+rm -f web/big.gz _big.gz
+
+echo "---- Testing Keep-Alive, ETag and Concurrent Connections"
+# Second request must reuse the connection
+nconn=`curl --noproxy 127.0.0.1 -s -o /dev/null -o /dev/null -w '%{num_connects}' http://127.0.0.1:8080/a http://127.0.0.1:8080/sub/b.txt`
+[ "$nconn" == "10" ] || (echo "[FAILED] keep-alive: connects=$nconn" && false)
+etag=`curl --noproxy 127.0.0.1 -sD - -o /dev/null http://127.0.0.1:8080/a | tr -d '\r' | sed -n -e 's/^ETag: *//p'`
+[ -n "$etag" ] || (echo "[FAILED] no ETag" && false)
+code=`curl --noproxy 127.0.0.1 -s -o /dev/null -w '%{http_code}' -H "If-None-Match: $etag" http://127.0.0.1:8080/a`
+[ "$code" == "304" ] || (echo "[FAILED] If-None-Match: $code" && false)
+# Entity tag lists - whole tags must match, W/ is ignored, * only as entire value
+for inm in "304~\"x\", W/$etag" "304~*" "200~\"x\", *" "200~\"x${etag:1}" "200~${etag%\"}x\"" "200~\"${etag}\""; do
+    code=`curl --noproxy 127.0.0.1 -s -o /dev/null -w '%{http_code}' -H "If-None-Match: ${inm#*~}" http://127.0.0.1:8080/a`
+    [ "$code" == "${inm%%~*}" ] || (echo "[FAILED] If-None-Match: ${inm#*~} -> $code" && false)
+done
+# An idle client must not block others
+(sleep 3 | nc 127.0.0.1 8080 > /dev/null) &
+idle=$!
+sleep 0.5
+curlit false a
+wait $idle
 
 echo "---- Testing Broken HTTP Requests"
 
@@ -75,7 +106,7 @@ function ncit () {
     # $2 -> reqlist entry
     local REQ="${2%%~*}"
     local REF="${2##*~}"
-    local resp="`printf "$REQ" | nc -N 127.0.0.1 8080`"
+    local resp="`printf "$REQ" | nc -N 127.0.0.1 8080 | sed -e '/^ETag:/d'`"
     if [ "$REF" == "DONTCARE" ]; then
         return 0
     fi
@@ -155,4 +186,19 @@ kill -SIGTERM $(cat station.pid)
 
 sleep 0.5
 
+echo "---- Testing Generated Content Bigger Than Connection Buffer"
+# /metrics output exceeds a 2KB connection buffer - must be streamed, not rejected (507)
+CUPS_BUFSZ=2 station --temp . -f -L station.log -l DEBUG &
+sleep 1
+curl --noproxy 127.0.0.1 -s -D _hdr http://127.0.0.1:8080/metrics -o _metrics
+code=`sed -n -e '1s/^HTTP\/1.1 \([0-9]*\).*/\1/p' _hdr`
+clen=`tr -d '\r' < _hdr | sed -n -e 's/^Content-Length: *//p'`
+[ "$code" == "200" ] || (echo "[FAILED] /metrics with small buffer: $code" && false)
+[ "$clen" -gt 2048 ] && [ "$clen" == "`wc -c < _metrics`" ] || (echo "[FAILED] /metrics size: $clen vs `wc -c < _metrics`" && false)
+grep -q '^station_lns_connected ' _metrics || (echo "[FAILED] /metrics truncated" && cat _metrics && false)
+rm -f _hdr _metrics
+kill -SIGTERM $(cat station.pid)
+
+sleep 0.5
+
 collect_gcda _web
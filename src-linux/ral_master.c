@@ -47,6 +47,7 @@
 #include "sx130xconf.h"
 #include "ral.h"
 #include "ralsub.h"
+#include "metrics.h"
 
 
 #define WAIT_SLAVE_PID_INTV rt_millis(500)
@@ -54,6 +55,8 @@
 #define RETRY_PIPE_IO       500
 #define PPM                 1000000
 
+enum { START_IDLE, START_PENDING, START_OK, START_FAILED };
+
 typedef struct slave {
     tmr_t      tmr;
     tmr_t      tsync;
@@ -64,8 +67,11 @@ typedef struct slave {
     u1_t       killCnt;
     u1_t       restartCnt;
     u1_t       antennaType;
-    dbuf_t     sx1301confJson;
+    u1_t       startState;   // START_*
+    ustime_t   startTime;    // config sent to slave
+    u4_t       rxCrcBad;     // last counter reported by slave
     chdefl_t   upchs;
+    struct sx130xconf_bin sx130xconf;  // compiled radio config (magic==0 if none)
     int        last_expcmd;
     // Read Spill Buffer
     struct {
@@ -79,10 +85,27 @@ static int    n_slaves;
 static slave_t* slaves;
 static pid_t    master_pid;
 static u4_t     region;
+static ustime_t configTime;  // start of last ral_config - 0 once first uplink was seen
+static ustime_t startT0;     // start of pending concentrator bring-up - 0 if none
+static int      startPending;// slaves which have not yet reported back on their config
+static tmr_t    startTmr;    // deadline for bring-up
+static tmr_t*   startWaiter; // fired once bring-up is over
+static tmrcb_t  startCb;
 
 
 // Fwd decl
 static void restart_slave (tmr_t* tmr);
+static void slave_started (slave_t* slave, u1_t startState);
+
+// TX responses carry the slave's submission latency - all other synchronous responses are generic
+static int resp_size (u1_t cmd) {
+    return cmd == RAL_CMD_TX ? sizeof(struct ral_tx_resp) : sizeof(struct ral_response);
+}
+
+static void tx_done (slave_t* slave, struct ral_tx_resp* resp) {
+    if( TC )
+        s2e_txLatency(&TC->s2ctx, (int)(slave-slaves), resp->txlat);
+}
 
 static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd, struct ral_response* expresp) {
     u1_t slave_idx = (int)(slave-slaves);
@@ -93,6 +116,8 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
         if( n == 0 ) {
             // EOF
             LOG(MOD_RAL|ERROR, "Slave (%d) - EOF", slave_idx);
+            if( slave->startState == START_PENDING )
+                slave_started(slave, START_FAILED);
             rt_yieldTo(&slave->tmr, restart_slave);
             return expok;
         }
@@ -130,28 +155,55 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
                 dlen = slave->rsb.off;
             }
             if( expcmd >= 0 && hdr->cmd == expcmd ) {
-                if( (slave->rsb.exp = sizeof(struct ral_response)) > dlen ) goto spill;
+                if( (slave->rsb.exp = resp_size(hdr->cmd)) > dlen ) goto spill;
                 *expresp = *(struct ral_response*)hdr;
-                consumed = sizeof(*expresp);
+                if( hdr->cmd == RAL_CMD_TX )
+                    tx_done(slave, (struct ral_tx_resp*)hdr);
+                consumed = slave->rsb.exp;
                 expok = 1;
                 slave->last_expcmd = expcmd = -1;
             }
             else if( slave->last_expcmd >= 0 && hdr->cmd == slave->last_expcmd ) {
-                if( (slave->rsb.exp = sizeof(struct ral_response)) > dlen ) goto spill;
+                if( (slave->rsb.exp = resp_size(hdr->cmd)) > dlen ) goto spill;
                 LOG(MOD_RAL|WARNING, "Slave (%d) responded to expired synchronous cmd: %d. Ignoring.", slave_idx, hdr->cmd);
-                consumed = sizeof(struct ral_response);
+                consumed = slave->rsb.exp;
                 slave->last_expcmd = -1;
             }
+            else if( hdr->cmd == RAL_CMD_TX ) {
+                // Without LBT the master does not wait for the TX response
+                if( (slave->rsb.exp = sizeof(struct ral_tx_resp)) > dlen ) goto spill;
+                tx_done(slave, (struct ral_tx_resp*)hdr);
+                consumed = sizeof(struct ral_tx_resp);
+            }
             else if( hdr->cmd == RAL_CMD_TIMESYNC ) {
                 if( (slave->rsb.exp= sizeof(struct ral_timesync_resp)) > dlen ) goto spill;
                 struct ral_timesync_resp* resp = (struct ral_timesync_resp*)hdr;
                 ustime_t delay = ts_updateTimesync(slave_idx, resp->quality, &resp->timesync);
+                metrics.ralRxCrcBad += resp->rxCrcBad - slave->rxCrcBad;
+                slave->rxCrcBad = resp->rxCrcBad;
                 rt_setTimer(&slave->tsync, rt_micros_ahead(delay));
                 consumed = sizeof(*resp);
             }
+            else if( hdr->cmd == RAL_CMD_CONFIG ) {
+                if( (slave->rsb.exp = sizeof(struct ral_config_resp)) > dlen ) goto spill;
+                struct ral_config_resp* resp = (struct ral_config_resp*)hdr;
+                LOG(MOD_RAL|INFO, "Slave (%d) concentrator up after %~T - radio init %~T, setconf %~T, LBT %~T, lgw_start %~T",
+                    slave_idx, rt_getTime() - slave->startTime,
+                    (ustime_t)resp->phases[MP_RADIO_INIT], (ustime_t)resp->phases[MP_SETCONF],
+                    (ustime_t)resp->phases[MP_LBT], (ustime_t)resp->phases[MP_LGW_START]);
+                for( int p=0; p < MP_MAX; p++ )
+                    metrics.ralStartup[p] = max(metrics.ralStartup[p], resp->phases[p]);
+                slave_started(slave, resp->status ? START_OK : START_FAILED);
+                consumed = sizeof(*resp);
+            }
             else if( hdr->cmd == RAL_CMD_RX ) {
                 if( (slave->rsb.exp = sizeof(struct ral_rx_resp)) > dlen ) goto spill;
                 struct ral_rx_resp* resp = (struct ral_rx_resp*)hdr;
+                metrics.ralRxPkts += 1;
+                if( configTime ) {
+                    metrics_observe(MH_RAL_FIRST_RX, (rt_getTime() - configTime) / 1e6);
+                    configTime = 0;
+                }
                 rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
                 if( rxjob != NULL ) {
                     memcpy(&TC->s2ctx.rxq.rxdata[rxjob->off], resp->rxdata, resp->rxlen);
@@ -164,12 +216,14 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
                     rxjob->dr = s2e_rps2dr(&TC->s2ctx, resp->rps);
                     if( rxjob->dr == DR_ILLEGAL ) {
                         LOG(MOD_RAL|ERROR, "Unable to map to an up DR: %R", resp->rps);
+                        metrics.ralRxDropped += 1;
                     } else {
                         s2e_addRxjob(&TC->s2ctx, rxjob);
                         s2e_flushRxjobs(&TC->s2ctx); // XXX
                     }
                 } else {
                     LOG(MOD_RAL|ERROR, "Slave (%d) has RX frame dropped - out of space", slave_idx);
+                    metrics.ralRxDropped += 1;
                 }
                 consumed = sizeof(*resp);
             }
@@ -343,20 +397,69 @@ static int write_slave_pipe (slave_t* slave, void* data, int len) {
 
 
 static void send_config (slave_t* slave) {
-    struct ral_config_req req = { .cmd = RAL_CMD_CONFIG, .rctx = 0 };
-    strcpy(req.hwspec, "sx1301/1");
-    int jlen = slave->sx1301confJson.bufsize;
-    if( jlen > sizeof(req.json) )
-        rt_fatal("JSON of sx1301conf to big for pipe: %d > %d", jlen, sizeof(req.json));
-    if( jlen > 0 ) {
-        req.region = region;
-        req.jsonlen = jlen;
-        req.upchs = slave->upchs;
-        memcpy(req.json, slave->sx1301confJson.buf, jlen);
-        LOG(MOD_RAL|INFO, "Master sending %d bytes of JSON sx1301conf to slave (%d)", jlen, (int)(slave-slaves));
-        if( !write_slave_pipe(slave, &req, sizeof(req)) )
-            rt_fatal("Failed to send sx1301conf");
+    if( slave->sx130xconf.magic == 0 )
+        return;  // no router_config yet or slave not used by region plan
+    struct ral_config_req req = { .cmd = RAL_CMD_CONFIG, .rctx = 0, .region = region, .sx130xconf = slave->sx130xconf };
+    LOG(MOD_RAL|INFO, "Master sending compiled sx1301conf to slave (%d) - %d bytes crc=0x%08X",
+        (int)(slave-slaves), (int)sizeof(req.sx130xconf), req.sx130xconf.crc);
+    if( !write_slave_pipe(slave, &req, sizeof(req)) )
+        rt_fatal("Failed to send sx1301conf");
+    if( startT0 && slave->startState != START_PENDING )
+        startPending += 1;
+    slave->startState = START_PENDING;
+    slave->startTime = rt_getTime();
+}
+
+
+// Slaves bring up their concentrators concurrently. Bring-up is over once all of them
+// reported back (or died) or RADIO_START_WAIT expired - only then readiness is signaled.
+static void finish_start () {
+    ustime_t dt = rt_getTime() - startT0;
+    int nup = 0, ncfg = 0;
+    for( int i=0; i < n_slaves; i++ ) {
+        ncfg += slaves[i].startState != START_IDLE;
+        nup  += slaves[i].startState == START_OK;
+    }
+    LOG(MOD_RAL|INFO, "%d of %d concentrators up after %~T", nup, ncfg, dt);
+    metrics_observe(MH_RAL_START, dt / 1e6);
+    startT0 = 0;
+    startPending = 0;
+    rt_clrTimer(&startTmr);
+    if( startWaiter ) {
+        rt_yieldTo(startWaiter, startCb);
+        startWaiter = NULL;
+    }
+}
+
+static void start_timeout (tmr_t* tmr) {
+    LOG(MOD_RAL|WARNING, "%d slave(s) did not bring up their concentrator within %~T", startPending, RADIO_START_WAIT);
+    finish_start();
+}
+
+static void slave_started (slave_t* slave, u1_t startState) {
+    int pending = slave->startState == START_PENDING;
+    slave->startState = startState;
+    if( pending && startT0 && --startPending <= 0 )
+        finish_start();
+}
+
+
+// Parse station.conf/slave-N.conf plus the router_config JSON and allocate channels on
+// behalf of slave slaveIdx. Result is kept by the master and resent on every slave restart.
+static int compile_config (int slaveIdx, dbuf_t json, chdefl_t* upchs, struct sx130xconf_bin* bin) {
+    struct sx130xconf sx130xconf;
+    // Device paths may refer to the slave index (e.g. /dev/spidev?.0) - resolve them as the slave would
+    s1_t masterIdx = sys_slaveIdx;
+    sys_slaveIdx = slaveIdx;
+    int ok = sx130xconf_parse_setup(&sx130xconf, slaveIdx, "sx1301/1", json.buf, json.bufsize) &&
+        sx130xconf_challoc(&sx130xconf, upchs);
+    sys_slaveIdx = masterIdx;
+    if( !ok ) {
+        LOG(MOD_RAL|ERROR, "Failed to compile sx1301conf for slave (%d)", slaveIdx);
+        return 0;
     }
+    sx130xconf_compile(bin, &sx130xconf);
+    return 1;
 }
 
 
@@ -416,6 +519,7 @@ static void restart_slave (tmr_t* tmr) {
     close(up[1]);
     close(dn[0]);
     slave->pid = pid;
+    slave->rxCrcBad = 0;
     send_config(slave);
     pipe_read(slave->up);
     rt_yieldTo(&slave->tmr, recheck_slave);
@@ -465,6 +569,7 @@ int ral_tx (txjob_t* txjob, s2ctx_t* s2ctx, int nocca) {
     req.txpow = txjob->txpow;
     req.addcrc = txjob->addcrc;
     req.txlen = txjob->len;
+    req.reqtime = rt_getTime();
     memcpy(req.txdata, &s2ctx->txq.txdata[txjob->off], txjob->len);
     if( !write_slave_pipe(slave, &req, sizeof(req)) )
         return RAL_TX_FAIL;
@@ -513,7 +618,7 @@ static void slave_challoc_cb (void* ctx, challoc_t* ch, int flag) {
         break;
     }
     case CHALLOC_CH: {
-        if( ch->chip > n1301 ) break;
+        if( ch->chip >= n1301 || ch->chip >= n_slaves ) break;
         slaves[ch->chip].upchs.freq[ch->chan] = ch->chdef.freq;
         slaves[ch->chip].upchs.rps[ch->chan] = ch->chdef.rps;
         break;
@@ -532,25 +637,29 @@ int ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t
         LOG(MOD_RAL|ERROR, "Unsupported hwspec=%s", hwspec);
         return 0;
     }
-    for( int i=0; i<n_slaves; i++ )
-        dbuf_free(&slaves[i].sx1301confJson);
+    dbuf_t jsons[MAX_TXUNITS];
+    struct sx130xconf_bin bins[MAX_TXUNITS];
+    ustime_t t0 = rt_getTime();
+    int ok = 0;
+    memset(jsons, 0, sizeof(jsons));
+    memset(bins, 0, sizeof(bins));
 
     ujdec_t D;
     uj_iniDecoder(&D, json, jsonlen);
     if( uj_decode(&D) ) {
         LOG(MOD_RAL|ERROR, "Parsing of sx1301 channel setup JSON failed");
-        return 0;
+        goto done;
     }
     if( uj_null(&D) ) {
         LOG(MOD_RAL|ERROR, "sx1301_conf is null but a hw setup IS required - no fallbacks");
-        return 0;
+        goto done;
     }
     uj_enterArray(&D);
     int slaveIdx, n1301=0;
     while( (slaveIdx = uj_nextSlot(&D)) >= 0 ) {
         n1301 = slaveIdx+1;
         if( slaveIdx < n_slaves ) {
-            slaves[slaveIdx].sx1301confJson = dbuf_dup(uj_skipValue(&D));
+            jsons[slaveIdx] = dbuf_dup(uj_skipValue(&D));
         } else {
             uj_skipValue(&D);
         }
@@ -559,20 +668,22 @@ int ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t
     uj_assertEOF(&D);
     if( n1301 == 0 ) {
         LOG(MOD_RAL|ERROR, "sx1301_conf is empty but a hw setup IS required - no fallbacks");
-        return 0;
+        goto done;
     }
 
+    for( int i=0; i<n_slaves; i++ )
+        memset(&slaves[i].upchs, 0, sizeof(slaves[i].upchs));
     ral_challoc(upchs, slave_challoc_cb, &n1301);
 
     str_t s = hwspec+7;
     int specn = rt_readDec(&s);
     if( specn != n1301 ) {
         LOG(MOD_RAL|ERROR, "hwspec=%s and size of sx1301_conf array (%d) not in sync", hwspec, n1301);
-        return 0;
+        goto done;
     }
     if( n1301 > n_slaves ) {
         LOG(MOD_RAL|ERROR, "Region plan asks for hwspec=%s which exceeds actual hardware: sx1301/%d", hwspec, n_slaves);
-        return 0;
+        goto done;
     }
     if( n1301 < n_slaves ) {
         if( n_slaves % n1301 != 0 ) {
@@ -581,7 +692,7 @@ int ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t
         } else {
             for( int si=n1301, sj=0; si < n_slaves; si++, sj=(sj+1)%n1301 ) {
                 slaves[si].upchs = slaves[sj].upchs;
-                slaves[si].sx1301confJson = dbuf_dup(slaves[sj].sx1301confJson);
+                jsons[si] = dbuf_dup(jsons[sj]);
             }
             LOG(MOD_RAL|WARNING, "Region plan hwspec '%s' replicated %d times onto slaves 'sx1301/%d' - assuming antenna diversity",
                 hwspec, n_slaves/n1301, n_slaves);
@@ -589,11 +700,29 @@ int ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t
     } else {
         LOG(MOD_RAL|INFO, "Region plan hwspec '%s' mapped to %d slaves 'sx1301/1'", hwspec, n_slaves);
     }
+    for( int i=0; i < n_slaves; i++ ) {
+        if( jsons[i].buf != NULL && !compile_config(i, jsons[i], &slaves[i].upchs, &bins[i]) )
+            goto done;
+    }
     region = cca_region;
+    memset(metrics.ralStartup, 0, sizeof(metrics.ralStartup));
+    configTime = t0;
+    startT0 = t0;
+    startPending = 0;
     for( int i=0; i < n_slaves; i++ ) {
+        slaves[i].startState = START_IDLE;
+        slaves[i].sx130xconf = bins[i];
         send_config(&slaves[i]);
     }
-    return 1;
+    if( startPending == 0 )
+        finish_start();
+    else
+        rt_setTimer(&startTmr, t0 + RADIO_START_WAIT);
+    ok = 1;
+ done:
+    for( int i=0; i<n_slaves; i++ )
+        dbuf_free(&jsons[i]);
+    return ok;
 }
 
 
@@ -633,6 +762,7 @@ void ral_ini () {
     atexit(killAllSlaves);
     signal(SIGPIPE, SIG_IGN);
 
+    rt_iniTimer(&startTmr, start_timeout);
     for( int i=0; i<n_slaves; i++ ) {
         rt_iniTimer(&slaves[i].tmr, NULL);
         rt_iniTimer(&slaves[i].tsync, req_timesync);
@@ -641,8 +771,22 @@ void ral_ini () {
 }
 
 
+void ral_onStarted (tmr_t* tmr, tmrcb_t cb) {
+    if( startT0 == 0 ) {
+        rt_yieldTo(tmr, cb);
+        return;
+    }
+    startWaiter = tmr;
+    startCb = cb;
+}
+
+
 void ral_stop () {
     struct ral_timesync_req req = { .cmd = RAL_CMD_STOP, .rctx = 0 };
+    rt_clrTimer(&startTmr);
+    startT0 = 0;
+    startPending = 0;
+    startWaiter = NULL;
     for( int slaveIdx=0; slaveIdx < n_slaves; slaveIdx++ ) {
         slave_t* slave = &slaves[slaveIdx];
         rt_clrTimer(&slave->tsync);
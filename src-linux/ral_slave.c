@@ -52,6 +52,7 @@ static tmr_t  rxpoll_tmr;
 static aio_t* rd_aio;
 static aio_t* wr_aio;
 static s2_t   txpowAdjust; // scaled by TXPOW_SCALE
+static u4_t   rxCrcBad;    // reported to master with timesync
 static struct lgw_pkt_rx_s pkt_rx[LGW_PKT_FIFO_SIZE];
 
 
@@ -107,9 +108,10 @@ static void rx_polling (tmr_t* tmr) {
         for( int i=0; i<n; i++ ) {
             struct lgw_pkt_rx_s* p = &pkt_rx[i];
             if( p->status != STAT_CRC_OK ) {
-                if( log_shallLog(MOD_RAL|DEBUG) ) {
+                if( LOG_ENABLED(MOD_RAL|DEBUG) ) {
                     log_rawpkt(DEBUG, "", p);
                 }
+                rxCrcBad += 1;
                 continue; // silently ignore bad CRC
             }
             if( p->size > MAX_RXFRAME_LEN ) {
@@ -134,7 +136,7 @@ static void rx_polling (tmr_t* tmr) {
             resp.rxlen  = p->size;
             memcpy(resp.rxdata, p->payload, p->size);
 
-            if( log_shallLog(MOD_RAL|XDEBUG) ) {
+            if( LOG_ENABLED(MOD_RAL|XDEBUG) ) {
                 log_rawpkt(XDEBUG, "", p);
             }
 
@@ -150,6 +152,7 @@ static void sendTimesync () {
     resp.rctx = sys_slaveIdx;
     resp.cmd = RAL_CMD_TIMESYNC;
     resp.quality = ral_getTimesync(pps_en, &last_xtime, &resp.timesync);
+    resp.rxCrcBad = rxCrcBad;
     pipe_write_data(&resp, sizeof(resp));
 }
 
@@ -234,34 +237,33 @@ static void pipe_read (aio_t* aio) {
 #else
                 int err = lgw_send(pkt_tx);
 #endif
-                if( region == 0 ) {
-                    continue;
-                }
-                // Send back CCA/LBT result
-                struct ral_response* resp = (struct ral_response*)req;
-                u1_t ret = RAL_TX_OK;
+                // Send back CCA/LBT result and how long it took to get the frame into the radio
+                struct ral_tx_resp resp = { .rctx = txreq->rctx, .cmd = RAL_CMD_TX };
+                resp.txlat = max(0, rt_getTime() - txreq->reqtime);
                 if( err == LGW_HAL_SUCCESS ) {
-                    ret = RAL_TX_OK;
+                    resp.status = RAL_TX_OK;
                 } else if( err == LGW_LBT_ISSUE ) {
-                    ret = RAL_TX_NOCA;
+                    resp.status = RAL_TX_NOCA;
                 } else {
                     LOG(MOD_RAL|ERROR, "lgw_send failed");
-                    ret = RAL_TX_FAIL;
+                    resp.status = RAL_TX_FAIL;
                 }
-                resp->status = ret;
-                pipe_write_data(resp, sizeof(*resp));
+                pipe_write_data(&resp, sizeof(resp));
                 continue;
             }
             else if( n >= off + sizeof(struct ral_config_req) && req->cmd == RAL_CMD_CONFIG) {
                 off += sizeof(struct ral_config_req);
                 struct ral_config_req* confreq = (struct ral_config_req*)req;
                 struct sx130xconf sx1301conf;
+                struct ral_config_resp resp = { .rctx = sys_slaveIdx, .cmd = RAL_CMD_CONFIG, .status = 1 };
+                ustime_t tinit = 0;
                 int status = 0;
                 // Note: sx1301conf_start can take considerable amount of time (if LBT on up to 8s!!)
-                if( (status = !sx130xconf_parse_setup(&sx1301conf, sys_slaveIdx, confreq->hwspec, confreq->json, confreq->jsonlen)) ||
-                    (status = !sx130xconf_challoc(&sx1301conf, &confreq->upchs)   << 1) ||
-                    (status = !sys_runRadioInit(sx1301conf.device)                << 2) ||
-                    (status = !sx130xconf_start(&sx1301conf, confreq->region)     << 3) )
+                // All slaves run this concurrently - master waits for all resp's before declaring the radios ready.
+                if( (status = !sx130xconf_load(&sx1301conf, &confreq->sx130xconf)) ||
+                    (tinit = rt_getTime(), status = !sys_runRadioInit(sx1301conf.device) << 2) ||
+                    (resp.phases[MP_RADIO_INIT] = rt_getTime() - tinit,
+                     status = !sx130xconf_start(&sx1301conf, confreq->region, resp.phases) << 3) )
                     rt_fatal("Slave radio start up failed with status 0x%02x", status);
                 if( sx1301conf.pps && sys_slaveIdx ) {
                     LOG(MOD_RAL|ERROR, "Only slave#0 may have PPS enabled");
@@ -272,6 +274,7 @@ static void pipe_read (aio_t* aio) {
                 txpowAdjust = sx1301conf.txpowAdjust;
                 last_xtime = ts_newXtimeSession(sys_slaveIdx);
                 rt_yieldTo(&rxpoll_tmr, rx_polling);
+                pipe_write_data(&resp, sizeof(resp));
                 sendTimesync();
                 continue;
             }
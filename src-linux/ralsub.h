@@ -32,6 +32,7 @@
 #if defined(CFG_lgw1) && defined(CFG_ral_master_slave)
 
 #include "timesync.h"
+#include "sx130xconf.h"
 
 
 enum {
@@ -71,15 +72,14 @@ struct ral_txabort_req {
     u1_t cmd;
 };
 
+// Radio config as compiled by the master - slaves do not parse JSON
 struct ral_config_req {
     sL_t rctx;
     u1_t cmd;
-    u2_t jsonlen;
     u4_t region;   // 0=no LBT, !=0 LBT for this region
-    chdefl_t upchs;
-    char hwspec[MAX_HWSPEC_SIZE];
-    char json[PIPE_BUF-16-MAX_HWSPEC_SIZE-sizeof(chdefl_t)];  // 16 >= 8+1+2+4
+    struct sx130xconf_bin sx130xconf;
 };
+_Static_assert(sizeof(struct ral_config_req) <= PIPE_BUF, "ral_config_req must be written atomically to the slave pipe");
 
 struct ral_tx_req {
     sL_t  rctx;
@@ -90,6 +90,7 @@ struct ral_tx_req {
     u1_t  addcrc;
     u4_t  freq;
     sL_t  xtime;
+    sL_t  reqtime;   // master's rt_getTime() when sent - same clock in all processes
     u1_t  txdata[MAX_TXFRAME_LEN];
 };
 
@@ -97,18 +98,34 @@ struct ral_tx_req {
 // tx:       RAL_TX_{OK,FAIL,NOCA}
 // cca:      0=busy, 1=clear
 // txstatus: TX status code
-// config:   0=fail, 1=ok
 struct ral_response {
     sL_t rctx;
     u1_t cmd;
     u1_t status;
 };
 
+// Sent by a slave for every TX request - synchronously awaited by the master only with LBT
+struct ral_tx_resp {
+    sL_t rctx;
+    u1_t cmd;
+    u1_t status;   // RAL_TX_{OK,FAIL,NOCA}
+    u4_t txlat;    // master request until frame handed to the radio [us]
+};
+
+// Sent by a slave once its concentrator is up (a failing slave exits instead)
+struct ral_config_resp {
+    sL_t rctx;
+    u1_t cmd;
+    u1_t status;           // 1=ok
+    u4_t phases[MP_MAX];   // bring-up timings [us]
+};
+
 struct ral_timesync_resp {
     sL_t rctx;
     u1_t cmd;
     int  quality;
     timesync_t timesync;
+    u4_t rxCrcBad;   // frames with bad CRC since slave start
 };
 
 struct ral_rx_resp {
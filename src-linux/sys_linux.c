@@ -37,6 +37,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "argp2.h"
 #include "s2conf.h"
@@ -97,7 +99,6 @@ static str_t  radioDevice;
 static str_t  versionTxt;
 static char*  updfile;
 static char*  temp_updfile;
-static int    updfd = -1;
 
 static str_t  protoEuiSrc;
 static str_t  prefixEuiSrc;
@@ -450,6 +451,49 @@ void sys_usleep (sL_t us) {
 }
 
 
+u1_t* sys_allocRing (int* size) {
+    long pgsz = sysconf(_SC_PAGESIZE);
+    int sz = (*size + pgsz - 1) / pgsz * pgsz;
+    // Reserve address space for two copies, then alias the second half to the first
+    u1_t* p = mmap(NULL, 2*sz, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if( p == MAP_FAILED )
+        rt_fatal("mmap(2) failed for ring buffer of %d bytes: %s", sz, strerror(errno));  // LCOV_EXCL_LINE
+    if( mmap(p, sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED ||
+        mremap(p, 0, sz, MREMAP_MAYMOVE|MREMAP_FIXED, p+sz) == MAP_FAILED )
+        rt_fatal("Mapping ring buffer of %d bytes failed: %s", sz, strerror(errno));      // LCOV_EXCL_LINE
+    *size = sz;
+    return p;
+}
+
+void sys_freeRing (u1_t* ring, int size) {
+    if( ring )
+        munmap(ring, 2*size);
+}
+
+
+u1_t* sys_mapFile (str_t filename, int size) {
+    int fd = open(filename, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+    if( fd == -1 ) {
+        LOG(MOD_SYS|ERROR, "Failed to open '%s': %s", filename, strerror(errno));
+        return NULL;
+    }
+    u1_t* p = MAP_FAILED;
+    if( ftruncate(fd, size) == 0 )
+        p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if( p == MAP_FAILED )
+        LOG(MOD_SYS|ERROR, "Failed to map '%s' (%d bytes): %s", filename, size, strerror(errno));
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void sys_unmapFile (u1_t* map, int size) {
+    if( map ) {
+        msync(map, size, MS_ASYNC);
+        munmap(map, size);
+    }
+}
+
+
 sL_t sys_time () {
     struct timespec tp;
     int err = clock_gettime(CLOCK_MONOTONIC, &tp);
@@ -473,49 +517,225 @@ str_t sys_version () {
 }
 
 /* FW Update ************************************ */
+//
+// Update data is handed to a writer thread through a ring buffer so that slow flash
+// does not stall the event loop. The writer drains whatever is queued in large writes -
+// independent of the size of the HTTP chunks (CUPS_BUFSZ) the data arrives in.
+//
+enum { UPD_QSIZE = 256*1024, UPD_MAXWRITE = 64*1024 };
+
+static struct {
+    pthread_t       thr;
+    pthread_mutex_t mx;
+    pthread_cond_t  cv;       // data queued / space freed
+    u1_t*    q;
+    u4_t     qhead;           // free running counters - index is modulo UPD_QSIZE
+    u4_t     qtail;
+    int      fd;
+    int      err;             // errno of failed write/sync
+    u1_t     running;
+    u1_t     finish;          // writer: drain queue, sync, and exit
+    updstats_t stats;
+} upd = { .mx = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER, .fd = -1 };
+
+
+static void* updWriter (void* arg) {
+    pthread_mutex_lock(&upd.mx);
+    while(1) {
+        while( upd.qhead == upd.qtail && !upd.finish )
+            pthread_cond_wait(&upd.cv, &upd.mx);
+        if( upd.qhead == upd.qtail )
+            break;
+        u4_t off = upd.qhead % UPD_QSIZE;
+        u4_t n = min(min(upd.qtail - upd.qhead, UPD_MAXWRITE), UPD_QSIZE - off);
+        pthread_mutex_unlock(&upd.mx);
+        // Producer only touches the range beyond qtail - safe to write without lock
+        sL_t t0 = sys_time();
+        int err = upd.err;
+        for( u4_t k=0; k < n && !err; ) {
+            int r = write(upd.fd, upd.q+off+k, n-k);
+            if( r == -1 && errno != EINTR )
+                err = errno;
+            else if( r > 0 )
+                k += r;
+        }
+        pthread_mutex_lock(&upd.mx);
+        upd.err = err;
+        upd.qhead += n;
+        if( !err )
+            upd.stats.written += n;
+        upd.stats.writeTime += sys_time() - t0;
+        pthread_cond_broadcast(&upd.cv);
+    }
+    pthread_mutex_unlock(&upd.mx);
+    // Only persist the update file - not the whole system
+    sL_t t0 = sys_time();
+    if( !upd.err && fdatasync(upd.fd) == -1 )
+        upd.err = errno;
+    upd.stats.writeTime += sys_time() - t0;
+    return NULL;
+}
 
-void sys_updateStart (int len) {
-    close(updfd);
-    if( len == 0 ) {
-        updfd = -1;
+
+static void updStopWriter () {
+    if( !upd.running )
         return;
+    pthread_mutex_lock(&upd.mx);
+    upd.finish = 1;
+    pthread_cond_broadcast(&upd.cv);
+    pthread_mutex_unlock(&upd.mx);
+    pthread_join(upd.thr, NULL);
+    upd.running = 0;
+}
+
+
+static int updStartWriter (int len) {
+    if( upd.q == NULL )
+        upd.q = rt_mallocN(u1_t, UPD_QSIZE);
+    upd.qhead = upd.qtail = 0;
+    upd.err = 0;
+    upd.finish = 0;
+    memset(&upd.stats, 0, sizeof(upd.stats));
+    upd.stats.total = len;
+    upd.stats.started = rt_getTime();
+    if( pthread_create(&upd.thr, NULL, updWriter, NULL) != 0 ) {
+        LOG(MOD_SYS|ERROR, "Failed to start update writer: %s", strerror(errno));
+        close(upd.fd);
+        upd.fd = -1;
+        return 0;
     }
+    upd.running = 1;
+    return 1;
+}
+
+void sys_updateStart (int len) {
+    updStopWriter();
+    if( upd.fd != -1 )
+        close(upd.fd);
+    upd.fd = -1;
+    if( len == 0 )
+        return;
     makeFilepath("/tmp/update", ".bi_", &temp_updfile, 0);
-    updfd = open(temp_updfile, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR|S_IXUSR|S_IRGRP|S_IXGRP);
-    if( updfd == -1 )
+    upd.fd = open(temp_updfile, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR|S_IXUSR|S_IRGRP|S_IXGRP);
+    if( upd.fd == -1 ) {
         LOG(MOD_SYS|ERROR, "Failed to open '%s': %s", temp_updfile, strerror(errno));
+        return;
+    }
+    updStartWriter(len);
 }
 
-void sys_updateWrite (u1_t* data, int off, int len) {
-    if( updfd == -1 ) return;
-    int err = write(updfd, data, len);
-    if( err == -1 ) {
-        LOG(MOD_SYS|ERROR, "Failed to write '%s': %s", temp_updfile, strerror(errno));
-        close(updfd);
-        updfd = -1;
+int sys_updateSuspend () {
+    // Keep the partial update file - return number of bytes safely on storage
+    updStopWriter();
+    if( upd.fd == -1 )
+        return -1;
+    close(upd.fd);
+    upd.fd = -1;
+    upd.stats.duration = rt_getTime() - upd.stats.started;
+    upd.stats.status = -1;
+    if( upd.err ) {
+        LOG(MOD_SYS|ERROR, "Failed to write '%s': %s", temp_updfile, strerror(upd.err));
+        return -1;
     }
+    return upd.stats.written;
+}
+
+int sys_updateResumable (int off) {
+    makeFilepath("/tmp/update", ".bi_", &temp_updfile, 0);
+    struct stat st;
+    return stat(temp_updfile, &st) == 0 && st.st_size >= off;
+}
+
+int sys_updateResume (int off, int len) {
+    updStopWriter();
+    if( upd.fd != -1 )
+        close(upd.fd);
+    makeFilepath("/tmp/update", ".bi_", &temp_updfile, 0);
+    upd.fd = open(temp_updfile, O_WRONLY);
+    struct stat st = { 0 };
+    if( upd.fd == -1 || fstat(upd.fd, &st) == -1 || st.st_size < off ||
+        ftruncate(upd.fd, off) == -1 || lseek(upd.fd, off, SEEK_SET) != off ) {
+        LOG(MOD_SYS|ERROR, "Cannot resume update file '%s' at offset %d: %s", temp_updfile, off,
+            upd.fd == -1 || st.st_size >= off ? strerror(errno) : "file too short");
+        if( upd.fd != -1 )
+            close(upd.fd);
+        upd.fd = -1;
+        return 0;
+    }
+    if( !updStartWriter(len) )
+        return 0;
+    upd.stats.resumedAt = upd.stats.received = upd.stats.written = off;
+    return 1;
+}
+
+void sys_updateWrite (u1_t* data, int off, int len) {
+    if( upd.fd == -1 ) return;
+    upd.stats.received += len;
+    pthread_mutex_lock(&upd.mx);
+    while( len > 0 ) {
+        // Queue full: flash is slower than the network - wait for the writer
+        while( upd.qtail - upd.qhead == UPD_QSIZE )
+            pthread_cond_wait(&upd.cv, &upd.mx);
+        u4_t qoff = upd.qtail % UPD_QSIZE;
+        u4_t n = min(min((u4_t)len, UPD_QSIZE - (upd.qtail - upd.qhead)), UPD_QSIZE - qoff);
+        pthread_mutex_unlock(&upd.mx);
+        memcpy(upd.q + qoff, data, n);
+        pthread_mutex_lock(&upd.mx);
+        upd.qtail += n;
+        data += n;
+        len -= n;
+        pthread_cond_signal(&upd.cv);
+    }
+    pthread_mutex_unlock(&upd.mx);
 }
 
 int sys_updateCommit (int len) {
     // Rename file and start a process
     if( len == 0 )
         return 1;
-    if( updfd == -1 ) {
+    updStopWriter();   // waits for queued data and fdatasync
+    upd.stats.duration = rt_getTime() - upd.stats.started;
+    if( upd.fd == -1 || upd.err ) {
+        if( upd.err )
+            LOG(MOD_SYS|ERROR, "Failed to write '%s': %s", temp_updfile, strerror(upd.err));
+        if( upd.fd != -1 )
+            close(upd.fd);
+        upd.fd = -1;
         if( temp_updfile )
             unlink(temp_updfile);
+        upd.stats.status = -1;
         return 0;
     }
-    close(updfd);
-    sync();
-    updfd = -1;
+    close(upd.fd);
+    upd.fd = -1;
     makeFilepath("/tmp/update", ".bin", &updfile, 0);
     if( rename(temp_updfile, updfile) == -1 ) {
         LOG(MOD_SYS|ERROR, "Rename of update file failed '%s': %s", temp_updfile, strerror(errno));
     }
-    sync();
+    // Persist the rename
+    char dir[MAX_FILEPATH_LEN];
+    snprintf(dir, sizeof(dir), "%s", updfile);
+    char* slash = strrchr(dir, '/');
+    if( slash ) {
+        *(slash == dir ? slash+1 : slash) = 0;
+        int dfd = open(dir, O_RDONLY|O_DIRECTORY);
+        if( dfd != -1 ) {
+            fsync(dfd);
+            close(dfd);
+        }
+    }
+    upd.stats.status = 1;
+    LOG(MOD_SYS|INFO, "Update written: %u bytes in %~T (flash busy %~T)",
+        upd.stats.written, upd.stats.duration, upd.stats.writeTime);
     return 1;
 }
 
+void sys_updateStats (updstats_t* stats) {
+    pthread_mutex_lock(&upd.mx);
+    *stats = upd.stats;
+    pthread_mutex_unlock(&upd.mx);
+}
+
 
 void sys_runUpdate () {
     makeFilepath("/tmp/update", ".bin", &updfile, 0);
@@ -526,8 +746,14 @@ void sys_runUpdate () {
 }
 
 void sys_abortUpdate () {
+    updStopWriter();
+    if( upd.fd != -1 ) {
+        close(upd.fd);
+        upd.fd = -1;
+        if( temp_updfile )
+            unlink(temp_updfile);
+    }
     unlink("/tmp/update.bin");
-    sync();
 }
 
 int sys_runRadioInit (str_t device) {
@@ -651,18 +877,20 @@ static int setLogFile (str_t logdef, str_t source) {
     free((void*)logfile.path);
     str_t spec = strchr(logdef,',');
     if( spec != NULL ) {
-        str_t path = rt_strdupn(logfile.path, spec-logfile.path);
-        logfile.path = sys_makeFilepath(path,1);
+        str_t path = rt_strdupn(logdef, spec-logdef);
+        logfile.path = sys_makeFilepath(path,0);
         rt_free((void*)path);
+        spec += 1;
         sL_t logsz = rt_readDec((str_t*)&spec);
         if( logsz > 0 )
             logfile.size = min(max(logsz, 10000), (sL_t)100e6);
         if( spec[0] == ',' ) {
+            spec += 1;
             int logrot = rt_readDec((str_t*)&spec);
-            if( logrot > 0 )
-                logfile.rotate = min(max(logrot, 0), (sL_t)100);
+            if( logrot >= 0 )   // 0 = no rotated copies
+                logfile.rotate = min(logrot, (sL_t)100);
         }
-        if( !spec[0] ) {
+        if( spec[0] ) {
             fprintf(stderr, "%s: Illegal log file spec: %s\n", source, logdef);
             return 0;
         }
@@ -1019,6 +1247,7 @@ static void startupMaster2 (tmr_t* tmr) {
 #if !defined(CFG_no_rmtsh)
     rt_addFeature("rmtsh");
 #endif
+    rt_addFeature("rmtlog");
 #if defined(CFG_prod)
     rt_addFeature("prod");  // certain development/test/debug features not accepted
 #endif
@@ -29,21 +29,29 @@
 #define _GNU_SOURCE
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
 #include <sys/stat.h>
+#if defined(CFG_logzip)
+#include <zlib.h>
+#endif
+#include "s2conf.h"
 #include "rt.h"
 #include "sys.h"
 #include "sys_linux.h"
+#include "rmtlog.h"
 
 
 #define LOG_LAG         100  // millis
 #define LOG_OUTSIZ     8192
 #define LOG_HIGHWATER (LOG_OUTSIZ/2)
 #define MAX_LOGHDR      64
+#define LOG_RECHECK     10   // secs - verify log file has not been moved
+#define LOG_ZIPSTEP  65536   // compress at most this many bytes between log writes
 
 static struct logfile* logfile;
 
@@ -115,57 +123,220 @@ static void stdout_read(aio_t* aio) {
 }
 
 
-static void writeLogData (const char *data, int len) {
-    if( !logfile || !logfile->path ) {
-      log2stderr:
-        if( write(orig_stderr, data, len) == -1 )
-            sys_fatal(FATAL_NOLOGGING);
-        return;
+// Log file is kept open - size is tracked in memory and the path is
+// only checked now and then in case someone else moved/removed the file.
+static int      logfd = -1;
+static sL_t     logsize;
+static dev_t    logdev;
+static ino_t    logino;
+static ustime_t logcheck;
+
+static void closeLogFile () {
+    if( logfd >= 0 ) {
+        close(logfd);
+        logfd = -1;
+    }
+}
+
+static int openLogFile () {
+    int fd = open(logfile->path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP);
+    if( fd == -1 ) {
+        fprintf(stderr,"Failed to open log file %s: %s\n", logfile->path, strerror(errno));
+        return 0;
     }
     struct stat st = { .st_size = 0 };
-    if( stat(logfile->path, &st) == -1 && errno != ENOENT ) {
+    if( fstat(fd, &st) == -1 )
         fprintf(stderr,"Failed to stat log file %s: %s\n", logfile->path, strerror(errno));
-        goto log2stderr;
+    logfd = fd;
+    logsize = st.st_size;
+    logdev = st.st_dev;
+    logino = st.st_ino;
+    logcheck = rt_seconds_ahead(LOG_RECHECK);
+    return 1;
+}
+
+
+#if defined(CFG_logzip)
+// Compress a rotated log file into FILE.gz - done in steps on the log thread
+// so that ongoing logging is not held up by a large file.
+static str_t  zipPath;
+static int    zipfd = -1;
+static gzFile zipOut;
+
+static void zipStart (str_t path) {
+    zipPath = strdup(path);
+}
+
+// Returns 1 if more work is pending
+static int zipStep (int maxbytes) {
+    if( zipPath == NULL )
+        return 0;
+    int plen = strlen(zipPath);
+    char tmp[plen + 8];
+    snprintf(tmp, sizeof(tmp), "%s.gz~", zipPath);
+    if( zipfd < 0 ) {
+        if( (zipfd = open(zipPath, O_RDONLY|O_CLOEXEC)) == -1 ) {
+            fprintf(stderr,"Failed to open log file %s: %s\n", zipPath, strerror(errno));
+            goto done;
+        }
+        if( (zipOut = gzopen(tmp, "wb")) == NULL ) {
+            fprintf(stderr,"Failed to create %s: %s\n", tmp, strerror(errno));
+            goto done;
+        }
     }
-    if( st.st_size >= logfile->size ) {
-        int flen = strlen(logfile->path);
-        char fn[flen + 15];
-        struct timespec min_ctim;
-        int logfno = -1;
-        strcpy(fn, logfile->path);
-        for( int i=0; i<logfile->rotate; i++ ) {
-            snprintf(fn+flen, 15, ".%d", i);
-            if( stat(fn, &st) == -1 ) {
-                if( errno != ENOENT )
-                    fprintf(stderr,"Failed to stat log file %s: %s\n", fn, strerror(errno));
-                logfno = i;
-                break;
-            }
-            if( logfno < 0 || min_ctim.tv_sec > st.st_ctim.tv_sec ) {
-                min_ctim.tv_sec = st.st_ctim.tv_sec;
-                logfno = i;
-            }
+    char buf[4096];
+    int n;
+    while( maxbytes > 0 && (n = read(zipfd, buf, sizeof(buf))) > 0 ) {
+        if( gzwrite(zipOut, buf, n) != n ) {
+            fprintf(stderr,"Failed to write %s\n", tmp);
+            goto done;
+        }
+        maxbytes -= n;
+    }
+    if( maxbytes > 0 ) {
+        // EOF - replace original by compressed file
+        int err = gzclose(zipOut);
+        zipOut = NULL;
+        if( err != Z_OK ) {
+            fprintf(stderr,"Failed to close %s: %d\n", tmp, err);
+        } else {
+            char gz[plen + 4];
+            snprintf(gz, sizeof(gz), "%s.gz", zipPath);
+            if( rename(tmp, gz) == -1 )
+                fprintf(stderr,"Failed to rename log file %s => %s: %s\n", tmp, gz, strerror(errno));
+            else if( unlink(zipPath) == -1 )
+                fprintf(stderr,"Failed to unlink log file %s: %s\n", zipPath, strerror(errno));
+        }
+        goto done;
+    }
+    return 1;
+
+ done:
+    if( zipOut ) {
+        gzclose(zipOut);
+        zipOut = NULL;
+        unlink(tmp);
+    }
+    if( zipfd >= 0 ) {
+        close(zipfd);
+        zipfd = -1;
+    }
+    free((void*)zipPath);
+    zipPath = NULL;
+    return 0;
+}
+#else // !defined(CFG_logzip)
+static void zipStart (str_t path) {}
+static int  zipStep (int maxbytes) { return 0; }
+#endif // !defined(CFG_logzip)
+
+
+// Stat rotated log file FN or FN.gz
+static int statRotated (char* fn, int fnlen, struct stat* st) {
+    if( stat(fn, st) == 0 )
+        return 1;
+    if( errno != ENOENT )
+        fprintf(stderr,"Failed to stat log file %s: %s\n", fn, strerror(errno));
+    int n = strlen(fn);
+    snprintf(fn+n, fnlen-n, ".gz");
+    int ok = stat(fn, st) == 0;
+    fn[n] = 0;
+    return ok;
+}
+
+static void rotateLogFile () {
+    // Finish pending compression - it might refer to the slot we reuse
+    while( zipStep(INT_MAX) );
+    if( logfile->rotate <= 0 ) {
+        // No rotated copies wanted - truncate in place (O_APPEND writes continue at the new end)
+        if( ftruncate(logfd, 0) == 0 ) {
+            logsize = 0;
+            return;
         }
+        fprintf(stderr,"Failed to truncate log file %s: %s\n", logfile->path, strerror(errno));
+        closeLogFile();
+        if( unlink(logfile->path) == -1 && errno != ENOENT )
+            fprintf(stderr,"Failed to unlink log file %s: %s\n", logfile->path, strerror(errno));
+        return;
+    }
+    closeLogFile();
+    int flen = strlen(logfile->path);
+    char fn[flen + 15];
+    struct timespec min_ctim;
+    struct stat st;
+    int logfno = -1;
+    strcpy(fn, logfile->path);
+    for( int i=0; i<logfile->rotate; i++ ) {
+        snprintf(fn+flen, 15, ".%d", i);
+        if( !statRotated(fn, sizeof(fn), &st) ) {
+            logfno = i;
+            break;
+        }
+        // Several rotations may happen within the same second - compare nanos too
+        if( logfno < 0 || min_ctim.tv_sec > st.st_ctim.tv_sec ||
+            (min_ctim.tv_sec == st.st_ctim.tv_sec && min_ctim.tv_nsec > st.st_ctim.tv_nsec) ) {
+            min_ctim = st.st_ctim;
+            logfno = i;
+        }
+    }
+    snprintf(fn+flen, 15, ".%d", logfno);
+    if( unlink(fn) == -1 && errno != ENOENT )
+        fprintf(stderr,"Failed to unlink log file %s: %s\n", fn, strerror(errno));
+    if( rename(logfile->path, fn) == -1 ) {
+        fprintf(stderr,"Failed to rename log file %s => %s: %s\n", logfile->path, fn, strerror(errno));
+        if( unlink(logfile->path) == -1 )
+            fprintf(stderr,"Failed to unlink log file %s: %s\n", logfile->path, strerror(errno));
+    } else {
+        int n = strlen(fn);
+        snprintf(fn+n, sizeof(fn)-n, ".gz");
         if( unlink(fn) == -1 && errno != ENOENT )
             fprintf(stderr,"Failed to unlink log file %s: %s\n", fn, strerror(errno));
-        if( rename(logfile->path, fn) == -1 ) {
-            fprintf(stderr,"Failed to rename log file %s => %s: %s\n", logfile->path, fn, strerror(errno));
-            if( unlink(logfile->path) == -1 )
-                fprintf(stderr,"Failed to unlink log file %s: %s\n", logfile->path, strerror(errno));
-        }
+        fn[n] = 0;
+        if( LOGFILE_COMPRESS )
+            zipStart(fn);
     }
-    int fd = open(logfile->path, O_CREAT|O_APPEND|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP);
-    if( fd == -1 ) {
-        fprintf(stderr,"Failed to open log file %s: %s\n", logfile->path, strerror(errno));
+}
+
+static void writeLogData (const char *data, int len) {
+    if( len <= 0 )
+        return;  // flush with nothing pending - must not trigger a rotation
+    if( !logfile || !logfile->path ) {
+      log2stderr:
+        if( write(orig_stderr, data, len) == -1 )
+            sys_fatal(FATAL_NOLOGGING);
+        return;
+    }
+    if( logfd >= 0 && rt_getTime() >= logcheck ) {
+        // Reopen if log file has been moved/removed behind our back
+        struct stat st;
+        if( stat(logfile->path, &st) == -1 || st.st_dev != logdev || st.st_ino != logino )
+            closeLogFile();
+        logcheck = rt_seconds_ahead(LOG_RECHECK);
+    }
+    if( logfd < 0 && !openLogFile() )
         goto log2stderr;
+    if( logsize >= logfile->size ) {
+        rotateLogFile();
+        if( logfd < 0 && !openLogFile() )
+            goto log2stderr;
     }
     int n;
-    if( (n = write(fd, data, len)) != len ) {
+    if( (n = write(logfd, data, len)) != len ) {
         fprintf(stderr,"Partial write to log file %s: %s\n", logfile->path, strerror(errno));
-        close(fd);
+        closeLogFile();
         goto log2stderr;
     }
-    close(fd);
+    logsize += len;
+}
+
+
+void sys_wakeLog (int urgent) {
+    if( urgent ) {
+        pthread_cond_signal(&condvar);
+    } else if( delay.next == TMR_NIL ) {
+        // Delay timer not running
+        rt_setTimer(&delay, rt_millis_ahead(LOG_LAG));
+    }
 }
 
 
@@ -180,27 +351,34 @@ static void addLog (const char *logline, int len) {
     outfill += k;
     int notify = (len == 0 || outfill >= LOG_HIGHWATER);
     pthread_mutex_unlock(&mxfill);
-    if( notify ) {
-        pthread_cond_signal(&condvar);
-    } else if( delay.next == TMR_NIL ) {
-        // Delay timer not running
-        rt_setTimer(&delay, rt_millis_ahead(LOG_LAG));
-    }
+    sys_wakeLog(notify);
 }
 
 
 static void on_delay (tmr_t* tmr) {
     pthread_mutex_lock(&mxfill);
-    if( outfill )
+    if( outfill || log_pendingDeferred() )
         pthread_cond_signal(&condvar);
     pthread_mutex_unlock(&mxfill);
 }
 
 
+// Format queued log records - caller holds mxcond (single consumer)
+static void renderDeferred () {
+    static char rbuf[LOG_OUTSIZ];
+    int n;
+    while( (n = log_renderDeferred(rbuf, sizeof(rbuf))) > 0 )
+        writeLogData(rbuf, n);
+}
+
+
 static void thread_log (void) {
     pthread_mutex_lock(&mxcond);
+    int zipping = 0;
     while(1) {
-        pthread_cond_wait(&condvar, &mxcond);
+        if( !zipping )
+            pthread_cond_wait(&condvar, &mxcond);
+        renderDeferred();
         pthread_mutex_lock(&mxfill);
         int len = outfill;
         pthread_mutex_unlock(&mxfill);
@@ -215,6 +393,11 @@ static void thread_log (void) {
             }
             pthread_mutex_unlock(&mxfill);
         }
+        if( (zipping = zipStep(LOG_ZIPSTEP)) ) {
+            // Let others get at the log file between compression steps
+            pthread_mutex_unlock(&mxcond);
+            pthread_mutex_lock(&mxcond);
+        }
     }
 }
 
@@ -223,10 +406,13 @@ void sys_flushLog (void) {
     fflush(stdout);
     fflush(stderr);
     pthread_mutex_lock(&mxcond);
+    renderDeferred();
     pthread_mutex_lock(&mxfill);
     writeLogData(outbuf, outfill);
     outfill = 0;
     pthread_mutex_unlock(&mxfill);
+    // Called before fork/exit - don't leave a half compressed file behind
+    while( zipStep(INT_MAX) );
     pthread_mutex_unlock(&mxcond);
 }
 
@@ -241,6 +427,7 @@ void sys_addLog (const char *logline, int len) {
 
 
 void sys_iniLogging (struct logfile* lf, int captureStdio) {
+    closeLogFile();
     logfile = lf;
     if( logfile->path && captureStdio ) {
         // Replace stdout/stderr with a pipe and drain its data
@@ -280,5 +467,7 @@ void sys_startLogThread () {
             sys_fatal(FATAL_PTHREAD);
         rt_iniTimer(&delay, on_delay);
         thrUp = 1;
+        log_iniDeferred(LOG_DEFERRED);
+        rmtlog_ini();
     }
 }
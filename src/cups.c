@@ -26,12 +26,14 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/stat.h>
 #include "s2conf.h"
 #include "sys.h"
 #include "uj.h"
 #include "kwcrc.h"
 #include "cups.h"
 #include "tc.h"
+#include "fs.h"
 
 #include "mbedtls/ecdsa.h"
 #include "mbedtls/error.h"
@@ -59,6 +61,87 @@ struct cups_sig {
     };
 };
 
+// State of an interrupted update download. The partial data itself stays in
+// the platform's update file. The SHA-512 context is stored as is - it is only
+// ever read back by the same station binary.
+typedef struct cups_resume {
+    u4_t magic;
+    u4_t size;       // length of update segment
+    u4_t off;        // bytes persisted so far
+    u4_t keycrc;     // CRC of signing key (0 if unsigned)
+    u4_t sigcrc;     // CRC of signature bytes
+    mbedtls_sha512_context sha;  // hash over the first off bytes
+} cups_resume_t;
+
+#define RESUME_MAGIC 0x52505543  // "CUPR"
+#define RESUME_FILE  "~temp/cups-update.resume"
+
+static cups_resume_t* resume;
+static u1_t resumeLoaded;
+
+static cups_resume_t* getResume () {
+    if( !CUPS_RESUME )
+        return NULL;
+    if( !resumeLoaded ) {
+        resumeLoaded = 1;
+        dbuf_t b = sys_checkFile(RESUME_FILE);
+        if( b.buf != NULL ) {
+            cups_resume_t* r = (cups_resume_t*)b.buf;
+            if( b.bufsize == sizeof(cups_resume_t) && r->magic == RESUME_MAGIC && r->off < r->size ) {
+                resume = rt_malloc(cups_resume_t);
+                *resume = *r;
+            }
+            rt_free(b.buf);
+        }
+    }
+    return resume;
+}
+
+static void dropResume () {
+    if( resume == NULL && resumeLoaded )
+        return;
+    rt_free(resume);
+    resume = NULL;
+    resumeLoaded = 1;
+    str_t fn = sys_makeFilepath(RESUME_FILE, 0);
+    fs_unlink(fn);
+    rt_free((void*)fn);
+}
+
+// Update transfer broke off - remember how far we got
+static void suspendUpdate (cups_t* cups) {
+    int n = sys_updateSuspend();
+    if( !CUPS_RESUME || n <= 0 || n != cups->segm_off ) {
+        dropResume();
+        return;
+    }
+    if( resume == NULL )
+        resume = rt_malloc(cups_resume_t);
+    resumeLoaded = 1;
+    resume->magic = RESUME_MAGIC;
+    resume->size = cups->segm_len;
+    resume->off = n;
+    resume->keycrc = resume->sigcrc = 0;
+    if( (cups->uflags & UPDATE_FLAG(SIGNATURE)) && cups->sig ) {
+        resume->keycrc = cups->sig->keycrc;
+        resume->sigcrc = rt_crc32(0, cups->sig->signature, cups->sig->len);
+        resume->sha = cups->sig->sha;
+    }
+    dbuf_t b = { .buf=(char*)resume, .bufsize=sizeof(*resume), .pos=sizeof(*resume) };
+    sys_writeFile(RESUME_FILE, &b);
+    LOG(MOD_CUP|INFO, "Update download interrupted after %d of %d bytes - will ask CUPS to resume", n, cups->segm_len);
+}
+
+static int resumeMatches (cups_t* cups, int segm_len) {
+    cups_resume_t* r = getResume();
+    if( r == NULL || r->off != cups->resume_off || r->size != segm_len )
+        return 0;
+    if( (cups->uflags & UPDATE_FLAG(SIGNATURE)) && cups->sig )
+        return r->keycrc == cups->sig->keycrc && r->sigcrc == rt_crc32(0, cups->sig->signature, cups->sig->len);
+    return r->keycrc == 0;
+}
+
+
 static int cups_verifySig (cups_sig_t* sig) {
     int verified = 0;
     dbuf_t key;
@@ -183,6 +266,8 @@ static void cups_ondone (tmr_t* tmr) {
 
 
 static void cups_done (cups_t* cups, s1_t cstate) {
+    if( cups->cstate == CUPS_FEED_UPDATE && cstate != CUPS_DONE )
+        suspendUpdate(cups);
     cups->cstate = cstate;
     http_free(&cups->hc);
     rt_yieldTo(&cups->timeout, cups_ondone);
@@ -235,6 +320,43 @@ static void cups_update_info (conn_t* _conn, int ev) {
                   "package",    's', version,
                   // "os",         's', sys_osversion(), 
                   NULL);
+        cups_resume_t* r = getResume();
+        if( r && !sys_updateResumable(r->off) ) {
+            // Resume record survived but partial data is gone - get the whole update again
+            LOG(MOD_CUP|WARNING, "Partial update data lost - restarting download from offset 0");
+            dropResume();
+            r = NULL;
+        }
+        if( r ) {
+            // Ask CUPS to continue the interrupted transfer of the same update
+            uj_encKey (&b, "updResume");
+            uj_encOpen(&b, '{');
+            uj_encKVn(&b,
+                      "size",   'u', r->size,
+                      "offset", 'u', r->off,
+                      "keyCrc", 'u', r->keycrc,
+                      "sigCrc", 'u', r->sigcrc,
+                      NULL);
+            uj_encClose(&b, '}');
+        }
+        updstats_t us;
+        sys_updateStats(&us);
+        if( us.total > 0 ) {
+            // Report how the last update transfer went
+            uj_encKey (&b, "updateStats");
+            uj_encOpen(&b, '{');
+            uj_encKVn(&b,
+                      "size",      'u', us.total,
+                      "received",  'u', us.received,
+                      "written",   'u', us.written,
+                      "resumedAt", 'u', us.resumedAt,
+                      "duration",  'T', us.duration/1e6,
+                      "writeTime", 'T', us.writeTime/1e6,
+                      "rate",      'g', us.duration > 0 ? (double)us.received*1e6/us.duration : 0.0,
+                      "ok",        'b', us.status > 0,
+                      NULL);
+            uj_encClose(&b, '}');
+        }
         uj_encKey  (&b, "keys");
         uj_encOpen (&b, '[');
         int keyid = -1;
@@ -266,6 +388,8 @@ static void cups_update_info (conn_t* _conn, int ev) {
             }
             if( cups_credset == SYS_CRED_REG )
                 sys_backupConfig(SYS_CRED_CUPS);
+            char* roff = http_findHeader(hdr.buf, "x-update-offset");
+            cups->resume_off = roff ? http_readDec(roff) : 0;
 
             // We expect both CUPS/TC URI segments to fit into HTTP buffer
             u1_t cupsuri_len = body.buf[0];
@@ -353,8 +477,21 @@ static void cups_update_info (conn_t* _conn, int ev) {
                 } else { // cstate == CUPS_FEED_UPDATE
                     assert(cstate == CUPS_FEED_UPDATE);
                     sys_commitConfigUpdate(); 
-                    sys_updateStart(segm_len);
-                    LOG(MOD_CUP|INFO, "[Segment] FW Update (%d bytes)", segm_len);
+                    if( cups->resume_off > 0 ) {
+                        if( !resumeMatches(cups, segm_len) || !sys_updateResume(cups->resume_off, segm_len) ) {
+                            LOG(MOD_CUP|ERROR, "[Segment] FW Update (%d bytes) - cannot resume at offset %d", segm_len, cups->resume_off);
+                            dropResume();
+                            goto proto_err;
+                        }
+                        if( cups->sig )
+                            cups->sig->sha = resume->sha;
+                        cups->segm_off = cups->resume_off;
+                        LOG(MOD_CUP|INFO, "[Segment] FW Update (%d bytes) - resuming at offset %d", segm_len, cups->segm_off);
+                    } else {
+                        dropResume();
+                        sys_updateStart(segm_len);
+                        LOG(MOD_CUP|INFO, "[Segment] FW Update (%d bytes)", segm_len);
+                    }
                 }
             }
         }
@@ -363,10 +500,12 @@ static void cups_update_info (conn_t* _conn, int ev) {
             // Segment finished
             if( cstate == CUPS_FEED_CUPS_CRED ) {
                 sys_credComplete(SYS_CRED_CUPS, cups->segm_len);
+                tls_dropSession(SYS_CRED_CUPS, NULL);  // sessions are bound to the old identity
                 LOG(MOD_CUP|INFO, "[Segment] CUPS Credentials update completed (%d bytes)", cups->segm_len);
             }
             else if( cstate == CUPS_FEED_TC_CRED ) {
                 sys_credComplete(SYS_CRED_TC, cups->segm_len);
+                tls_dropSession(SYS_CRED_TC, NULL);  // sessions are bound to the old identity
                 LOG(MOD_CUP|INFO, "[Segment] TC Credentials update completed (%d bytes)", cups->segm_len);
             } else if( cstate == CUPS_FEED_SIGNATURE ) {
                 cups->uflags |= UPDATE_FLAG(SIGNATURE);
@@ -375,6 +514,7 @@ static void cups_update_info (conn_t* _conn, int ev) {
                 mbedtls_sha512_starts(&cups->sig->sha, 0);
             }
             else { // cstate == CUPS_FEED_UPDATE
+                dropResume();
                 if( sys_updateCommit(cups->segm_len) ) {
                     cups->uflags |= UPDATE_FLAG(UPDATE);
                     LOG(MOD_CUP|INFO, "[Segment] Update committed (%d bytes)", cups->segm_len);
@@ -415,6 +555,13 @@ static void cups_update_info (conn_t* _conn, int ev) {
                 mbedtls_sha512_update(&cups->sig->sha, data, dlen);
             }
             sys_updateWrite(data, segm_off, dlen);
+            if( (segm_off*10LL)/segm_len != ((segm_off+dlen)*10LL)/segm_len ) {
+                updstats_t us;
+                sys_updateStats(&us);
+                ustime_t dt = rt_getTime() - us.started;
+                LOG(MOD_CUP|INFO, "[Segment] FW Update: %d%% (%d/%d bytes) %.1fkB/s", (int)(((segm_off+dlen)*100LL)/segm_len),
+                    segm_off+dlen, segm_len, dt > 0 ? (double)us.received*1e3/dt : 0.0);
+            }
         }
         body.pos += dlen;
         cups->segm_off += dlen;
@@ -63,6 +63,7 @@ typedef struct cups {
     u1_t     temp[4];     // assemble length fields
     int      segm_off;
     int      segm_len;
+    int      resume_off;  // CUPS agreed to continue an interrupted update at this offset
     tmrcb_t  ondone;
     cups_sig_t* sig;
 } cups_t;
@@ -764,8 +764,14 @@ int fs_stat (str_t fn, struct stat* st) {
 
 int fs_lseek (int fd, int offset, int whence) {
     fh_t* fh = fd2fh(fd);
-    if( fh == NULL )
+    if( fh == NULL ) {
+#if defined(CFG_linux)
+        if( errno == EINVAL ) {
+            return lseek(fd, offset, whence);
+        }
+#endif
         return -1;
+    }
     if( fh->faddr == 0 ) {
         // no seek on writable files - fs can do only append
         errno = EINVAL;
@@ -941,6 +947,11 @@ int fs_ck () {
 
 
 void fs_info(fsinfo_t* infop) {
+    if( fsSection < 0 ) {
+        memset(infop, 0, sizeof(*infop));
+        infop->activeSection = 255;  // no fs_ini yet
+        return;
+    }
     infop->fbasep   = sys_ptrFlash();
     infop->fbase    = FLASH_BEG_A;
     infop->pagecnt  = FS_PAGE_CNT & ~1;
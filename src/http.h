@@ -47,7 +47,17 @@ typedef struct http {
     struct {
         netctx_t netctx;
         aio_t*   aio;
+        struct http* clients;  // pool of concurrent client connections
+        int      nclients;
+        ustime_t idletime;     // close clients idle for this long
     } listen;
+    struct {
+        int      fd;           // file streamed after response header (-1 if none)
+        char*    body;         // or buffer streamed after response header (NULL if none)
+        int      boff;         // offset of next body chunk
+        int      fleft;        // bytes of file/buffer still to be sent
+        u1_t     keepalive;    // wait for another request once response is sent
+    } resp;
 } http_t;
 
 enum {
@@ -57,13 +57,15 @@ enum {
 
 void   httpd_ini        (httpd_t*, int bufsize);
 void   httpd_free       (httpd_t*);
-int    httpd_listen     (httpd_t*, const char* port);
+int    httpd_listen     (httpd_t*, const char* port, int nclients, ustime_t idletime);
 void   httpd_close      (httpd_t*);
 void   httpd_stop       (httpd_t*);
 dbuf_t httpd_getRespbuf (httpd_t*);
 dbuf_t httpd_getHdr     (httpd_t*);
 dbuf_t httpd_getBody    (httpd_t*);
 void   httpd_response   (httpd_t*, dbuf_t* resp);
+void   httpd_sendFile   (httpd_t*, dbuf_t* hdr, int fd, int size);  // send hdr and stream file - takes ownership of fd
+void   httpd_sendBody   (httpd_t*, dbuf_t* hdr, dbuf_t* body);      // send hdr and stream body - takes ownership of body->buf
 
 enum {
     HTTPD_PATH_DONE,
@@ -11,8 +11,10 @@
 #define J_AS923JP              ((ujcrc_t)(0x6616F98E))
 #define J_asap                 ((ujcrc_t)(0x61D4E603))
 #define J_AU915                ((ujcrc_t)(0xD8599E68))
+#define J_backfill             ((ujcrc_t)(0x1B3664FB))
 #define J_bcning               ((ujcrc_t)(0x1EE5E245))
 #define J_beaconing            ((ujcrc_t)(0x58428CA7))
+#define J_burst                ((ujcrc_t)(0x3EDBF400))
 #define J_cca                  ((ujcrc_t)(0x00636361))
 #define J_CN470                ((ujcrc_t)(0xD75F977D))
 #define J_CN779                ((ujcrc_t)(0xD75E9777))
@@ -26,6 +28,7 @@
 #define J_diid                 ((ujcrc_t)(0x64D5D500))
 #define J_disconnect           ((ujcrc_t)(0x508A92A9))
 #define J_dnmode               ((ujcrc_t)(0xFB97E55A))
+#define J_dnbulk               ((ujcrc_t)(0x04F70849))
 #define J_dnframe              ((ujcrc_t)(0xF7095424))
 #define J_dnmsg                ((ujcrc_t)(0x37C3E917))
 #define J_dnsched              ((ujcrc_t)(0xFDEA5B35))
@@ -42,6 +45,7 @@
 #define J_euiprefix            ((ujcrc_t)(0x9D5E0C96))
 #define J_shell                ((ujcrc_t)(0x767A1E0A))
 #define J_cmd                  ((ujcrc_t)(0x0063716A))
+#define J_frames               ((ujcrc_t)(0xFDFA222F))
 #define J_freq                 ((ujcrc_t)(0x66E0EB00))
 #define J_Freq                 ((ujcrc_t)(0x46C0CB20))
 #define J_freqs                ((ujcrc_t)(0x47ADEB15))
@@ -59,11 +63,13 @@
 #define J_JoinEUI              ((ujcrc_t)(0x5B618676))
 #define J_KR920                ((ujcrc_t)(0xFB789669))
 #define J_layout               ((ujcrc_t)(0x11950A24))
+#define J_levels               ((ujcrc_t)(0x08862827))
 #define J_log_file             ((ujcrc_t)(0x7886C6B6))
 #define J_log_level            ((ujcrc_t)(0x7B397448))
 #define J_log_rotate           ((ujcrc_t)(0x240F1106))
 #define J_log_size             ((ujcrc_t)(0x6453ABB5))
 #define J_max_eirp             ((ujcrc_t)(0x60B4BA83))
+#define J_metrics              ((ujcrc_t)(0xFDF84245))
 #define J_mix_gain             ((ujcrc_t)(0xC7F3BD05))
 #define J_msgid                ((ujcrc_t)(0x66901419))
 #define J_msgtype              ((ujcrc_t)(0xBD07399C))
@@ -77,12 +83,14 @@
 #define J_ontime               ((ujcrc_t)(0xF9E41F34))
 #define J_pa_gain              ((ujcrc_t)(0xDEE8634E))
 #define J_pdu                  ((ujcrc_t)(0x00708461))
+#define J_pdus                 ((ujcrc_t)(0x70F4E512))
 #define J_preamble             ((ujcrc_t)(0x05167D25))
 #define J_priority             ((ujcrc_t)(0xF00C8E15))
 #define J_pps                  ((ujcrc_t)(0x00707073))
 #define J_radio                ((ujcrc_t)(0x6A861A03))
 #define J_radio_conf           ((ujcrc_t)(0xBA23370B))
 #define J_radio_init           ((ujcrc_t)(0xA4224015))
+#define J_rate                 ((ujcrc_t)(0x72F7EC02))
 #define J_rctx                 ((ujcrc_t)(0x72F5E81D))
 #define J_reboot               ((ujcrc_t)(0xF6CE1F1D))
 #define J_reconnect            ((ujcrc_t)(0xD965FF91))
@@ -90,6 +98,7 @@
 #define J_regionid             ((ujcrc_t)(0xE6FFB211))
 #define J_restart              ((ujcrc_t)(0xFFFF1F62))
 #define J_rmtsh                ((ujcrc_t)(0x77731403))
+#define J_rmtlog               ((ujcrc_t)(0xEA011E0B))
 #define J_router               ((ujcrc_t)(0xFEE91D0C))
 #define J_routerid             ((ujcrc_t)(0xE1C9C417))
 #define J_router_config        ((ujcrc_t)(0xE5E7E58E))
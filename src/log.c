@@ -30,6 +30,7 @@
 #include "sys.h"
 #include "rt.h"
 #include "uj.h"
+#include "rmtlog.h"
 
 const char* LVLSTR[] = {
     [XDEBUG  ]= "XDEB",
@@ -72,14 +73,130 @@ static u1_t   logLevels[32] = {
     CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl,
     CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl
 };
+// Expanded form of logLevels - one flag per mod_level
+#define LVLINI(l) ((l) >= CFG_logini_lvl)
+#define MODINI    LVLINI(0), LVLINI(1), LVLINI(2), LVLINI(3), LVLINI(4), LVLINI(5), LVLINI(6), LVLINI(7)
+#define MODALL    1, 1, 1, 1, 1, 1, 1, 1
+u1_t log_enabled[256] = {
+    MODINI, MODINI, MODINI, MODINI, MODINI, MODINI, MODINI, MODINI,
+    MODINI, MODINI, MODINI, MODINI, MODINI, MODINI, MODINI, MODINI,
+    MODALL, MODALL, MODALL, MODALL, MODALL, MODALL, MODALL, MODALL,
+    MODALL, MODALL, MODALL, MODALL, MODALL, MODALL, MODALL, MODALL
+};
+#undef MODALL
+#undef MODINI
+#undef LVLINI
+
+// Remote log streaming - lines are fed into rmtlog if enabled.
+// A module level of 8 means nothing of this module is streamed.
+static u1_t   rmtLevels[32] = { [0 ... 31] = 8 };
+static u1_t   rmtCapture;           // pass formatted lines to rmtlog
+static u1_t   logbufMl = 0xFF;      // mod_level of line in logbuf - 0xFF: unknown (local only)
+
+
+// Deferred logging - log_vmsg stores time, format pointer and raw arguments into
+// a ring and the log thread renders text via log_renderDeferred.
+// Records are 8 byte aligned and never wrap - a zero length marks a skipped tail.
+typedef struct logrec {
+    u2_t        len;        // record length incl. header, multiple of 8
+    u2_t        dlen;       // captured arguments/text following header
+    u1_t        mod_level;
+    u1_t        _pad[3];
+    ustime_t    utc;
+    const char* fmt;        // NULL: dlen bytes of preformatted log line
+} logrec_t;
+
+enum { LOGREC_MAX = 2*LOGLINE_LEN };
 
+static u1_t*  ring;
+static u4_t   ringSize;     // power of 2
+static u4_t   ringHead;     // advanced by producer (main thread)
+static u4_t   ringTail;     // advanced by consumer (log thread)
+static u4_t   ringDropped;  // records lost due to full ring
 
-static int log_header (u1_t mod_level) {
+
+static int log_header (dbuf_t* b, ustime_t utc, u1_t mod_level) {
     int mod = (mod_level & MOD_ALL) >> 3;
-    logbuf.pos = 0;
+    b->pos = 0;
     str_t mod_s = slaveMod[0] ? slaveMod : mod >= SIZE_ARRAY(MODSTR) ? "???":MODSTR[mod];
-    xprintf(&logbuf, "%.3T [%s:%s] ", rt_getUTC(), mod_s, LVLSTR[mod_level & 7]);
-    return logbuf.pos;
+    xprintf(b, "%.3T [%s:%s] ", utc, mod_s, LVLSTR[mod_level & 7]);
+    return b->pos;
+}
+
+static int ringPut (u1_t mod_level, const char* fmt, const void* data, int dlen) {
+    int len = (sizeof(logrec_t) + dlen + 7) & ~7;
+    u4_t head = ringHead;
+    u4_t tail = __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE);
+    u4_t off = head & (ringSize-1);
+    u4_t skip = off + len > ringSize ? ringSize - off : 0;
+    if( head - tail + skip + len > ringSize ) {
+        __atomic_add_fetch(&ringDropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if( skip ) {
+        ((logrec_t*)&ring[off])->len = 0;
+        off = 0;
+    }
+    logrec_t* r = (logrec_t*)&ring[off];
+    r->len = len;
+    r->dlen = dlen;
+    r->mod_level = mod_level;
+    r->utc = rt_getUTC();
+    r->fmt = fmt;
+    memcpy(r+1, data, dlen);
+    __atomic_store_n(&ringHead, head + skip + len, __ATOMIC_RELEASE);
+    sys_wakeLog(head - tail + skip + len >= ringSize/2);
+    return 1;
+}
+
+void log_iniDeferred (int size) {
+    if( size <= 0 || ring )
+        return;
+    u4_t sz = 4096;
+    while( sz*2 <= size )
+        sz *= 2;
+    ring = rt_mallocN(u1_t, sz);
+    ringSize = sz;
+}
+
+int log_pendingDeferred () {
+    return ring && (__atomic_load_n(&ringHead, __ATOMIC_ACQUIRE) != ringTail || ringDropped);
+}
+
+int log_renderDeferred (char* buf, int bufsize) {
+    int pos = 0;
+    if( !ring )
+        return 0;
+    u4_t dropped = __atomic_load_n(&ringDropped, __ATOMIC_RELAXED);
+    if( dropped && bufsize >= LOGLINE_LEN ) {
+        dbuf_t b = { .buf=buf, .bufsize=LOGLINE_LEN, .pos=0 };
+        log_header(&b, rt_getUTC(), MOD_SYS|WARNING);
+        xprintf(&b, "Log ring overflow - %u lines dropped\n", dropped);
+        __atomic_sub_fetch(&ringDropped, dropped, __ATOMIC_RELAXED);
+        pos = b.pos;
+    }
+    u4_t head = __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE);
+    u4_t tail = ringTail;
+    while( tail != head && bufsize - pos >= LOGLINE_LEN ) {
+        u4_t off = tail & (ringSize-1);
+        logrec_t* r = (logrec_t*)&ring[off];
+        if( r->len == 0 ) {
+            tail += ringSize - off;
+            continue;
+        }
+        dbuf_t b = { .buf=buf+pos, .bufsize=LOGLINE_LEN, .pos=0 };
+        if( r->fmt == NULL ) {
+            memcpy(b.buf, r+1, b.pos = r->dlen);
+        } else {
+            log_header(&b, r->utc, r->mod_level);
+            xprintf_replay(&b, r->fmt, (const u1_t*)(r+1), r->dlen);
+            xeol(&b);
+        }
+        pos += b.pos;
+        tail += r->len;
+        __atomic_store_n(&ringTail, tail, __ATOMIC_RELEASE);
+    }
+    return pos;
 }
 
 int log_str2level (const char* level) {
@@ -124,31 +241,73 @@ void log_setSlaveIdx (s1_t idx) {
     slaveMod[2] = idx%10 + '0';
 }
 
+static void setModLevel (int m, int level) {
+    logLevels[m] = level;
+    level = min(level, rmtLevels[m]);
+    for( int l=0; l < 8; l++ )
+        log_enabled[m*8+l] = l >= level;
+}
+
 int log_setLevel (int level) {
     if( level < 0 ) return -1;
     int mod = level & MOD_ALL;
     level &= 7;
     if( mod == MOD_ALL ) {
         for( int m=0; m<32; m++ ) {
-            logLevels[m] = level;
+            setModLevel(m, level);
         }
         return -1;
     }
     int old = logLevels[mod>>3];
-    logLevels[mod>>3] = level;
+    setModLevel(mod>>3, level);
     return old;
 }
 
-int log_shallLog (u1_t mod_level) {
-    return (mod_level&7) >= logLevels[(mod_level & MOD_ALL) >> 3];
+void log_setRemoteCapture (int on) {
+    rmtCapture = on;
+}
+
+str_t log_setRemoteLevels (const char* levels) {
+    for( int m=0; m<32; m++ )
+        rmtLevels[m] = 8;
+    str_t err = NULL;
+    while( levels && levels[0] ) {
+        int l = log_str2level(levels);
+        if( l < 0 ) {
+            err = levels;
+            break;
+        }
+        int mod = l & MOD_ALL;
+        for( int m=0; m<32; m++ ) {
+            if( mod == MOD_ALL || m == mod>>3 )
+                rmtLevels[m] = l & 7;
+        }
+        levels = strchr(levels, ',');
+        levels = levels ? levels+1 : NULL;
+    }
+    for( int m=0; m<32; m++ )
+        setModLevel(m, logLevels[m]);
+    return err;
 }
 
 void log_vmsg (u1_t mod_level, const char* fmt, va_list args) {
     if( !log_shallLog(mod_level) )
         return;
-    int n = log_header(mod_level);
-    logbuf.pos = n;
+    if( ring && !rmtCapture ) {
+        u1_t data[LOGREC_MAX] __attribute__((aligned(8)));
+        va_list ap;
+        va_copy(ap, args);
+        int dlen = vxprintf_capture(data, sizeof(data), fmt, ap);
+        va_end(ap);
+        if( dlen >= 0 ) {
+            ringPut(mod_level, fmt, data, dlen);
+            return;
+        }
+        // Too many arguments - render now and queue as text
+    }
+    log_header(&logbuf, rt_getUTC(), mod_level);
     vxprintf(&logbuf, fmt, args);
+    logbufMl = mod_level;
     log_flush();
 }
 
@@ -171,7 +330,8 @@ int log_special (u1_t mod_level, dbuf_t* b) {
         return 0;
     b->buf = logbuf.buf;
     b->bufsize = logbuf.bufsize;
-    b->pos = log_header(mod_level);
+    b->pos = log_header(&logbuf, rt_getUTC(), mod_level);
+    logbufMl = mod_level;
     return 1;
 }
 
@@ -184,7 +344,21 @@ void log_specialFlush (int len) {
 void log_flush () {
     xeol(&logbuf);
     xeos(&logbuf);
-    sys_addLog(logbuf.buf, logbuf.pos);
+    u1_t ml = logbufMl;
+    logbufMl = 0xFF;
+    if( rmtCapture && logbuf.pos > 0 ) {
+        int m = (ml & MOD_ALL) >> 3, l = ml & 7;
+        rmtlog_addLine(logbuf.buf, logbuf.pos, l >= rmtLevels[m]);
+        if( l < logLevels[m] ) {
+            logbuf.pos = 0;   // only wanted by remote
+            return;
+        }
+    }
+    if( ring && logbuf.pos > 0 ) {
+        ringPut(0, NULL, logbuf.buf, logbuf.pos);
+    } else {
+        sys_addLog(logbuf.buf, logbuf.pos);
+    }
     logbuf.pos = 0;
 }
 
@@ -0,0 +1,138 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include "s2conf.h"
+#include "uj.h"
+#include "tc.h"
+#include "fs.h"
+#include "metrics.h"
+
+metrics_t metrics;
+
+typedef struct mhdef {
+    str_t  name;
+    double le[MH_BUCKETS-1];   // upper bounds - last bucket is +Inf
+} mhdef_t;
+
+static const mhdef_t MHDEFS[MH_MAX] = {
+    [MH_SYNC_QUALITY] = { "station_timesync_quality_us", { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 } },
+    [MH_LNS_RTT]      = { "station_lns_rtt_seconds",     { .01, .025, .05, .1, .25, .5, 1, 2.5, 5 } },
+    [MH_RAL_TX]       = { "station_ral_tx_seconds",      { .0005, .001, .0025, .005, .01, .025, .05, .1, .25 } },
+    [MH_RAL_START]    = { "station_ral_startup_seconds", { .1, .25, .5, 1, 2, 3, 5, 8, 13 } },
+    [MH_RAL_FIRST_RX] = { "station_ral_first_uplink_seconds", { 1, 2, 5, 10, 30, 60, 120, 300, 600 } },
+};
+
+static const str_t MPNAMES[MP_MAX] = {
+    [MP_RADIO_INIT] = "station_ral_startup_radioinit_us",
+    [MP_SETCONF]    = "station_ral_startup_setconf_us",
+    [MP_LBT]        = "station_ral_startup_lbt_us",
+    [MP_LGW_START]  = "station_ral_startup_lgwstart_us",
+};
+
+
+void metrics_observe (int h, double v) {
+    mhist_t* mh = &metrics.hist[h];
+    const double* le = MHDEFS[h].le;
+    int i = 0;
+    while( i < MH_BUCKETS-1 && v > le[i] )
+        i++;
+    mh->bucket[i] += 1;
+    mh->count += 1;
+    mh->sum += v;
+}
+
+
+static void counter (dbuf_t* b, str_t name, uL_t v) {
+    xprintf(b, "# TYPE %s counter\n%s %lu\n", name, name, v);
+}
+
+static void gauge (dbuf_t* b, str_t name, sL_t v) {
+    xprintf(b, "# TYPE %s gauge\n%s %ld\n", name, name, v);
+}
+
+static void histogram (dbuf_t* b, int h) {
+    const mhdef_t* d = &MHDEFS[h];
+    const mhist_t* mh = &metrics.hist[h];
+    u4_t cum = 0;
+    xprintf(b, "# TYPE %s histogram\n", d->name);
+    for( int i=0; i < MH_BUCKETS-1; i++ ) {
+        cum += mh->bucket[i];
+        xprintf(b, "%s_bucket{le=\"%g\"} %u\n", d->name, d->le[i], cum);
+    }
+    xprintf(b, "%s_bucket{le=\"+Inf\"} %u\n%s_sum %g\n%s_count %u\n",
+            d->name, mh->count, d->name, mh->sum, d->name, mh->count);
+}
+
+
+void metrics_render (dbuf_t* b) {
+    counter(b, "station_rx_frames_total",      metrics.rxFrames);
+    counter(b, "station_rx_mirrors_total",     metrics.rxMirrors);
+    counter(b, "station_rx_filtered_total",    metrics.rxFiltered);
+    counter(b, "station_updf_sent_total",      metrics.updfSent);
+    counter(b, "station_tx_started_total",     metrics.txStarted);
+    counter(b, "station_tx_missed_total",      metrics.txMissed);
+    counter(b, "station_tx_nochannel_total",   metrics.txNoCA);
+    counter(b, "station_tx_failed_total",      metrics.txFailed);
+    counter(b, "station_tx_dropped_total",     metrics.txDropped);
+    counter(b, "station_tx_airtime_us_total",  metrics.txAirtime);
+    counter(b, "station_ws_connects_total",    metrics.wsConnects);
+    counter(b, "station_ws_rx_msgs_total",     metrics.wsRxMsgs);
+    counter(b, "station_ws_rx_bytes_total",    metrics.wsRxBytes);
+    counter(b, "station_ws_tx_msgs_total",     metrics.wsTxMsgs);
+    counter(b, "station_ws_tx_bytes_total",    metrics.wsTxBytes);
+    counter(b, "station_timesync_rejected_total", metrics.tsRejected);
+    counter(b, "station_ral_rx_packets_total", metrics.ralRxPkts);
+    counter(b, "station_ral_rx_crcbad_total",  metrics.ralRxCrcBad);
+    counter(b, "station_ral_rx_dropped_total", metrics.ralRxDropped);
+    for( int h=0; h < MH_MAX; h++ )
+        histogram(b, h);
+    for( int p=0; p < MP_MAX; p++ )
+        gauge(b, MPNAMES[p], metrics.ralStartup[p]);
+
+    // Gauges are sampled at scrape time - nothing to maintain on hot paths
+    tc_t* tc = TC;
+    gauge(b, "station_lns_connected", tc && tc->tstate == TC_MUXS_CONNECTED);
+    if( tc ) {
+        txq_t* txq = &tc->s2ctx.txq;
+        int freeJobs = 0;
+        for( txidx_t i = txq->freeJobs; i != TXIDX_END && i != TXIDX_NIL; i = txq_idx2job(txq, i)->next )
+            freeJobs++;
+        gauge(b, "station_rxq_depth",       tc->s2ctx.rxq.next - tc->s2ctx.rxq.first);
+        gauge(b, "station_txq_jobs_free",   freeJobs);
+        gauge(b, "station_txq_data_free",   MAX_TXDATA - txq->txdataInUse);
+    }
+    fsinfo_t fi;
+    fs_info(&fi);
+    if( fi.activeSection <= 1 ) {
+        gauge(b, "station_fs_used_bytes",  fi.used);
+        gauge(b, "station_fs_free_bytes",  fi.free);
+        gauge(b, "station_fs_records",     fi.records);
+        counter(b, "station_fs_gc_cycles_total", fi.gcCycles);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _metrics_h_
+#define _metrics_h_
+
+#include "rt.h"
+
+// Station internals exported in Prometheus text format (see /metrics in web.c).
+// Hot paths only bump plain counters - everything else is gathered when scraped.
+
+enum {
+    MH_SYNC_QUALITY,   // quality of MCU/SX130X time syncs [us]
+    MH_LNS_RTT,        // round trip of timesync requests to LNS [s]
+    MH_RAL_TX,         // time to hand a frame to the radio layer [s]
+    MH_RAL_START,      // router_config until all concentrators are up [s]
+    MH_RAL_FIRST_RX,   // router_config until first uplink [s]
+    MH_MAX
+};
+enum { MH_BUCKETS = 10 };  // incl. +Inf
+
+// Concentrator bring-up phases
+enum {
+    MP_RADIO_INIT,     // radio init command (reset etc.)
+    MP_SETCONF,        // board, TX LUT, RF and IF chains handed to HAL
+    MP_LBT,            // LBT setup
+    MP_LGW_START,      // lgw_start incl. GPS enable
+    MP_MAX
+};
+
+typedef struct mhist {
+    u4_t   bucket[MH_BUCKETS];  // non-cumulative - rendered cumulative
+    u4_t   count;
+    double sum;
+} mhist_t;
+
+typedef struct metrics {
+    // s2e
+    u4_t rxFrames;      // frames handed over by the radio layer
+    u4_t rxMirrors;     // mirror frames dropped
+    u4_t rxFiltered;    // failed sanity checks or stopped by filters
+    u4_t updfSent;      // uplinks reported to LNS
+    u4_t txStarted;     // frames handed to the radio
+    u4_t txMissed;      // missed TX time
+    u4_t txNoCA;        // channel busy
+    u4_t txFailed;      // radio refused/did not emit
+    u4_t txDropped;     // no alternative left
+    uL_t txAirtime;     // [us]
+    // net
+    u4_t wsConnects;
+    u4_t wsRxMsgs;
+    u4_t wsTxMsgs;
+    uL_t wsRxBytes;
+    uL_t wsTxBytes;
+    // timesync
+    u4_t tsRejected;    // syncs discarded due to bad quality
+    // ral
+    u4_t ralRxPkts;     // packets fetched from the concentrator
+    u4_t ralRxCrcBad;
+    u4_t ralRxDropped;  // no rxjob space, oversized or unmappable DR
+    u4_t ralStartup[MP_MAX];  // last bring-up [us] - slowest concentrator per phase
+    mhist_t hist[MH_MAX];
+} metrics_t;
+
+extern metrics_t metrics;
+
+void metrics_observe (int h, double v);
+void metrics_render  (dbuf_t* b);
+
+#endif // _metrics_h_
@@ -27,6 +27,7 @@
  */
 
 
+#include <sys/stat.h>
 #include "s2conf.h"
 #include "sys.h"
 #include "uj.h"
@@ -35,6 +36,11 @@
 #include "httpd.h"
 #include "tls.h"
 #include "kwcrc.h"
+#include "fs.h"
+#include "metrics.h"
+#if defined(CFG_wsdeflate)
+#include <zlib.h>
+#endif
 
 str_t const SUFFIX2CT[] = {
     "txt",  "text/plain",
@@ -318,9 +324,10 @@ enum { WSHDR_RESV_W = 8 }; // reserve at start of wbuf
 enum { WSHDR_RESV_R = 1 }; // reserve at start of rbuf
 enum { WSHDR_MASK   = 0x80,
        WSHDR_LEN2   = 0x7E,  // 16 bit length
-       WSHDR_LEN4   = 0x7F,  // 64 bit length - not used in this code
+       WSHDR_LEN4   = 0x7F,  // 64 bit length - only accepted on receive
 };
 enum { WSHDR_FIN    = 0x80,
+       WSHDR_RSV1   = 0x40,  // permessage-deflate: compressed message
        WSHDR_CONT   = 0x00,
        WSHDR_TEXT   = 0x01,
        WSHDR_BINARY = 0x02,
@@ -330,11 +337,15 @@ enum { WSHDR_FIN    = 0x80,
 };
 
 
-// Write data between wpos..wend
-static int writeData (conn_t* conn) {
+enum { WS_STAGE_SIZE = 16*1024 }; // coalesce WS frames up to one max TLS record
+enum { WS_MASK_KEY   = 0x01010101 };
+
+
+// Write data between *pos..end
+static int writeBytes (conn_t* conn, u1_t* buf, doff_t* pos, doff_t end) {
     int ret;
-    while( conn->wpos < conn->wend ) {
-        if( (ret = tls_write(&conn->netctx, conn->tlsctx, conn->wbuf + conn->wpos, conn->wend - conn->wpos) ) <= 0 ) {
+    while( *pos < end ) {
+        if( (ret = tls_write(&conn->netctx, conn->tlsctx, buf + *pos, end - *pos) ) <= 0 ) {
             if( ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE ) {
                 log_mbedError(MOD_AIO|ERROR, ret, "[%d] Send failed", conn->netctx.fd);
                 return IO_ERROR;
@@ -342,51 +353,425 @@ static int writeData (conn_t* conn) {
             return IO_WRPEND;
         }
         LOG(MOD_AIO|XDEBUG, "[%d] socket write bytes=%d", conn->netctx.fd, ret);
-        conn->wpos += ret;
+        conn->wsWrites += 1;
+        *pos += ret;
     }
     return IO_WRDONE;
 }
 
+// Write data between wpos..wend
+static int writeData (conn_t* conn) {
+    return writeBytes(conn, conn->wbuf, &conn->wpos, conn->wend);
+}
+
+// Write coalesced WS frames between spos..sfill
+static int writeStaged (conn_t* conn) {
+    int e = writeBytes(conn, conn->sbuf, &conn->spos, conn->sfill);
+    if( e == IO_WRDONE )
+        conn->spos = conn->sfill = 0;
+    return e;
+}
+
+// XOR mask data with a 4 byte key (memory order of key is wire order of mask).
+// Processes 8 bytes per step - src and dst may be the same but must not otherwise overlap.
+static void maskData (u1_t* dst, const u1_t* src, int len, u4_t key) {
+    uL_t k8 = ((uL_t)key << 32) | key;
+    int i = 0;
+    for( ; i+8 <= len; i += 8 ) {
+        uL_t w;
+        memcpy(&w, src+i, 8);
+        w ^= k8;
+        memcpy(dst+i, &w, 8);
+    }
+    const u1_t* k1 = (const u1_t*)&key;
+    for( ; i < len; i++ )
+        dst[i] = src[i] ^ k1[i&3];
+}
+
+#if defined(CFG_wsdeflate)
+// --------------------------------------------------------------------------------
+// permessage-deflate (RFC 7692)
+// --------------------------------------------------------------------------------
+
+enum { WS_DEFLATE_STATS = 100 };  // log compression stats every N sent messages
+
+typedef struct wsdeflate {
+    z_stream tx;
+    z_stream rx;
+    u1_t     txReset;    // client_no_context_takeover
+    u1_t     rxReset;    // server_no_context_takeover
+    u1_t     rxMsg;      // message being received is compressed
+    u1_t     inflated;   // delivered message is in ibuf
+    u1_t*    zbuf;       // deflate output - WS_STAGE_SIZE
+    u1_t*    ibuf;       // inflated message - ibuf[0] is OPCODE
+    doff_t   ibufsize;
+    doff_t   ilen;
+    u4_t     txMsgs, txRaw, txZip;
+    u4_t     rxMsgs, rxRaw, rxZip;
+    ustime_t txTime, rxTime;
+} wsdeflate_t;
+
+static int zsWbits () {
+    return max(9, min(15, (int)WS_DEFLATE_WBITS));
+}
+
+static void zsLogStats (conn_t* conn) {
+    wsdeflate_t* zs = conn->zs;
+    LOG(MOD_AIO|DEBUG, "[%d] WS deflate: tx %u msgs %u->%u bytes (%.1f%%) %.1fus/msg - rx %u msgs %u->%u bytes (%.1f%%) %.1fus/msg",
+        conn->netctx.fd,
+        zs->txMsgs, zs->txRaw, zs->txZip, zs->txRaw ? 100.0*zs->txZip/zs->txRaw : 0.0, zs->txMsgs ? (double)zs->txTime/zs->txMsgs : 0.0,
+        zs->rxMsgs, zs->rxZip, zs->rxRaw, zs->rxRaw ? 100.0*zs->rxZip/zs->rxRaw : 0.0, zs->rxMsgs ? (double)zs->rxTime/zs->rxMsgs : 0.0);
+}
+
+static void zsFree (conn_t* conn) {
+    wsdeflate_t* zs = conn->zs;
+    if( zs == NULL )
+        return;
+    if( zs->txMsgs || zs->rxMsgs )
+        zsLogStats(conn);
+    deflateEnd(&zs->tx);
+    inflateEnd(&zs->rx);
+    rt_free(zs->zbuf);
+    rt_free(zs->ibuf);
+    rt_free(zs);
+    conn->zs = NULL;
+}
+
+// Parse window bits parameter value: =N or ="N"
+static int zsParseBits (char** pp) {
+    char* p = http_skipWsp(*pp);
+    if( *p != '=' )
+        return -1;
+    p = http_skipWsp(p+1);
+    int q = *p == '"';
+    str_t v = p+q;
+    int bits = rt_readDec(&v);
+    if( v == p+q || (q && *v++ != '"') )
+        return -1;
+    *pp = (char*)v;
+    return bits;
+}
+
+// Check WS upgrade response for accepted extensions and set up compression state.
+static int zsNegotiate (conn_t* conn) {
+    char* p = http_findHeader((char*)conn->rbuf, "sec-websocket-extensions");
+    if( p == NULL ) {
+        if( WS_DEFLATE )
+            LOG(MOD_AIO|INFO, "[%d] Server declined permessage-deflate", conn->netctx.fd);
+        return 1;
+    }
+    int n = http_icaseCmp(p, "permessage-deflate");
+    if( !WS_DEFLATE || n == 0 )
+        goto bad;
+    int wbits = zsWbits();
+    int sbits = 15, cbits = wbits, txReset = 0, rxReset = 0;
+    p += n;
+    while( *(p = http_skipWsp(p)) == ';' ) {
+        p = http_skipWsp(p+1);
+        if( (n = http_icaseCmp(p, "server_no_context_takeover")) ) {
+            rxReset = 1;
+            p += n;
+        }
+        else if( (n = http_icaseCmp(p, "client_no_context_takeover")) ) {
+            txReset = 1;
+            p += n;
+        }
+        else if( (n = http_icaseCmp(p, "server_max_window_bits")) ) {
+            p += n;
+            if( (sbits = zsParseBits(&p)) < 8 || sbits > wbits )
+                goto bad;
+        }
+        else if( (n = http_icaseCmp(p, "client_max_window_bits")) ) {
+            p += n;
+            if( (cbits = zsParseBits(&p)) < 9 || cbits > wbits )
+                goto bad;
+        }
+        else {
+            goto bad;
+        }
+    }
+    if( *p != '\r' )
+        goto bad;  // multiple extensions - we only offered one
+
+    wsdeflate_t* zs = rt_malloc(wsdeflate_t);
+    // Scale hash table with window: memory ~ 2^(cbits+2) + 2^(memLevel+9)
+    if( deflateInit2(&zs->tx, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -cbits, max(1, cbits-7), Z_DEFAULT_STRATEGY) != Z_OK ) {
+        rt_free(zs);
+        goto bad;
+    }
+    if( inflateInit2(&zs->rx, -sbits) != Z_OK ) {
+        deflateEnd(&zs->tx);
+        rt_free(zs);
+        goto bad;
+    }
+    zs->txReset = txReset;
+    zs->rxReset = rxReset;
+    zs->zbuf = rt_mallocN(u1_t, WS_STAGE_SIZE);
+    zs->ibufsize = 4*1024;
+    zs->ibuf = rt_mallocN(u1_t, zs->ibufsize);
+    conn->zs = zs;
+    LOG(MOD_AIO|INFO, "[%d] WS permessage-deflate: client_max_window_bits=%d%s server_max_window_bits=%d%s",
+        conn->netctx.fd, cbits, txReset ? " (no context takeover)" : "", sbits, rxReset ? " (no context takeover)" : "");
+    return 1;
+
+ bad:
+    LOG(MOD_AIO|ERROR, "[%d] Unsupported WS extensions response: %.*s", conn->netctx.fd,
+        (int)(strchr(p, '\r') ? strchr(p, '\r') - p : 0), p);
+    return 0;
+}
+
+// Upper bound of compressed size of a message of len bytes
+static int zsBound (conn_t* conn, int len) {
+    return deflateBound(&conn->zs->tx, len) + 6;  // + empty stored block of Z_SYNC_FLUSH
+}
+
+// Compress message into zbuf - caller made sure zsBound fits into zbuf
+static int zsDeflate (conn_t* conn, const u1_t* data, int dlen) {
+    wsdeflate_t* zs = conn->zs;
+    ustime_t t0 = rt_getTime();
+    z_stream* z = &zs->tx;
+    z->next_in = (u1_t*)data;
+    z->avail_in = dlen;
+    z->next_out = zs->zbuf;
+    z->avail_out = WS_STAGE_SIZE;
+    int err = deflate(z, Z_SYNC_FLUSH);
+    assert(err == Z_OK && z->avail_in == 0 && z->avail_out > 0);
+    // Strip trailing 00 00 FF FF of sync flush
+    int zlen = z->next_out - zs->zbuf - 4;
+    if( zs->txReset )
+        deflateReset(z);
+    zs->txTime += rt_getTime() - t0;
+    zs->txRaw += dlen;
+    zs->txZip += zlen;
+    if( ++zs->txMsgs % WS_DEFLATE_STATS == 0 )
+        zsLogStats(conn);
+    return zlen;
+}
+
+// Decompress message rbuf[p..e] into ibuf
+static int zsInflate (conn_t* conn, doff_t p, doff_t e, u1_t opcode) {
+    static const u1_t tail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+    wsdeflate_t* zs = conn->zs;
+    ustime_t t0 = rt_getTime();
+    z_stream* z = &zs->rx;
+    doff_t ilen = 0;
+    int ended = 0;  // peer finished the message with a final (BFINAL) block - RFC 7692 7.2.3.1
+    for( int k=0; k<2 && !ended; k++ ) {
+        z->next_in  = k==0 ? &conn->rbuf[p] : (u1_t*)tail;
+        z->avail_in = k==0 ? e-p : sizeof(tail);
+        do {
+            if( ilen+1 == zs->ibufsize ) {
+                if( zs->ibufsize >= conn->rbufmax ) {
+                    LOG(MOD_AIO|ERROR, "[%d] Inflated WS message too large (max %d)", conn->netctx.fd, conn->rbufmax);
+                    return 0;
+                }
+                doff_t sz = min(2*zs->ibufsize, conn->rbufmax);
+                u1_t* b = rt_mallocN(u1_t, sz);
+                memcpy(b, zs->ibuf, zs->ibufsize);
+                rt_free(zs->ibuf);
+                zs->ibuf = b;
+                zs->ibufsize = sz;
+            }
+            z->next_out = zs->ibuf+1+ilen;
+            z->avail_out = zs->ibufsize-1-ilen;
+            int err = inflate(z, Z_SYNC_FLUSH);
+            ilen = z->next_out - zs->ibuf - 1;
+            if( err == Z_STREAM_END ) {
+                ended = 1;  // ignore anything after the final block
+                break;
+            }
+            if( err != Z_OK && err != Z_BUF_ERROR ) {
+                LOG(MOD_AIO|ERROR, "[%d] WS inflate failed: %s", conn->netctx.fd, z->msg ? z->msg : "?");
+                return 0;
+            }
+        } while( z->avail_in || z->avail_out == 0 );
+    }
+    if( zs->rxReset || ended )
+        inflateReset(z);
+    zs->ibuf[0] = opcode;
+    zs->ilen = ilen;
+    zs->inflated = 1;
+    zs->rxTime += rt_getTime() - t0;
+    zs->rxRaw += ilen;
+    zs->rxZip += e-p;
+    zs->rxMsgs += 1;
+    return 1;
+}
+#endif // defined(CFG_wsdeflate)
+
+
+// Convert as many pending frames from wend..wfill into wire format as fit into sbuf.
+// Returns number of frames staged. Zero means next frame is too large for sbuf.
+static int stageFrames (conn_t* conn) {
+    u1_t* wbuf = conn->wbuf;
+    u1_t* s = conn->sbuf;
+    doff_t wend = conn->wend;
+    int n = 0, frames = 0;
+    u4_t key = WS_MASK_KEY;
+    while( wend < conn->wfill ) {
+        u2_t dlen = rt_rmsbf2(wbuf + wend);
+        u1_t ftype = wbuf[wend+2];  // WSHDR_TEXT | WSHDR_BINARY | WSHDR_PONG
+        const u1_t* d = wbuf + wend + WSHDR_INTRA;
+        int plen = dlen;
+#if defined(CFG_wsdeflate)
+        if( conn->zs && ftype != WSHDR_PONG ) {
+            // Check before compressing - compressor state must only advance for frames being sent
+            if( n + 8 + zsBound(conn, dlen) > WS_STAGE_SIZE )
+                break;
+            plen = zsDeflate(conn, d, dlen);
+            d = conn->zs->zbuf;
+            ftype |= WSHDR_RSV1;
+        }
+#endif
+        int hlen = plen < WSHDR_LEN2 ? 6 : 8;
+        if( n + hlen + plen > WS_STAGE_SIZE )
+            break;
+        s[n++] = WSHDR_FIN|ftype;
+        if( hlen == 6 ) {
+            s[n++] = plen | WSHDR_MASK;
+        } else {
+            s[n++] = WSHDR_LEN2 | WSHDR_MASK;
+            s[n++] = plen>>8;
+            s[n++] = plen;
+        }
+        memcpy(s+n, &key, 4);
+        maskData(s+n+4, d, plen, key);
+        n += 4 + plen;
+        wend += WSHDR_INTRA + dlen;
+        frames += 1;
+    }
+    if( frames ) {
+        conn->spos = 0;
+        conn->sfill = n;
+        conn->wpos = conn->wend = wend;  // frames consumed - space may be reused by ws_getSendbuf
+        conn->wsFrames += frames;
+        LOG(MOD_AIO|XDEBUG, "[%d] WS coalesced %d frames into %d bytes", conn->netctx.fd, frames, n);
+    }
+    return frames;
+}
+
+
+// Oldest byte in WS ring still in use
+static doff_t ringTail (conn_t* conn) {
+    return conn->rmsg ? conn->rmsg : conn->rnext;
+}
+
+// Keep WS ring offsets small - bytes at x and x+rbufsize are the same
+static void ringNormalize (conn_t* conn) {
+    doff_t n = conn->rbufsize;
+    if( ringTail(conn) < n )
+        return;
+    conn->rbeg  -= n;
+    conn->rend  -= n;
+    conn->rnext -= n;
+    conn->rpos  -= n;
+    if( conn->rmsg ) {
+        conn->rmsg  -= n;
+        conn->rfrag -= n;
+    }
+}
+
+// Replace WS ring by a larger one able to hold need bytes from ring tail
+static int ringGrow (conn_t* conn, uL_t need) {
+    if( need > conn->rbufmax )
+        return 0;
+    int size = max(need, min(2*(uL_t)conn->rbufsize, conn->rbufmax));
+    u1_t* rbuf = sys_allocRing(&size);
+    doff_t tail = ringTail(conn);
+    LOG(MOD_AIO|INFO, "[%d] Growing WS recv buffer: %d -> %d bytes", conn->netctx.fd, conn->rbufsize, size);
+    memcpy(rbuf + WSHDR_RESV_R, conn->rbuf + tail, conn->rpos - tail);
+    sys_freeRing(conn->rbuf, conn->rbufsize);
+    conn->rbuf = rbuf;
+    conn->rbufsize = size;
+    conn->rbeg  = conn->rbeg  - tail + WSHDR_RESV_R;
+    conn->rend  = conn->rend  - tail + WSHDR_RESV_R;
+    conn->rnext = conn->rnext - tail + WSHDR_RESV_R;
+    conn->rpos  = conn->rpos  - tail + WSHDR_RESV_R;
+    if( conn->rmsg ) {
+        conn->rmsg  = conn->rmsg  - tail + WSHDR_RESV_R;
+        conn->rfrag = conn->rfrag - tail + WSHDR_RESV_R;
+    }
+    return 1;
+}
+
 
 enum { WS_FRAME, HTTP_HDR, HTTP_BODY };
-// Fill in data from rpos..rbufsize
+// Fill in data from rpos..rbufsize (WS_FRAME: ring from rpos up to ring tail)
 static int readData (conn_t* conn, int mode) {
     int r;
     while(1) {
         if( mode == WS_FRAME ) {
-            // Do we have frame frame header and all data?
-            int b = conn->rbeg;
-            u1_t* r = &conn->rbuf[b];
-            int n = conn->rpos - b;
+            ringNormalize(conn);
+            // Do we have frame header and all data?
+            doff_t b = conn->rnext;
+            u1_t* h = &conn->rbuf[b];
+            doff_t n = conn->rpos - b;
             if( n >= 2 ) {
-                u1_t opcode = r[0] & 0xF;
-                u2_t len = r[1] & 0x7F;
-                // ensure: FIN=1 RSV1/2/3=0, no masking (0x80) and no 64bit length
-                if( (r[0] & 0xF0) != 0x80 || (r[1]&0x80) || len == 0x7F ) {
-                    LOG(MOD_AIO|ERROR, "[%d] Illegal WS frame: %02X:%02X", conn->netctx.fd, r[0], r[1]);
+                u1_t opcode = h[0] & 0xF;
+                int fin = h[0] & WSHDR_FIN;
+                uL_t len = h[1] & 0x7F;
+                int hlen = len < WSHDR_LEN2 ? 2 : len == WSHDR_LEN2 ? 4 : 10;
+                // ensure: RSV2/3=0, RSV1 only if compressing, no masking (0x80), control frames short and not fragmented
+                int rsv1 = h[0] & WSHDR_RSV1;
+                if( (h[0] & 0x30) || (h[1] & WSHDR_MASK) || (opcode >= WSHDR_CLOSE && (!fin || hlen > 2)) ||
+                    (rsv1 && (conn->zs == NULL || opcode == WSHDR_CONT || opcode >= WSHDR_CLOSE)) ) {
+                    LOG(MOD_AIO|ERROR, "[%d] Illegal WS frame: %02X:%02X", conn->netctx.fd, h[0], h[1]);
                     return IO_ERROR;
                 }
-                if( len < 0x7E ) {
-                    if( len+2 <= n ) {
-                        conn->rbeg = b + 2;
-                        conn->rend = b + 2 + len;
-                        r[1] = opcode;
-                        return IO_RDDONE;
+                if( opcode < WSHDR_CLOSE && (opcode == WSHDR_CONT) != (conn->rmsg != 0) ) {
+                    LOG(MOD_AIO|ERROR, "[%d] Illegal WS fragment sequence: %02X", conn->netctx.fd, h[0]);
+                    return IO_ERROR;
+                }
+                if( n >= hlen ) {
+                    if( hlen == 4 )
+                        len = rt_rmsbf2(&h[2]);
+                    else if( hlen == 10 )
+                        len = rt_rmsbf8(&h[2]);
+                    uL_t need = (uL_t)(b - ringTail(conn)) + hlen + len;
+                    if( need > conn->rbufsize ) {
+                        if( !ringGrow(conn, need) ) {
+                            LOG(MOD_AIO|ERROR, "[%d] WS message too large: %lu bytes (max %d)", conn->netctx.fd, need, conn->rbufmax);
+                            return IO_ERROR;
+                        }
+                        continue;
                     }
-                } else if( n >= 4 ) {
-                    len = rt_rmsbf2(&r[2]);
-                    if( len+4 <= n ) {
-                        conn->rbeg = b + 4;
-                        conn->rend = b + 4 + len;
-                        r[3] = opcode;
+                    if( hlen + len <= n ) {
+#if defined(CFG_wsdeflate)
+                        if( conn->zs && opcode != WSHDR_CONT && opcode < WSHDR_CLOSE )
+                            conn->zs->rxMsg = rsv1;
+#endif
+                        doff_t p = b + hlen;
+                        doff_t e = p + len;
+                        conn->rnext = e;
+                        if( opcode == WSHDR_CONT ) {
+                            // Append fragment to message - only moves this fragment over preceding headers
+                            memmove(&conn->rbuf[conn->rfrag], &conn->rbuf[p], len);
+                            conn->rfrag += len;
+                            if( !fin )
+                                continue;
+                            p = conn->rmsg;
+                            e = conn->rfrag;
+                            opcode = conn->ropcode;
+                            conn->rmsg = conn->rfrag = 0;
+                        }
+                        else if( !fin ) {
+                            // First fragment of a message
+                            conn->rmsg = p;
+                            conn->rfrag = e;
+                            conn->ropcode = opcode;
+                            continue;
+                        }
+                        conn->rbeg = p;
+                        conn->rend = e;
+                        conn->rbuf[p-1] = opcode;
+#if defined(CFG_wsdeflate)
+                        if( conn->zs && opcode < WSHDR_CLOSE && conn->zs->rxMsg && !zsInflate(conn, p, e, opcode) )
+                            return IO_ERROR;
+#endif
                         return IO_RDDONE;
                     }
                 }
-                if( b+len+2 > conn->rbufsize )
-                    goto compact;
             }
-            if( conn->rpos >= conn->rbufsize )
-                goto compact;
         }
         else if( mode == HTTP_HDR ) {
             // Did we see end of HTTP header "\r\n\r\n" ?
@@ -409,8 +794,12 @@ static int readData (conn_t* conn, int mode) {
                 return IO_RDDONE;
             }
         }
-    readagain:
-        if( (r = tls_read(&conn->netctx, conn->tlsctx, conn->rbuf + conn->rpos, conn->rbufsize - conn->rpos) ) <= 0 ) {
+        doff_t room = (mode == WS_FRAME ? ringTail(conn) + conn->rbufsize : conn->rbufsize) - conn->rpos;
+        if( room == 0 ) {
+            LOG(MOD_AIO|ERROR, "[%d] Recv buffer too small", conn->netctx.fd);
+            return IO_ERROR;
+        }
+        if( (r = tls_read(&conn->netctx, conn->tlsctx, conn->rbuf + conn->rpos, room) ) <= 0 ) {
             if( r == 0 ) {
                 LOG(MOD_AIO|DEBUG, "[%d] Connection closed unexpectedly", conn->netctx.fd);
                 return IO_ERROR;
@@ -424,19 +813,6 @@ static int readData (conn_t* conn, int mode) {
         LOG(MOD_AIO|XDEBUG, "[%d] socket read  bytes=%d", conn->netctx.fd, r);
         conn->rpos += r;
     }
-  compact:
-    // No enough remaining buffer space
-    LOG(MOD_AIO|INFO, "[%d] COMPACTING Recv buffer", conn->netctx.fd);
-    r = conn->rbeg-WSHDR_RESV_R;
-    if( r > 0 ) {
-        memmove(&conn->rbuf[WSHDR_RESV_R], &conn->rbuf[r+WSHDR_RESV_R], conn->rbufsize-r);
-        conn->rbeg -= r;
-        conn->rend -= r;
-        conn->rpos -= r;
-        goto readagain;
-    }
-    LOG(MOD_AIO|ERROR, "[%d] Recv buffer too small", conn->netctx.fd);
-    return IO_ERROR;
 }
 
 
@@ -455,11 +831,20 @@ static void triggerWsClosedEv(tmr_t* tmr) {
 
 void ws_shutdown (ws_t* conn) {
     LOG(MOD_AIO|DEBUG, "[%d] WS connection shutdown...", conn->netctx.fd);
+    if( conn->wsWrites )
+        LOG(MOD_AIO|DEBUG, "[%d] WS send stats: %u frames in %u writes (%.2f frames/write)",
+            conn->netctx.fd, conn->wsFrames, conn->wsWrites, (double)conn->wsFrames/conn->wsWrites);
     mbedtls_net_free(&conn->netctx);
-    rt_free(conn->rbuf);
+    sys_freeRing(conn->rbuf, conn->rbufsize);
     rt_free(conn->wbuf);
+    rt_free(conn->sbuf);
+#if defined(CFG_wsdeflate)
+    zsFree(conn);
+#endif
     conn->rbuf = NULL;
     conn->wbuf = NULL;
+    conn->sbuf = NULL;
+    conn->spos = conn->sfill = 0;
     rt_free((void*)conn->authtoken);
     conn->authtoken = NULL;
     tls_freeSession(conn->tlsctx); conn->tlsctx = NULL;
@@ -478,7 +863,9 @@ static void ws_closing_w (aio_t* aio) {
     LOG(MOD_AIO|XDEBUG, "[%d] ws_closing_w state=%d", conn->netctx.fd, conn->state);
     int e;
   again:
-    if( (e = writeData(conn)) == IO_ERROR ) {
+    if( (e = writeStaged(conn)) == IO_WRDONE )
+        e = writeData(conn);
+    if( e == IO_ERROR ) {
         ws_shutdown(conn);
         return;
     }
@@ -514,8 +901,9 @@ static void ws_connected_w (aio_t* aio) {
     // LOG(MOD_AIO|XDEBUG, "[%d] ws_connected_w state=%d", conn->netctx.fd, conn->state);
     int e;
   again:
-    if( conn->wpos < conn->wend ) {
-        if( (e = writeData(conn)) == IO_ERROR ) {
+    if( conn->spos < conn->sfill || conn->wpos < conn->wend ) {
+        // Either coalesced frames in sbuf or a single oversized frame in place in wbuf
+        if( (e = conn->spos < conn->sfill ? writeStaged(conn) : writeData(conn)) == IO_ERROR ) {
             ws_shutdown(conn);
             return;
         }
@@ -523,6 +911,8 @@ static void ws_connected_w (aio_t* aio) {
             return;
         assert(e==IO_WRDONE);
         conn->evcb(conn, WSEV_DATASENT);
+        if( conn->state != WS_CONNECTED )
+            return;
     }
     // Do we have more data pending?
     doff_t wend = conn->wend;
@@ -531,33 +921,42 @@ static void ws_connected_w (aio_t* aio) {
         aio_set_wrfn(conn->aio, NULL);
         return;
     }
-    // Setup next frame
+    if( stageFrames(conn) )
+        goto again;
+    // Frame exceeds staging buffer - build WS header in place (in front of frame data)
     u1_t* wbuf = conn->wbuf;
     u2_t dlen = rt_rmsbf2(wbuf + wend);
     u1_t ftype = wbuf[wend+2];  // WSHDR_TEXT | WSHDR_BINARY
     wend += WSHDR_INTRA;
-    if( dlen < WSHDR_LEN2 ) {
-        // short WS header
-        wbuf[wend-6] = WSHDR_FIN|ftype;
-        wbuf[wend-5] = dlen | WSHDR_MASK;
-        conn->wpos = wend-6;
-    } else {
-        // medium WS head (note we have WSHDR_WRESV reserve at the start of wbuf)
-        wbuf[wend-8] = WSHDR_FIN|ftype;
-        wbuf[wend-7] = WSHDR_LEN2 | WSHDR_MASK;
-        wbuf[wend-6] = dlen>>8;
-        wbuf[wend-5] = dlen;
-        conn->wpos = wend-8;
-    }
+    assert(dlen >= WSHDR_LEN2);
+    // medium WS head (note we have WSHDR_WRESV reserve at the start of wbuf)
+    wbuf[wend-8] = WSHDR_FIN|ftype;
+    wbuf[wend-7] = WSHDR_LEN2 | WSHDR_MASK;
+    wbuf[wend-6] = dlen>>8;
+    wbuf[wend-5] = dlen;
+    conn->wpos = wend-8;
     conn->wend = wend + dlen;
-    // Masking value - 0
-    wbuf[wend-4] = wbuf[wend-3] = wbuf[wend-2] = wbuf[wend-1] = 1;
-    for( int i=0; i<dlen; i++ )
-        wbuf[wend+i] ^= 1;
+    u4_t key = WS_MASK_KEY;
+    memcpy(&wbuf[wend-4], &key, 4);
+    maskData(&wbuf[wend], &wbuf[wend], dlen, key);
+    conn->wsFrames += 1;
     goto again;
 }
 
 
+// Payload of received frame/message - preceded by OPCODE
+static u1_t* recvFrame (conn_t* conn, int* plen) {
+#if defined(CFG_wsdeflate)
+    if( conn->zs && conn->zs->inflated ) {
+        *plen = conn->zs->ilen;
+        return conn->zs->ibuf + 1;
+    }
+#endif
+    *plen = conn->rend - conn->rbeg;
+    return &conn->rbuf[conn->rbeg];
+}
+
+
 static void ws_connected_r (aio_t* aio) {
     ws_t* conn = (ws_t*)aio->ctx;
     assert(conn->state >= WS_CONNECTED);  // also called during close
@@ -571,11 +970,11 @@ static void ws_connected_r (aio_t* aio) {
     if( e == IO_RDPEND )
         return;
     assert(e==IO_RDDONE);
-    u1_t* p = &conn->rbuf[conn->rbeg];
+    int plen;
+    u1_t* p = recvFrame(conn, &plen);
     u1_t opcode = p[-1];
     switch(opcode) {
     case WSHDR_PING: {
-        int plen = conn->rend-conn->rbeg;
         LOG(MOD_AIO|XDEBUG, "[%d|WS] < PING (%H)", conn->netctx.fd, plen, p);
         dbuf_t wbuf = ws_getSendbuf(conn, plen);
         if( wbuf.buf == NULL ) {
@@ -596,8 +995,9 @@ static void ws_connected_r (aio_t* aio) {
         break;
     }
     case WSHDR_TEXT: {
+        metrics.wsRxMsgs += 1;
+        metrics.wsRxBytes += plen;
         int offset = 0;
-        int plen = conn->rend - conn->rbeg;
         while( offset < plen ) {
             LOG(MOD_AIO|XDEBUG, "[%d|WS] %c %.*s", conn->netctx.fd, offset ? '.' : '<', min((LOGLINE_LEN-50),plen-offset), p+offset);
             offset += (LOGLINE_LEN-50);
@@ -608,6 +1008,8 @@ static void ws_connected_r (aio_t* aio) {
         break;
     }
     case WSHDR_BINARY: {
+        metrics.wsRxMsgs += 1;
+        metrics.wsRxBytes += plen;
         conn->evcb(conn, WSEV_BINARYRCVD);
         if( conn->aio == NULL )
             return;
@@ -629,9 +1031,13 @@ static void ws_connected_r (aio_t* aio) {
         break;
     }
     }
-    conn->rbeg = conn->rend;
-    if( conn->rend == conn->rpos )
-        conn->rbeg = conn->rend = conn->rpos = WSHDR_RESV_R;
+#if defined(CFG_wsdeflate)
+    if( conn->zs )
+        conn->zs->inflated = 0;
+#endif
+    conn->rbeg = conn->rend = conn->rnext;
+    if( conn->rnext == conn->rpos && !conn->rmsg )
+        conn->rbeg = conn->rend = conn->rnext = conn->rpos = WSHDR_RESV_R;
     goto again;
 }
 
@@ -651,6 +1057,41 @@ void ws_close (ws_t* conn, int reason) {
 }
 
 
+// TLS sessions are cached per peer - conn->host/port must be set before the handshake starts
+static void tlsPeer (conn_t* conn, char* peer, int peersize) {
+    snprintf(peer, peersize, "%s:%s", conn->host, conn->port);
+}
+
+static void tlsResume (conn_t* conn) {
+    conn->tlsstart = rt_getTime();
+    char peer[MAX_HOSTNAME_LEN+MAX_PORT_LEN+2];
+    tlsPeer(conn, peer, sizeof(peer));
+    if( tls_resumeSession(conn->tlsctx, conn->credcat, conn->credset, peer) )
+        LOG(MOD_AIO|DEBUG, "[%d] Offering cached TLS session to %s", conn->netctx.fd, peer);
+}
+
+static void tlsHandshakeDone (conn_t* conn) {
+    if( conn->tlsstart == 0 )
+        return;
+    char peer[MAX_HOSTNAME_LEN+MAX_PORT_LEN+2];
+    tlsPeer(conn, peer, sizeof(peer));
+    int resumed = tls_saveSession(conn->tlsctx, conn->credcat, conn->credset, peer);
+    LOG(MOD_AIO|INFO, "[%d] TLS handshake with %s %s in %.1fms", conn->netctx.fd, peer,
+        resumed ? "resumed" : "full", (rt_getTime() - conn->tlsstart)/1e3);
+    conn->tlsstart = 0;
+}
+
+static void tlsHandshakeFailed (conn_t* conn) {
+    if( conn->tlsctx == NULL || conn->tlsstart == 0 )
+        return;
+    // Do not retry with a session that may have contributed to the failure
+    char peer[MAX_HOSTNAME_LEN+MAX_PORT_LEN+2];
+    tlsPeer(conn, peer, sizeof(peer));
+    tls_dropSession(conn->credcat, peer);
+    conn->tlsstart = 0;
+}
+
+
 static void ws_connecting (aio_t* aio);
 
 static void ws_handshaking (aio_t* aio) {
@@ -662,11 +1103,26 @@ static void ws_handshaking (aio_t* aio) {
         if( conn->tlsctx )
             err = mbedtls_ssl_handshake(conn->tlsctx);
         if( err == 0 ) {
+            if( conn->tlsctx )
+                tlsHandshakeDone(conn);
             // Ready to run websocket protocol
-            assert(conn->rbuf == NULL && conn->wbuf == NULL);
-            conn->rbuf = rt_mallocN(u1_t, conn->rbufsize);
+            assert(conn->rbuf == NULL && conn->wbuf == NULL && conn->sbuf == NULL);
+            int rbufsize = conn->rbufsize;
+            conn->rbuf = sys_allocRing(&rbufsize);
+            conn->rbufsize = rbufsize;
+            conn->rpos = conn->rbeg = conn->rend = conn->rnext = 0;
+            conn->rmsg = conn->rfrag = 0;
             conn->wbuf = rt_mallocN(u1_t, conn->wbufsize);
-
+            conn->sbuf = rt_mallocN(u1_t, WS_STAGE_SIZE);
+            conn->spos = conn->sfill = 0;
+
+            char ext[128] = { 0 };
+#if defined(CFG_wsdeflate)
+            if( WS_DEFLATE )
+                snprintf(ext, sizeof(ext),
+                         "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=%d; server_max_window_bits=%d\r\n",
+                         zsWbits(), zsWbits());
+#endif
             conn->wpos = 0;
             conn->wend = snprintf
                 ((char*)conn->wbuf, conn->wbufsize,
@@ -677,7 +1133,7 @@ static void ws_handshaking (aio_t* aio) {
                  "Sec-WebSocket-Key: %s\r\n"
                  "Sec-WebSocket-Version: 13\r\n"
                  //"Sec-WebSocket-Protocol: ...\r\n"
-                 //"Sec-WebSocket-Extensions: ...\r\n"
+                 "%s"
                  //"Origin: http://www.example.com\r\n"  // if browser request or similar
                  //and other header fields if required e.g. cookies
                  "%s\r\n",
@@ -689,6 +1145,7 @@ static void ws_handshaking (aio_t* aio) {
                  //  aPnEh0f0Q/DcX6MmuFsHYw==
                  //  OMQ7ar+ghnUHbT8lsfjziA==
                  "bpse8nVmEl6ZlX4lSb6RMw==",
+                 ext,
                  conn->authtoken ? conn->authtoken : "");
             assert(conn->wend < conn->wbufsize-1);
             conn->state = WS_CLIENT_REQ;
@@ -713,7 +1170,7 @@ static void ws_handshaking (aio_t* aio) {
 	    mbedtls_x509_crt_verify_info(errmsg, sizeof(errmsg), "", flags);
 	    LOG(MOD_AIO|INFO, "TLS server certificate verification failed: %.*s", sizeof(errmsg), errmsg)
 	}
-
+        tlsHandshakeFailed(conn);
         ws_shutdown(conn);
         return;
     }
@@ -756,12 +1213,20 @@ static void ws_connecting (aio_t* aio) {
             ws_shutdown(conn);
             return;
         }
+#if defined(CFG_wsdeflate)
+        if( !zsNegotiate(conn) ) {
+            ws_shutdown(conn);
+            return;
+        }
+#endif
         conn->wpos = conn->wend = conn->wfill = WSHDR_RESV_W;
+        conn->wsFrames = conn->wsWrites = 0;
         aio_set_rdfn(conn->aio, ws_connected_r);
         aio_set_wrfn(conn->aio, NULL);
         conn->state = WS_CONNECTED;
+        metrics.wsConnects += 1;
         conn->evcb(conn, WSEV_CONNECTED);
-        conn->rbeg = conn->rend; // signal lower level that we consumed this frame
+        conn->rbeg = conn->rnext = conn->rend; // signal lower level that we consumed this frame
         if( conn->aio )
             ws_connected_r(conn->aio);
         return;
@@ -822,6 +1287,8 @@ void ws_sendData (ws_t* conn, dbuf_t* b, int binaryData) {
     b->buf[1-WSHDR_INTRA] = n;
     b->buf[2-WSHDR_INTRA] = binaryData ? WSHDR_BINARY : WSHDR_TEXT;
     conn->wfill += n+WSHDR_INTRA;
+    metrics.wsTxMsgs += 1;
+    metrics.wsTxBytes += n;
     b->buf = NULL;
     b->pos = b->bufsize = 0;
     aio_set_wrfn(conn->aio, ws_connected_w);
@@ -854,9 +1321,11 @@ dbuf_t ws_getRecvbuf (ws_t* conn) {
             .pos = 0 };
         return b;
     }
+    int plen;
+    u1_t* p = recvFrame(conn, &plen);
     dbuf_t b = {
-        .buf = (char*)(conn->rbuf + conn->rbeg),
-        .bufsize = conn->rend - conn->rbeg,
+        .buf = (char*)p,
+        .bufsize = plen,
         .pos = 0 };
     return b;
 }
@@ -869,15 +1338,21 @@ void ws_ini (ws_t* conn, int rbufsize, int wbufsize) {
     conn->state = WS_CLOSED;
     conn->evcb = conn_evcb_nil;
     conn->rbufsize = rbufsize;
+    conn->rbufmax  = rbufsize;
     conn->wbufsize = wbufsize;
 }
 
 
 void ws_free (ws_t* conn) {
-    rt_free(conn->rbuf);
+    sys_freeRing(conn->rbuf, conn->rbufsize);
     rt_free(conn->wbuf);
+    rt_free(conn->sbuf);
+#if defined(CFG_wsdeflate)
+    zsFree(conn);
+#endif
     conn->rbuf = NULL;
     conn->wbuf = NULL;
+    conn->sbuf = NULL;
     rt_free(conn->host);
     rt_free(conn->port);
     rt_free(conn->uripath);
@@ -914,12 +1389,13 @@ int ws_connect (ws_t* conn, char* host, char* port, char* uripath) {
         return 0;
     }
     sys_keepAlive(conn->netctx.fd);
-    if( conn->tlsctx )
-        mbedtls_ssl_set_bio(conn->tlsctx, &conn->netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
-
     conn->host = rt_strdup(host);
     conn->port = rt_strdup(port);
     conn->uripath = rt_strdup(uripath);
+    if( conn->tlsctx ) {
+        mbedtls_ssl_set_bio(conn->tlsctx, &conn->netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
+        tlsResume(conn);
+    }
     conn->aio = aio_open(conn, conn->netctx.fd, NULL, NULL);
     conn->state = WS_TLS_HANDSHAKE;
     ws_handshaking(conn->aio);
@@ -1011,12 +1487,16 @@ static void http_write (aio_t* aio) {
     assert(conn->c.state == HTTP_SENDING_REQ);
     int e = writeData(&conn->c);
     if( e == IO_ERROR ) {
+        tlsHandshakeFailed(&conn->c);
         http_close(conn);
         return;
     }
     if( e == IO_WRPEND )
         return;
     assert(e==IO_WRDONE);
+    // Handshake is implicit in the first TLS write - done if request is out
+    if( conn->c.tlsctx )
+        tlsHandshakeDone(&conn->c);
     conn->c.rpos = conn->c.rbeg = conn->c.wfill;
     conn->c.state = HTTP_READING_HDR;
     conn->c.creason = 0;
@@ -1036,6 +1516,7 @@ void http_ini (http_t* conn, int bufsize) {
     conn->c.rbufsize = bufsize;
     conn->c.wbufsize = bufsize;
     conn->c.rbuf = conn->c.wbuf = rt_mallocN(u1_t,bufsize);
+    conn->resp.fd = -1;
 }
 
 
@@ -1058,6 +1539,10 @@ static void _http_close (http_t* conn, tmrcb_t trigCloseEv) {
     aio_close(conn->c.aio);
     rt_free((void*)conn->c.authtoken);
     conn->c.authtoken = NULL;
+    rt_free(conn->c.host);
+    rt_free(conn->c.port);
+    conn->c.host = NULL;
+    conn->c.port = NULL;
     conn->c.rpos = conn->c.rbeg = conn->c.rend = 0;
     conn->c.wfill = conn->c.wpos = conn->c.wend = 0;
     conn->c.aio = NULL;
@@ -1090,8 +1575,12 @@ int http_connect (http_t* conn, char* host, char* port) {
         return 0;
     }
     sys_keepAlive(conn->c.netctx.fd);
-    if( conn->c.tlsctx )
+    conn->c.host = rt_strdup(host);
+    conn->c.port = rt_strdup(port);
+    if( conn->c.tlsctx ) {
         mbedtls_ssl_set_bio(conn->c.tlsctx, &conn->c.netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
+        tlsResume(&conn->c);
+    }
 
     conn->c.aio = aio_open(conn, conn->c.netctx.fd, NULL, NULL);
     // NOTE: the first wfill bytes are reserved for host:port
@@ -1198,17 +1687,73 @@ void http_request (http_t* conn, dbuf_t* req) {
 
 
 
+static void httpdIdle (tmr_t* tmr) {
+    httpd_t* conn = tmr2httpd(tmr);
+    LOG(MOD_AIO|DEBUG, "[%d] HTTPD connection idle - closing", conn->c.netctx.fd);
+    httpd_close(conn);
+}
+
+
+static void httpdWaitRequest (httpd_t* conn) {
+    conn->c.rpos = conn->c.rbeg = conn->c.rend = 0;
+    conn->c.wfill = conn->c.wpos = conn->c.wend = 0;
+    conn->extra.coff = conn->extra.clen = -1;
+    conn->resp.keepalive = 0;
+    conn->c.state = HTTPD_READING_HDR;
+    httpd_t* listener = (httpd_t*)conn->c.opctx;
+    rt_setTimerCb(&conn->c.tmr, rt_micros_ahead(listener->listen.idletime), httpdIdle);
+}
+
+
+static void httpdCloseFile (httpd_t* conn) {
+    if( conn->resp.fd >= 0 )
+        fs_close(conn->resp.fd);
+    rt_free(conn->resp.body);
+    conn->resp.fd = -1;
+    conn->resp.body = NULL;
+    conn->resp.fleft = 0;
+}
+
+
 static void httpd_write (aio_t* aio) {
     httpd_t* conn = (httpd_t*)aio->ctx;
     assert(conn->c.state == HTTPD_SENDING_RESP);
-    int e = writeData(&conn->c);
-    if( e == IO_ERROR ) {
-        httpd_close(conn);
+    while(1) {
+        int e = writeData(&conn->c);
+        if( e == IO_ERROR ) {
+            httpd_close(conn);
+            return;
+        }
+        if( e == IO_WRPEND )
+            return;
+        assert(e==IO_WRDONE);
+        if( conn->resp.fleft <= 0 )
+            break;
+        // Stream next chunk of file/body through the write buffer - request is no longer needed
+        int n = min(conn->resp.fleft, conn->c.wbufsize);
+        if( conn->resp.body ) {
+            memcpy(conn->c.wbuf, conn->resp.body + conn->resp.boff, n);
+            conn->resp.boff += n;
+        } else {
+            n = fs_read(conn->resp.fd, conn->c.wbuf, n);
+        }
+        if( n <= 0 ) {
+            // Content-Length already sent - can only abort
+            LOG(MOD_AIO|ERROR, "[%d] Failed to read file being sent: %d bytes missing", conn->c.netctx.fd, conn->resp.fleft);
+            httpd_close(conn);
+            return;
+        }
+        conn->resp.fleft -= n;
+        conn->c.wpos = 0;
+        conn->c.wend = n;
+    }
+    httpdCloseFile(conn);
+    if( conn->resp.keepalive ) {
+        httpdWaitRequest(conn);
+        aio_set_wrfn(aio, NULL);
+        aio_set_rdfn(aio, http_read);
         return;
     }
-    if( e == IO_WRPEND )
-        return;
-    assert(e==IO_WRDONE);
     conn->c.wpos = conn->c.wend = conn->c.wfill;
     conn->c.state = HTTPD_CLOSED;
     httpd_close(conn);
@@ -1216,35 +1761,45 @@ static void httpd_write (aio_t* aio) {
 
 
 static void httpd_accept (aio_t* aio) {
-    httpd_t* conn = (httpd_t*)aio->ctx;
+    httpd_t* listener = (httpd_t*)aio->ctx;
     netctx_t client_netctx;
     int ret;
     mbedtls_net_init(&client_netctx);
-    if( (ret = mbedtls_net_accept( &conn->listen.netctx, &client_netctx, NULL, 0, NULL) ) != 0 ) {
-        log_mbedError(MOD_AIO|ERROR, ret, "[%d->%d] Accept failed", conn->listen.netctx.fd, client_netctx.fd);
+    if( (ret = mbedtls_net_accept( &listener->listen.netctx, &client_netctx, NULL, 0, NULL) ) != 0 ) {
+        log_mbedError(MOD_AIO|ERROR, ret, "[%d->%d] Accept failed", listener->listen.netctx.fd, client_netctx.fd);
         return;
     }
-    
-    if( conn->c.aio != NULL ) {
-        LOG(MOD_AIO|WARNING, "[%d->%d] Dropping new connection - busy with [%d]!",
-            conn->listen.netctx.fd, client_netctx.fd, conn->c.netctx.fd);
+    httpd_t* conn = NULL;
+    for( int i=0; i < listener->listen.nclients; i++ ) {
+        if( listener->listen.clients[i].c.aio == NULL ) {
+            conn = &listener->listen.clients[i];
+            break;
+        }
+    }
+    if( conn == NULL ) {
+        LOG(MOD_AIO|WARNING, "[%d->%d] Dropping new connection - all %d connections busy!",
+            listener->listen.netctx.fd, client_netctx.fd, listener->listen.nclients);
         mbedtls_net_free(&client_netctx);
         return;
     }
     assert(conn->c.state == HTTPD_CLOSED);
+    if( (ret = mbedtls_net_set_nonblock(&client_netctx)) != 0 ) {
+        log_mbedError(MOD_AIO|ERROR, ret, "[%d] Non blocking failed", client_netctx.fd);
+        mbedtls_net_free(&client_netctx);
+        return;
+    }
     conn->c.netctx = client_netctx;
-    conn->c.rpos = conn->c.rbeg = conn->c.rend = 0;
-    conn->c.wfill = conn->c.wpos = conn->c.wend = 0;
-    conn->extra.coff = conn->extra.clen = -1;
-    conn->c.state = HTTPD_READING_HDR;
+    conn->c.evcb = listener->c.evcb;
+    httpdWaitRequest(conn);
     conn->c.aio = aio_open(conn, conn->c.netctx.fd, http_read, NULL);
-    LOG(MOD_AIO|DEBUG, "[%d->%d] Connection accepted...", conn->listen.netctx.fd, conn->c.netctx.fd);
+    LOG(MOD_AIO|DEBUG, "[%d->%d] Connection accepted...", listener->listen.netctx.fd, conn->c.netctx.fd);
 }
 
 
 void httpd_response (httpd_t* conn, dbuf_t* req) {
     int wfill = conn->c.wfill;
     assert(req->pos > 0 && (u1_t*)req->buf == &conn->c.wbuf[wfill]);
+    rt_clrTimer(&conn->c.tmr);  // request is in - no longer idle
     conn->c.rpos = conn->c.rbeg = conn->c.rend =
         conn->c.wpos = wfill;
     conn->c.wend = req->pos + wfill;
@@ -1254,6 +1809,24 @@ void httpd_response (httpd_t* conn, dbuf_t* req) {
 }
 
 
+void httpd_sendFile (httpd_t* conn, dbuf_t* hdr, int fd, int size) {
+    httpdCloseFile(conn);
+    conn->resp.fd = fd;
+    conn->resp.fleft = size;
+    httpd_response(conn, hdr);
+}
+
+
+void httpd_sendBody (httpd_t* conn, dbuf_t* hdr, dbuf_t* body) {
+    httpdCloseFile(conn);
+    conn->resp.body = body->buf;
+    conn->resp.boff = 0;
+    conn->resp.fleft = body->pos;
+    body->buf = NULL;
+    httpd_response(conn, hdr);
+}
+
+
 dbuf_t httpd_getRespbuf (httpd_t* conn) {
     return http_getReqbuf(conn);
 }
@@ -1277,7 +1850,7 @@ void httpd_free (httpd_t* conn) {
 }
 
 
-int httpd_listen (httpd_t* conn, const char* port) {
+int httpd_listen (httpd_t* conn, const char* port, int nclients, ustime_t idletime) {
     if( conn->listen.aio != NULL ||    // forgot to httpd_stop?
         conn->c.tlsctx != NULL )    // TLS not supported for HTTPD
         return 0;
@@ -1292,10 +1865,18 @@ int httpd_listen (httpd_t* conn, const char* port) {
         log_mbedError(MOD_AIO|ERROR, ret, "[%d] Non blocking failed", conn->listen.netctx.fd);
         goto fail;
     }
+    // Client connections share the listener's buffer size
+    conn->listen.nclients = max(1, nclients);
+    conn->listen.idletime = idletime;
+    conn->listen.clients = rt_mallocN(httpd_t, conn->listen.nclients);
+    for( int i=0; i < conn->listen.nclients; i++ ) {
+        httpd_ini(&conn->listen.clients[i], conn->c.rbufsize);
+        conn->listen.clients[i].c.opctx = conn;
+    }
     conn->listen.aio = aio_open(conn, conn->listen.netctx.fd, httpd_accept, NULL);
     conn->c.wfill = conn->c.rbeg = conn->c.rend = 0;  // getHdr/Body return empty buffers
     conn->c.state = HTTPD_CLOSED;
-    LOG(MOD_AIO|DEBUG, "[%d] Connection listening...", conn->listen.netctx.fd);
+    LOG(MOD_AIO|DEBUG, "[%d] Connection listening (max %d clients)...", conn->listen.netctx.fd, conn->listen.nclients);
     return 1;
 }
 
@@ -1303,6 +1884,15 @@ void httpd_stop (httpd_t* conn) {
     aio_close(conn->listen.aio);
     conn->listen.aio = NULL;
     mbedtls_net_free(&conn->listen.netctx);
+    for( int i=0; i < conn->listen.nclients; i++ ) {
+        httpd_t* client = &conn->listen.clients[i];
+        client->c.evcb = conn_evcb_nil;  // no close event - client is going away
+        httpd_close(client);
+        httpd_free(client);
+    }
+    rt_free(conn->listen.clients);
+    conn->listen.clients = NULL;
+    conn->listen.nclients = 0;
     httpd_close(conn);
 }
 
@@ -1314,6 +1904,7 @@ static void triggerHttpdClosedEv(tmr_t* tmr) {
 
 
 void httpd_close (httpd_t* conn) {
+    httpdCloseFile(conn);
     _http_close(conn, triggerHttpdClosedEv);
 }
 
@@ -1506,6 +2097,8 @@ int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* server
     assert(conn->tlsconf==NULL && conn->tlsctx==NULL);
     conn->tlsconf = tlsconf;
     conn->tlsctx = tls_makeSession(tlsconf, servername);
+    conn->credcat = cred_cat;
+    conn->credset = cred_set;
     return 1;
  errexit:
     LOG(MOD_AIO|ERROR, errmsg, sys_credcat2str(cred_cat), sys_credset2str(cred_set));
@@ -40,18 +40,29 @@ typedef mbedtls_net_context netctx_t;
 typedef struct conn {
     aio_t*   aio;
     tmr_t    tmr;
-    // Read side
+    // Read side - for WS a double mapped ring (see sys_allocRing), offsets may exceed rbufsize
     u1_t*    rbuf;
     doff_t   rbufsize;
+    doff_t   rbufmax;  // WS ring may grow up to this size to hold a large message
     doff_t   rpos;     // socket fills in data here
     doff_t   rbeg;     // oldest frame in recv buffer, rbeg[-1] is OPCODE
-    doff_t   rend;     // end of frame, after that starts a WS header
+    doff_t   rend;     // end of frame
+    doff_t   rnext;    // next WS header
+    doff_t   rmsg;     // start of fragmented WS message being reassembled (0=none)
+    doff_t   rfrag;    // end of reassembled fragment data
+    u1_t     ropcode;  // opcode of fragmented WS message
+    struct wsdeflate* zs;  // permessage-deflate state if negotiated (CFG_wsdeflate)
     // Write side
     u1_t*    wbuf;
     doff_t   wbufsize;
     doff_t   wpos;     // socket reads data from here and sends it
     doff_t   wend;     // end of WS frame, after that 2 bytes frame length + frame data
     doff_t   wfill;    // local producers fill in data here
+    u1_t*    sbuf;     // WS frames coalesced into wire format (masked) - sent as one write
+    doff_t   spos;     // socket reads staged data from here and sends it
+    doff_t   sfill;    // end of staged data
+    u4_t     wsFrames; // debug counters: frames staged and writes needed to send them
+    u4_t     wsWrites;
 
     u1_t     state;
     s1_t     optemp;   // some temp value related to opctx
@@ -61,6 +72,9 @@ typedef struct conn {
     netctx_t   netctx;
     tlsctx_p   tlsctx;
     tlsconf_t* tlsconf;   // or NULL if shared and stored someplace else
+    s1_t       credcat;   // credentials used for TLS - key into TLS session cache
+    s1_t       credset;
+    ustime_t   tlsstart;  // start of TLS handshake - 0 when done
     str_t      authtoken;
 
     void*      opctx;     // context managing this connection
@@ -0,0 +1,79 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "quantile.h"
+
+
+static int bin (s4_t x) {
+    return x >= WQ_RANGE ? WQ_RANGE-1 : x;
+}
+
+
+void wq_ini (wquant_t* w) {
+    memset(w, 0, sizeof(*w));
+}
+
+
+void wq_reset (wquant_t* w) {
+    // Only bins between min and max can be set
+    if( w->cnt )
+        memset(&w->bins[bin(w->min)], 0, (bin(w->max) - bin(w->min) + 1) * sizeof(w->bins[0]));
+    w->cnt = 0;
+    w->min = w->max = 0;
+}
+
+
+int wq_add (wquant_t* w, s4_t x) {
+    assert(w->cnt < WQ_MAX_SAMPLES);
+    x = max(0, x);
+    if( w->cnt == 0 || x < w->min ) w->min = x;
+    if( w->cnt == 0 || x > w->max ) w->max = x;
+    w->bins[bin(x)] += 1;
+    return ++w->cnt;
+}
+
+
+// Same rank selection as indexing a sorted window: v[(percent*n+50)/100]
+s4_t wq_quantile (const wquant_t* w, int percent) {
+    if( w->cnt == 0 )
+        return 0;
+    u4_t rank = min((percent * w->cnt + 50) / 100, w->cnt-1);
+    int b = bin(w->min);
+    for( u4_t n = w->bins[b]; n <= rank; n += w->bins[++b] );
+    return b == WQ_RANGE-1 ? w->max : b;
+}
+
+
+s4_t wq_min (const wquant_t* w) {
+    return w->min;
+}
+
+
+s4_t wq_max (const wquant_t* w) {
+    return w->max;
+}
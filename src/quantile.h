@@ -0,0 +1,54 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _quantile_h_
+#define _quantile_h_
+
+#include "rt.h"
+
+// Exact quantiles over windows of non-negative samples (timesync statistics) - negative ones count as 0.
+// Samples are counted in unit bins over [0,WQ_RANGE) - adding one is O(1) no matter
+// how large the window grows. A quantile falling beyond WQ_RANGE-1 is reported as the
+// window maximum (an upper bound). Min and max are always exact.
+enum { WQ_RANGE = 1024 };
+enum { WQ_MAX_SAMPLES = 0xFFFF };   // bins are u2_t
+
+typedef struct wquant {
+    u4_t cnt;              // number of samples
+    s4_t min, max;
+    u2_t bins[WQ_RANGE];   // bins[WQ_RANGE-1] also counts all larger samples
+} wquant_t;
+
+void wq_ini      (wquant_t* w);           // a zeroed wquant_t is also initialized
+void wq_reset    (wquant_t* w);           // start a new window
+int  wq_add      (wquant_t* w, s4_t x);   // returns number of samples in window
+s4_t wq_quantile (const wquant_t* w, int percent);
+s4_t wq_min      (const wquant_t* w);
+s4_t wq_max      (const wquant_t* w);
+
+#endif // _quantile_h_
@@ -37,113 +37,276 @@
 #define SX130X_RFF_NB 2
 #define SX130X_IF_NB 10
 
-int ral_challoc (chdefl_t* upchs, challoc_cb alloc_cb, void* ctx) {
-    u4_t rfe_spans[MAX_130X*SX130X_RFF_NB*2] = {0};
-    for( int chip=0; chip<MAX_130X; chip++ )
-        rfe_spans[2*SX130X_RFF_NB*chip] = rfe_spans[2*SX130X_RFF_NB*chip+2] = INT_MAX;
+// --------------------------------------------------------------------------------
+//
+// Channel allocation
+//
+// Place the uplink channels onto as few SX130X chips as possible. Each chip has
+// 8 multi-SF 125kHz modems, one fast LoRa modem (250/500kHz) and one FSK modem
+// and two RF frontends. All 125kHz/FSK channels of a frontend must be within
+// SX130X_RFE_MAXCOFF_125 of its center frequency and a fast LoRa channel within
+// SX130X_RFE_MAXCOFF_250/500.
+//
+// Depth first branch and bound over the channels (125kHz ascending in frequency,
+// then FSK, then fast LoRa). The first descent behaves like a greedy fill.
+// Objective is lexicographic: fewest channels left out, then fewest chips.
+// If a plan does not fit into MAX_130X chips the channels that cannot be placed are
+// dropped. The search stops at a solution meeting the lower bound or after
+// CHALLOC_MAX_NODES nodes with the best solution found so far.
+//
+// --------------------------------------------------------------------------------
 
-    uint modem_idx = 0;
-    uint chip_idx = 0;
-    uint multi_chslot = 0;
-    uint fsk_chslot = 0;
-    uint fl_chslot = 0;
+enum { CA_125, CA_FSK, CA_FL };
+enum { CA_CHAINS = MAX_130X*SX130X_RFF_NB };
+enum { CHALLOC_MAX_NODES = 200000 };
 
-    alloc_cb(ctx, NULL, CHALLOC_START);
+typedef struct {
+    u4_t lo, hi;    // range of 125kHz/FSK channels - lo > hi if there are none
+    u1_t used;      // any channel incl. fast LoRa
+} cachain_t;
 
-    while( chip_idx < MAX_130X && (multi_chslot < MAX_UPCHNLS || fsk_chslot < MAX_UPCHNLS || fl_chslot < MAX_UPCHNLS) ) {
-    alloc_cb(ctx, &(challoc_t) {.chip = chip_idx}, CHALLOC_CHIP_START);
+typedef struct {
+    chdefl_t* upchs;
+    int       nitems;
+    u1_t      slot[MAX_UPCHNLS];          // index into upchs in search order
+    u1_t      kind[MAX_UPCHNLS];
+    u1_t      rem[MAX_UPCHNLS+1][3];      // remaining channels per kind from item k on
+    // Current partial assignment
+    cachain_t chains[CA_CHAINS];
+    u1_t      n125[MAX_130X];
+    u1_t      nfsk[MAX_130X];
+    u1_t      nfl[MAX_130X];
+    s1_t      assign[MAX_UPCHNLS];        // chain index per item, -1 if left out
+    int       chips;
+    int       skipped;
+    // Best solution
+    s1_t      best[MAX_UPCHNLS];
+    int       bestChips;
+    int       bestSkipped;
+    int       minChips;                   // lower bounds of whole search
+    int       minSkipped;
+    u4_t      nodes;
+    int       optimal;                    // best solution meets lower bounds - stop searching
+} casearch_t;
 
-    // Allocate 125kHz channels
-    modem_idx = 0;
-    while( multi_chslot < MAX_UPCHNLS && modem_idx < SX130X_IF_NB-2 ) {
-        if( !upchs->freq[multi_chslot] || upchs->rps[multi_chslot].maxSF == FSK || upchs->rps[multi_chslot].bw != BW125 ) {
-            multi_chslot++;
-            continue;
-        }
-        u4_t ch_freq = upchs->freq[multi_chslot];
-        for( int rfe_idx=0; rfe_idx<SX130X_RFF_NB; rfe_idx++ ) {
-            u4_t* rfe_span = &rfe_spans[2*rfe_idx+4*chip_idx];
-            if( rfe_span[1] == 0 || (ch_freq - rfe_span[0])/2 <= SX130X_RFE_MAXCOFF_125 ) {
-                rfe_span[0] = min(ch_freq, rfe_span[0]);
-                rfe_span[1] = max(ch_freq, rfe_span[1]);
-                alloc_cb(ctx, &(challoc_t) {
-                    .chip = chip_idx, .chan = modem_idx++, .rff = rfe_idx,
-                    .rff_freq = (rfe_span[0]+rfe_span[1])/2,
-                    .chdef = {.freq = ch_freq, .rps = upchs->rps[multi_chslot]}
-                }, CHALLOC_CH);
-                ch_freq = 0; multi_chslot++; // Channel allocated, move on to next slot
-                break;
-            }
+
+static int ca_maxcoff (struct chrps rps) {
+    return rps.bw == BW250 ? SX130X_RFE_MAXCOFF_250 : SX130X_RFE_MAXCOFF_500;
+}
+
+static int ca_fits (cachain_t* c, int kind, u4_t freq, struct chrps rps) {
+    if( c->lo > c->hi )
+        return 1;  // no 125kHz/FSK channels constrain this frontend
+    if( kind != CA_FL )
+        return max(c->hi, freq) - min(c->lo, freq) <= 2*SX130X_RFE_MAXCOFF_125;
+    int maxcoff = ca_maxcoff(rps);
+    u4_t cmin = c->hi - SX130X_RFE_MAXCOFF_125;
+    u4_t cmax = c->lo + SX130X_RFE_MAXCOFF_125;
+    return freq + maxcoff >= cmin && freq <= cmax + maxcoff;
+}
+
+static int ca_chipRoom (casearch_t* S, int chip, int kind) {
+    return kind == CA_125 ? S->n125[chip] < SX130X_IF_NB-2 : kind == CA_FSK ? !S->nfsk[chip] : !S->nfl[chip];
+}
+
+// Lower bounds for channels left out and chips used given items k.. are still open
+static void ca_bounds (casearch_t* S, int k, int* lbSkipped, int* lbChips) {
+    int free[3] = { 0, 0, 0 };
+    for( int chip=0; chip < S->chips; chip++ ) {
+        free[CA_125] += SX130X_IF_NB-2 - S->n125[chip];
+        free[CA_FSK] += !S->nfsk[chip];
+        free[CA_FL]  += !S->nfl[chip];
+    }
+    int newChips = MAX_130X - S->chips;
+    int need125 = max(0, S->rem[k][CA_125] - free[CA_125]);
+    int needFsk = max(0, S->rem[k][CA_FSK] - free[CA_FSK]);
+    int needFl  = max(0, S->rem[k][CA_FL]  - free[CA_FL]);
+    *lbSkipped = S->skipped
+        + max(0, need125 - (SX130X_IF_NB-2)*newChips)
+        + max(0, needFsk - newChips)
+        + max(0, needFl  - newChips);
+    int n = max((need125 + SX130X_IF_NB-3) / (SX130X_IF_NB-2), max(needFsk, needFl));
+    *lbChips = S->chips + min(n, newChips);
+}
+
+static void ca_place (casearch_t* S, int k, int ci);
+
+static void ca_search (casearch_t* S, int k) {
+    if( S->optimal || S->nodes >= CHALLOC_MAX_NODES )
+        return;
+    S->nodes += 1;
+    if( k == S->nitems ) {
+        if( S->skipped < S->bestSkipped || (S->skipped == S->bestSkipped && S->chips < S->bestChips) ) {
+            S->bestSkipped = S->skipped;
+            S->bestChips = S->chips;
+            memcpy(S->best, S->assign, S->nitems);
+            if( S->bestSkipped == S->minSkipped && S->bestChips == S->minChips )
+                S->optimal = 1;  // cannot do better - stop
         }
-        if( ch_freq ) break;
+        return;
     }
+    int lbSkipped, lbChips;
+    ca_bounds(S, k, &lbSkipped, &lbChips);
+    if( lbSkipped > S->bestSkipped || (lbSkipped == S->bestSkipped && lbChips >= S->bestChips) )
+        return;
+    int kind = S->kind[k];
+    u4_t freq = S->upchs->freq[S->slot[k]];
+    struct chrps rps = S->upchs->rps[S->slot[k]];
+    // Frontends already in use
+    for( int ci=0; ci < 2*S->chips; ci++ ) {
+        if( S->chains[ci].used && ca_chipRoom(S, ci/2, kind) && ca_fits(&S->chains[ci], kind, freq, rps) )
+            ca_place(S, k, ci);
+    }
+    // Open second frontend of a chip in use (first one is always in use)
+    for( int chip=0; chip < S->chips; chip++ ) {
+        if( !S->chains[2*chip+1].used && ca_chipRoom(S, chip, kind) )
+            ca_place(S, k, 2*chip+1);
+    }
+    // Add a chip
+    if( S->chips < MAX_130X )
+        ca_place(S, k, 2*S->chips);
+    // Leave channel out
+    S->assign[k] = -1;
+    S->skipped += 1;
+    ca_search(S, k+1);
+    S->skipped -= 1;
+}
 
-    // FSK
-    while( fsk_chslot < MAX_UPCHNLS ) {
-        if( !upchs->freq[fsk_chslot] || upchs->rps[fsk_chslot].maxSF != FSK ) {
-            fsk_chslot++;
-            continue;
+static void ca_place (casearch_t* S, int k, int ci) {
+    int chip = ci/2;
+    int kind = S->kind[k];
+    u4_t freq = S->upchs->freq[S->slot[k]];
+    cachain_t saved = S->chains[ci];
+    cachain_t* c = &S->chains[ci];
+    int newChip = chip == S->chips;
+    if( kind != CA_FL ) {
+        c->lo = min(c->lo, freq);
+        c->hi = max(c->hi, freq);
+    }
+    c->used = 1;
+    if( newChip )
+        S->chips += 1;
+    u1_t* cnt = kind == CA_125 ? &S->n125[chip] : kind == CA_FSK ? &S->nfsk[chip] : &S->nfl[chip];
+    *cnt += 1;
+    S->assign[k] = ci;
+    ca_search(S, k+1);
+    *cnt -= 1;
+    if( newChip )
+        S->chips -= 1;
+    *c = saved;
+}
+
+
+// Center frequency of a frontend - midpoint of 125kHz/FSK channels but
+// if a fast LoRa channel is present midpoint of the range acceptable to both.
+static u4_t ca_center (cachain_t* c, int flslot, chdefl_t* upchs) {
+    if( flslot < 0 )
+        return (c->lo + c->hi) / 2;
+    u4_t fl = upchs->freq[flslot];
+    if( c->lo > c->hi )
+        return fl;
+    int maxcoff = ca_maxcoff(upchs->rps[flslot]);
+    u4_t cmin = c->hi - SX130X_RFE_MAXCOFF_125;
+    u4_t cmax = c->lo + SX130X_RFE_MAXCOFF_125;
+    return (max(cmin, fl-maxcoff) + min(cmax, fl+maxcoff)) / 2;
+}
+
+
+int ral_challoc (chdefl_t* upchs, challoc_cb alloc_cb, void* ctx) {
+    static casearch_t S;   // too big for the stack of some platforms
+    memset(&S, 0, sizeof(S));
+    S.upchs = upchs;
+    for( int kind=CA_125; kind <= CA_FL; kind++ ) {
+        for( int chslot=0; chslot < MAX_UPCHNLS; chslot++ ) {
+            if( !upchs->freq[chslot] )
+                continue;
+            struct chrps rps = upchs->rps[chslot];
+            int k = rps.maxSF == FSK ? CA_FSK : rps.bw == BW125 ? CA_125 : rps.bw == BW250 || rps.bw == BW500 ? CA_FL : -1;
+            if( k != kind )
+                continue;
+            S.slot[S.nitems] = chslot;
+            S.kind[S.nitems] = kind;
+            S.nitems += 1;
         }
-        if( chip_idx >= MAX_130X ) break; // Too many chips
-        u4_t ch_freq = upchs->freq[fsk_chslot];
-        for( int rfe_idx=0; rfe_idx<SX130X_RFF_NB; rfe_idx++ ) {
-            u4_t* rfe_span = &rfe_spans[2*rfe_idx+4*chip_idx];
-            if( rfe_span[1] == 0 || (ch_freq >= rfe_span[1] - 2*SX130X_RFE_MAXCOFF_125 &&
-                                     ch_freq <= rfe_span[0] + 2*SX130X_RFE_MAXCOFF_125) ) {
-                rfe_span[0] = min(ch_freq, rfe_span[0]);
-                rfe_span[1] = max(ch_freq, rfe_span[1]);
-                alloc_cb(ctx, &(challoc_t) {
-                    .chip = chip_idx, .chan = SX130X_IF_NB-1, .rff = rfe_idx,
-                    .rff_freq = (rfe_span[0]+rfe_span[1])/2,
-                    .chdef = {.freq = ch_freq, .rps = upchs->rps[fsk_chslot]}
-                }, CHALLOC_CH);
-                fsk_chslot++;
-                modem_idx++;
-                break;
-            }
+    }
+    // Sort 125kHz channels by frequency - frontend windows then extend only upwards
+    for( int i=1; i < S.nitems && S.kind[i] == CA_125; i++ ) {
+        for( int j=i; j > 0 && upchs->freq[S.slot[j-1]] > upchs->freq[S.slot[j]]; j-- ) {
+            u1_t t = S.slot[j]; S.slot[j] = S.slot[j-1]; S.slot[j-1] = t;
         }
-        break;
+    }
+    for( int k=S.nitems-1; k >= 0; k-- ) {
+        memcpy(S.rem[k], S.rem[k+1], 3);
+        S.rem[k][S.kind[k]] += 1;
+    }
+    for( int ci=0; ci < CA_CHAINS; ci++ ) {
+        S.chains[ci].lo = UINT32_MAX;
+        S.chains[ci].hi = 0;
+    }
+    ca_bounds(&S, 0, &S.minSkipped, &S.minChips);
+    S.bestSkipped = S.nitems + 1;
+    S.bestChips = MAX_130X + 1;
+    ca_search(&S, 0);
+    if( S.bestSkipped > S.nitems ) {
+        S.bestSkipped = S.nitems;  // search budget exhausted before first leaf - never happens
+        S.bestChips = 0;
+        memset(S.best, -1, sizeof(S.best));
+    }
+    LOG(MOD_RAL|DEBUG, "Channel allocation: %d channels on %d chips (%d left out, %u search steps)",
+        S.nitems - S.bestSkipped, S.bestChips, S.bestSkipped, S.nodes);
+    for( int k=0; k < S.nitems; k++ ) {
+        if( S.best[k] < 0 )
+            LOG(MOD_RAL|WARNING, "Channel %F (%s) does not fit into %d chips - not used",
+                upchs->freq[S.slot[k]], S.kind[k] == CA_125 ? "125kHz" : S.kind[k] == CA_FSK ? "FSK" : "fast LoRa", MAX_130X);
     }
 
-    // Fast LoRa
-    while( fl_chslot < MAX_UPCHNLS ) {
-        if( !upchs->freq[fl_chslot] || (upchs->rps[fl_chslot].bw != BW250 && upchs->rps[fl_chslot].bw != BW500) ) {
-            fl_chslot++;
-            continue;
+    alloc_cb(ctx, NULL, CHALLOC_START);
+    for( int chip=0; chip < S.bestChips; chip++ ) {
+        alloc_cb(ctx, &(challoc_t) {.chip = chip}, CHALLOC_CHIP_START);
+        cachain_t chains[SX130X_RFF_NB];
+        int flslot[SX130X_RFF_NB];
+        u4_t minFreq = UINT32_MAX, maxFreq = 0;
+        for( int r=0; r < SX130X_RFF_NB; r++ ) {
+            chains[r] = (cachain_t) { .lo = UINT32_MAX, .hi = 0 };
+            flslot[r] = -1;
         }
-        if( chip_idx >= MAX_130X ) break; // Too many chips
-        u4_t ch_freq = upchs->freq[fl_chslot];
-        int maxcoff = upchs->rps[fl_chslot].bw == BW250 ? SX130X_RFE_MAXCOFF_250 : SX130X_RFE_MAXCOFF_500;
-        for( int rfe_idx=0; rfe_idx<SX130X_RFF_NB; rfe_idx++ ) {
-            u4_t* rfe_span = &rfe_spans[2*rfe_idx+4*chip_idx];
-            u4_t cmin = rfe_span[1] - SX130X_RFE_MAXCOFF_125;
-            u4_t cmax = rfe_span[0] + SX130X_RFE_MAXCOFF_125;
-            if( rfe_span[1] == 0 || (ch_freq >= cmin - maxcoff && ch_freq <= cmax + maxcoff) ) {
-                rfe_span[0] = min(ch_freq, rfe_span[0]);
-                rfe_span[1] = max(ch_freq, rfe_span[1]);
+        for( int k=0; k < S.nitems; k++ ) {
+            if( S.best[k] < 0 || S.best[k]/SX130X_RFF_NB != chip )
+                continue;
+            cachain_t* c = &chains[S.best[k] % SX130X_RFF_NB];
+            u4_t freq = upchs->freq[S.slot[k]];
+            if( S.kind[k] == CA_FL ) {
+                flslot[S.best[k] % SX130X_RFF_NB] = S.slot[k];
+            } else {
+                c->lo = min(c->lo, freq);
+                c->hi = max(c->hi, freq);
+            }
+            minFreq = min(minFreq, freq);
+            maxFreq = max(maxFreq, freq);
+        }
+        int modem_idx = 0;
+        for( int kind=CA_125; kind <= CA_FL; kind++ ) {
+            for( int k=0; k < S.nitems; k++ ) {
+                if( S.kind[k] != kind || S.best[k] < 0 || S.best[k]/SX130X_RFF_NB != chip )
+                    continue;
+                int rff = S.best[k] % SX130X_RFF_NB;
                 alloc_cb(ctx, &(challoc_t) {
-                    .chip = chip_idx, .chan = SX130X_IF_NB-2, .rff = rfe_idx,
-                    .rff_freq = (max(cmin, ch_freq-maxcoff)+min(cmax, ch_freq+maxcoff))/2,
-                    .chdef = { .freq = ch_freq, .rps = upchs->rps[fl_chslot]}
+                    .chip = chip,
+                    .chan = kind == CA_125 ? modem_idx : kind == CA_FSK ? SX130X_IF_NB-1 : SX130X_IF_NB-2,
+                    .rff = rff,
+                    .rff_freq = ca_center(&chains[rff], flslot[rff], upchs),
+                    .chdef = { .freq = upchs->freq[S.slot[k]], .rps = upchs->rps[S.slot[k]] }
                 }, CHALLOC_CH);
-                fl_chslot++;
                 modem_idx++;
-                break;
             }
         }
-        break;
+        alloc_cb(ctx, &(challoc_t) {
+            .chipid = chip,
+            .chans  = modem_idx,
+            .minFreq= modem_idx ? minFreq : 0,
+            .maxFreq= modem_idx ? maxFreq : 0,
+            }, CHALLOC_CHIP_DONE);
     }
-
-    alloc_cb(ctx, &(challoc_t) {
-        .chipid = chip_idx,
-        .chans  = modem_idx,
-        .minFreq= modem_idx ? rfe_spans[4*chip_idx] : 0,
-        .maxFreq= modem_idx ? max(rfe_spans[4*chip_idx+3],rfe_spans[4*chip_idx+1]) : 0,
-        }, CHALLOC_CHIP_DONE);
-    chip_idx++;
-    }
-
-    // Done allocating
     alloc_cb(ctx, NULL, CHALLOC_DONE);
     return 1;
 }
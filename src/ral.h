@@ -109,6 +109,9 @@ int ral_rps2sf (rps_t rps);
 void  ral_ini ();
 void  ral_stop ();
 int   ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t* upchs);
+// Radios may still be coming up after ral_config returned - run cb once all are up (or gave up).
+// ral_stop cancels a pending callback.
+void  ral_onStarted (tmr_t* tmr, tmrcb_t cb);
 int   ral_txstatus (u1_t txunit);
 void  ral_txabort (u1_t txunit);
 int   ral_tx  (txjob_t* txjob, s2ctx_t* s2ctx, int nocca);
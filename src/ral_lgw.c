@@ -38,6 +38,7 @@
 #include "sys.h"
 #include "sx130xconf.h"
 #include "ral.h"
+#include "metrics.h"
 #include "lgw/loragw_reg.h"
 #include "lgw/loragw_hal.h"
 #if defined(CFG_sx1302)
@@ -182,6 +183,7 @@ static s2_t       txpowAdjust;    // scaled by TXPOW_SCALE
 static sL_t       last_xtime;
 static tmr_t      rxpollTmr;
 static tmr_t      syncTmr;
+static ustime_t   configTime;     // start of last ral_config - 0 once first uplink was seen
 
 
 
@@ -308,14 +310,21 @@ static void rxpolling (tmr_t* tmr) {
         if( n==0 ) {
             break;
         }
+        metrics.ralRxPkts += 1;
+        if( configTime ) {
+            metrics_observe(MH_RAL_FIRST_RX, (rt_getTime() - configTime) / 1e6);
+            configTime = 0;
+        }
 
         rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
         if( rxjob == NULL ) {
             log_rawpkt(ERROR, "Dropped RX frame - out of space: ", &pkt_rx);
+            metrics.ralRxDropped += 1;
             break; // Allow to flush RX jobs
         }
         if( pkt_rx.status != STAT_CRC_OK ) {
-            if( log_shallLog(MOD_RAL|DEBUG) ) {
+            metrics.ralRxCrcBad += 1;
+            if( LOG_ENABLED(MOD_RAL|DEBUG) ) {
                 log_rawpkt(DEBUG, "", &pkt_rx);
             }
             continue; // silently ignore bad CRC
@@ -324,6 +333,7 @@ static void rxpolling (tmr_t* tmr) {
             // This should not happen since caller provides
             // space for max frame length - 255 bytes
             log_rawpkt(ERROR, "Dropped RX frame - frame size too large: ", &pkt_rx);
+            metrics.ralRxDropped += 1;
             continue;
         }
 
@@ -341,10 +351,11 @@ static void rxpolling (tmr_t* tmr) {
         rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);
         if( rxjob->dr == DR_ILLEGAL ) {
             log_rawpkt(ERROR, "Dropped RX frame - unable to map to an up DR: ", &pkt_rx);
+            metrics.ralRxDropped += 1;
             continue;
         }
 
-        if( log_shallLog(MOD_RAL|XDEBUG) ) {
+        if( LOG_ENABLED(MOD_RAL|XDEBUG) ) {
             log_rawpkt(XDEBUG, "", &pkt_rx);
         }
 
@@ -373,18 +384,25 @@ int ral_config (str_t hwspec, u4_t cca_region, char* json, int jsonlen, chdefl_t
     }
     uj_enterArray(&D);
     int ok=0, slaveIdx;
+    ustime_t t0 = rt_getTime();
     while( (slaveIdx = uj_nextSlot(&D)) >= 0 ) {
         dbuf_t json = uj_skipValue(&D);
         if( slaveIdx == 0 ) {
             struct sx130xconf sx130xconf;
+            u4_t phases[MP_MAX] = { 0 };
+            ustime_t tinit = 0;
             int status = 0;
 
             if( (status = !sx130xconf_parse_setup(&sx130xconf, -1, hwspec, json.buf, json.bufsize) << 0) ||
                 (status = !sx130xconf_challoc(&sx130xconf, upchs)    << 1) ||
-                (status = !sys_runRadioInit(sx130xconf.device)       << 2) ||
-                (status = !sx130xconf_start(&sx130xconf, cca_region) << 3) ) {
+                (tinit = rt_getTime(), status = !sys_runRadioInit(sx130xconf.device) << 2) ||
+                (phases[MP_RADIO_INIT] = rt_getTime() - tinit,
+                 status = !sx130xconf_start(&sx130xconf, cca_region, phases) << 3) ) {
                 LOG(MOD_RAL|ERROR, "ral_config failed with status 0x%02x", status);
             } else {
+                memcpy(metrics.ralStartup, phases, sizeof(phases));
+                metrics_observe(MH_RAL_START, (rt_getTime() - t0) / 1e6);
+                configTime = t0;
                 // Radio started
                 txpowAdjust = sx130xconf.txpowAdjust;
                 pps_en = sx130xconf.pps;
@@ -408,6 +426,10 @@ void ral_ini() {
     rt_iniTimer(&syncTmr, synctime);
 }
 
+void ral_onStarted (tmr_t* tmr, tmrcb_t cb) {
+    rt_yieldTo(tmr, cb);   // ral_config brings up the radio synchronously
+}
+
 void ral_stop() {
     rt_clrTimer(&syncTmr);
     last_xtime = 0;
@@ -42,6 +42,7 @@
 #endif // defined(CFG_linux)
 #include "sx1301v2conf.h"
 #include "ral.h"
+#include "metrics.h"
 #include "lgw2/sx1301ar_err.h"
 #include "lgw2/sx1301ar_gps.h"
 #include "lgw2/spi_linuxdev.h"
@@ -261,14 +262,17 @@ static void rxpolling (tmr_t* tmr) {
         if( n==0 ) {
             break;
         }
+        metrics.ralRxPkts += n;
         for( int i=0; i<n; i++ ) {
             rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
             if( rxjob == NULL ) {
                 LOG(ERROR, "SX1301 RX frame dropped - out of space");
+                metrics.ralRxDropped += 1;
                 continue;
             }
             sx1301ar_rx_pkt_t* p = &pkt_rx[i];
             if( p->status != STAT_CRC_OK ) {
+                metrics.ralRxCrcBad += 1;
                 LOG(XDEBUG, "Dropped frame without CRC or with broken CRC");
                 continue; // silently ignore bad CRC
             }
@@ -276,6 +280,7 @@ static void rxpolling (tmr_t* tmr) {
                 // This should not happen since caller provides
                 // space for max frame length - 255 bytes
                 LOG(MOD_RAL|ERROR, "Frame size (%d) exceeds offered buffer (%d)", p->size, MAX_RXFRAME_LEN);
+                metrics.ralRxDropped += 1;
                 continue;
             }
             
@@ -302,6 +307,7 @@ static void rxpolling (tmr_t* tmr) {
             rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);
             if( rxjob->dr == DR_ILLEGAL ) {
                 LOG(MOD_RAL|ERROR, "Unable to map to an up DR: %R", rps);
+                metrics.ralRxDropped += 1;
                 continue;
             }
             s2e_addRxjob(&TC->s2ctx, rxjob);
@@ -388,6 +394,10 @@ void ral_ini() {
     rt_iniTimer(&syncTmr, synctime);
 }
 
+void ral_onStarted (tmr_t* tmr, tmrcb_t cb) {
+    rt_yieldTo(tmr, cb);   // ral_config brings up the radio synchronously
+}
+
 void ral_stop() {
     sx1301ar_stop(SX1301AR_MAX_BOARD_NB);
     if( spiFd >= 0 ) {
@@ -0,0 +1,336 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "s2conf.h"
+#include "s2e.h"
+#include "kwcrc.h"
+#include "rmtlog.h"
+
+
+enum { RMTLOG_MINRING  = 16*1024 };            // ring size if no backfill is kept
+enum { RMTLOG_FRAMESZ  = 2*LOGLINE_LEN };      // max payload of one binary frame
+enum { RMTLOG_HEADROOM = 4*MIN_UPJSON_SIZE };  // leave this much WS send buffer to uplinks
+enum { REC_HDR = 2, REC_STREAM = 0x8000 };     // record: [len|REC_STREAM (2 bytes LE)] text
+#define RMTLOG_LAG     rt_millis(50)           // collect lines before sending
+#define RMTLOG_RETRY   rt_millis(200)          // WS send buffer busy - try again
+
+static u1_t*    ring;
+static u4_t     ringSize;     // power of 2
+static u4_t     head;         // next record is written here
+static u4_t     first;        // oldest record in ring
+static u4_t     sendPos;      // next record to stream
+static u4_t     liveFrom;     // records before this are backfill - sent regardless of REC_STREAM
+static u4_t     dropped;      // lines overwritten before they could be sent
+static s2ctx_t* rmtctx;       // streaming to this LNS session - NULL if off
+static u4_t     rate;         // token bucket: bytes per second
+static u4_t     burst;        // token bucket: capacity in bytes
+static u4_t     tokens;
+static ustime_t refillTime;
+static tmr_t    pumpTmr;
+
+
+static void ringWrite (u4_t pos, const void* data, int n) {
+    u4_t off = pos & (ringSize-1);
+    int k = min(n, (int)(ringSize - off));
+    memcpy(&ring[off], data, k);
+    memcpy(&ring[0], (const u1_t*)data + k, n-k);
+}
+
+static void ringRead (u4_t pos, void* data, int n) {
+    u4_t off = pos & (ringSize-1);
+    int k = min(n, (int)(ringSize - off));
+    memcpy(data, &ring[off], k);
+    memcpy((u1_t*)data + k, &ring[0], n-k);
+}
+
+static int recHdr (u4_t pos) {
+    u1_t h[REC_HDR];
+    ringRead(pos, h, REC_HDR);
+    return h[0] | (h[1]<<8);
+}
+
+// Record is sent when streaming - either backfill or selected by remote levels
+static inline int recStreamed (u4_t pos, int hdr) {
+    return (hdr & REC_STREAM) || (s4_t)(pos - liveFrom) < 0;
+}
+
+static void allocRing (u4_t size) {
+    u4_t sz = 4096;
+    while( sz < size )
+        sz *= 2;
+    rt_free(ring);
+    ring = rt_mallocN(u1_t, sz);
+    ringSize = sz;
+    head = first = sendPos = liveFrom = 0;
+    dropped = 0;
+}
+
+static void freeRing () {
+    rt_free(ring);
+    ring = NULL;
+    ringSize = 0;
+}
+
+static void onPumpTimeout (tmr_t* tmr) {
+    rmtlog_pump(rt_getTime());
+}
+
+static void schedulePump (ustime_t when) {
+    if( pumpTmr.next == TMR_NIL || pumpTmr.deadline > when )
+        rt_setTimerCb(&pumpTmr, when, onPumpTimeout);
+}
+
+
+void rmtlog_ini () {
+    if( RMTLOG_BACKFILL > 0 && ring == NULL ) {
+        allocRing(RMTLOG_BACKFILL);
+        log_setRemoteCapture(1);
+    }
+}
+
+
+// Called from inside log.c - must not log
+void rmtlog_addLine (const char* line, int len, int stream) {
+    if( ring == NULL || len <= 0 )
+        return;
+    len = min(len, LOGLINE_LEN);
+    u4_t need = REC_HDR + len;
+    while( head - first + need > ringSize ) {
+        // Overwrite oldest record
+        int hdr = recHdr(first);
+        u4_t next = first + REC_HDR + (hdr & ~REC_STREAM);
+        if( rmtctx && sendPos == first ) {
+            if( recStreamed(first, hdr) )
+                dropped += 1;
+            sendPos = next;
+        }
+        first = next;
+    }
+    int hdr = len | (stream ? REC_STREAM : 0);
+    u1_t h[REC_HDR] = { hdr, hdr>>8 };
+    ringWrite(head, h, REC_HDR);
+    ringWrite(head + REC_HDR, line, len);
+    head += need;
+    if( rmtctx && stream )
+        schedulePump(rt_getTime() + RMTLOG_LAG);
+}
+
+
+// Collect text of streamed records starting at sendPos - at most maxlen bytes.
+// If buf is NULL only the length is computed. *endp is set to the first record not consumed.
+static int collect (char* buf, int maxlen, u4_t* endp) {
+    u4_t pos = sendPos;
+    int n = 0;
+    while( pos != head ) {
+        int hdr = recHdr(pos);
+        int len = hdr & ~REC_STREAM;
+        if( recStreamed(pos, hdr) ) {
+            if( n + len > maxlen )
+                break;
+            if( buf )
+                ringRead(pos + REC_HDR, buf + n, len);
+            n += len;
+        }
+        pos += REC_HDR + len;
+    }
+    *endp = pos;
+    return n;
+}
+
+
+enum { NOTE_MAXLEN = 80 };
+
+// Note about lines lost from the ring - returns its length (at most NOTE_MAXLEN)
+static int dropNote (char* buf) {
+    dbuf_t b = { .buf = buf, .bufsize = NOTE_MAXLEN, .pos = 0 };
+    xprintf(&b, "%.3T [SYS:WARN] Remote log: %u lines dropped\n", rt_getUTC(), dropped);
+    return b.pos;
+}
+
+
+void rmtlog_pump (ustime_t now) {
+    if( rmtctx == NULL )
+        return;
+    sL_t add = (now - refillTime) * (sL_t)rate / rt_seconds(1);
+    if( tokens + add >= burst ) {
+        tokens = burst;
+        refillTime = now;
+    } else if( add > 0 ) {
+        tokens += add;
+        refillTime += add * rt_seconds(1) / rate;
+    }
+    while( sendPos != head || dropped ) {
+        // Size the frame to check tokens and reserve send buffer space
+        u4_t endPos;
+        char note[NOTE_MAXLEN];
+        int nlen = dropped ? dropNote(note) : 0;
+        int n = collect(NULL, RMTLOG_FRAMESZ - nlen, &endPos);
+        if( n + nlen == 0 ) {
+            sendPos = endPos;  // only lines not meant for remote
+            break;
+        }
+        int fsz = 1 + nlen + n;
+        if( tokens < fsz ) {
+            schedulePump(now + (fsz - tokens) * rt_seconds(1) / rate + 1);
+            return;
+        }
+        ujbuf_t sendbuf = (*rmtctx->getSendbuf)(rmtctx, fsz + RMTLOG_HEADROOM);
+        if( sendbuf.buf == NULL ) {
+            schedulePump(now + RMTLOG_RETRY);
+            return;
+        }
+        // Lines logged while getting the send buffer may have evicted records and moved sendPos.
+        // Fill the frame from the current ring state - a grown note eats into the headroom.
+        sendbuf.buf[0] = RMTLOG_CHANNEL;
+        nlen = dropped ? dropNote(sendbuf.buf + 1) : 0;
+        n = collect(sendbuf.buf + 1 + nlen, min(RMTLOG_FRAMESZ - nlen, fsz - 1), &endPos);
+        sendPos = endPos;
+        dropped = 0;
+        if( n + nlen == 0 )
+            break;
+        sendbuf.pos = 1 + nlen + n;
+        (*rmtctx->sendBinary)(rmtctx, &sendbuf);
+        tokens -= min(tokens, (u4_t)sendbuf.pos);
+    }
+}
+
+
+int rmtlog_enable (s2ctx_t* s2ctx, str_t levels, u4_t lnsRate, u4_t lnsBurst, u4_t backfill) {
+    if( log_setRemoteLevels(levels) != NULL ) {
+        log_setRemoteLevels(NULL);
+        return 0;
+    }
+    // LNS may only lower configured limits
+    rate  = max(1, lnsRate  ? min(lnsRate,  RMTLOG_RATE ) : RMTLOG_RATE);
+    burst = max(RMTLOG_FRAMESZ+1, lnsBurst ? min(lnsBurst, RMTLOG_BURST) : RMTLOG_BURST);
+    tokens = burst;
+    refillTime = rt_getTime();
+    if( rmtctx == NULL ) {
+        if( ring == NULL )
+            allocRing(RMTLOG_MINRING);
+        log_setRemoteCapture(1);
+        // Start with the most recent backfill bytes of complete records
+        u4_t pos = first;
+        while( pos != head && head - pos > backfill )
+            pos += REC_HDR + (recHdr(pos) & ~REC_STREAM);
+        sendPos = pos;
+        liveFrom = head;
+        dropped = 0;
+        rmtctx = s2ctx;
+    }
+    schedulePump(rt_getTime());
+    return 1;
+}
+
+
+void rmtlog_disable () {
+    log_setRemoteLevels(NULL);
+    rmtctx = NULL;
+    rt_clrTimer(&pumpTmr);
+    if( RMTLOG_BACKFILL == 0 ) {
+        log_setRemoteCapture(0);
+        freeRing();
+    }
+}
+
+
+void rmtlog_onClose (s2ctx_t* s2ctx) {
+    if( rmtctx != NULL && rmtctx == s2ctx )
+        rmtlog_disable();
+}
+
+
+void s2e_handleRmtlog (s2ctx_t* s2ctx, ujdec_t* D) {
+    ujcrc_t field;
+    int   enable = 0;
+    str_t levels = "INFO";
+    u4_t  lnsRate = 0, lnsBurst = 0, backfill = 0;
+    while( (field = uj_nextField(D)) ) {
+        switch(field) {
+        case J_msgtype: {
+            uj_skipValue(D);
+            break;
+        }
+        case J_enable: {
+            enable = uj_bool(D);
+            break;
+        }
+        case J_levels: {
+            levels = uj_str(D);
+            break;
+        }
+        case J_rate: {
+            lnsRate = uj_intRange(D, 0, 0x7FFFFFFF);
+            break;
+        }
+        case J_burst: {
+            lnsBurst = uj_intRange(D, 0, 0x7FFFFFFF);
+            break;
+        }
+        case J_backfill: {
+            backfill = uj_intRange(D, 0, 0x3FFFFF) * 1024;
+            break;
+        }
+        case J_MuxTime: {
+            s2e_updateMuxtime(s2ctx, uj_num(D), 0);
+            break;
+        }
+        default: {
+            LOG(MOD_S2E|WARNING, "Unknown field in 'rmtlog' message - ignored: %s", D->field.name);
+            uj_skipValue(D);
+            break;
+        }
+        }
+    }
+    if( !enable ) {
+        if( rmtctx )
+            LOG(MOD_S2E|INFO, "Remote logging stopped");
+        rmtlog_disable();
+    }
+    else if( !rmtlog_enable(s2ctx, levels, lnsRate, lnsBurst, backfill) ) {
+        LOG(MOD_S2E|ERROR, "Remote logging - illegal log levels: %s", levels);
+        enable = 0;
+    } else {
+        LOG(MOD_S2E|INFO, "Remote logging: levels=%s rate=%uB/s burst=%uB backfill=%ukB",
+            levels, rate, burst, min(backfill, ringSize)/1024);
+    }
+    ujbuf_t sendbuf = (*s2ctx->getSendbuf)(s2ctx, MIN_UPJSON_SIZE);
+    if( sendbuf.buf == NULL ) {
+        LOG(MOD_S2E|ERROR, "Failed to send 'rmtlog' response, no buffer space");
+        return;
+    }
+    uj_encOpen(&sendbuf, '{');
+    uj_encKVn(&sendbuf,
+              "msgtype",  's', "rmtlog",
+              "enable",   'b', enable,
+              "rate",     'u', enable ? rate : 0,
+              "burst",    'u', enable ? burst : 0,
+              NULL);
+    uj_encClose(&sendbuf, '}');
+    (*s2ctx->sendText)(s2ctx, &sendbuf);
+}
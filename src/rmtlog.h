@@ -0,0 +1,56 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rmtlog_h_
+#define _rmtlog_h_
+
+#include "rt.h"
+#include "uj.h"
+
+struct s2ctx;
+
+// Remote log streaming to the LNS.
+// Log lines are kept in a memory ring and sent as binary websocket frames:
+//   [RMTLOG_CHANNEL(1)] followed by complete text log lines
+// Channel bytes 0..MAX_RMTSH-1 are used by remote shell sessions.
+// Sending is paced by a token bucket and only done if the websocket send buffer
+// retains enough headroom for uplink traffic. If the ring overflows before lines
+// could be sent they are dropped and a note is inserted into the stream.
+// With RMTLOG_BACKFILL the ring keeps the most recent local log output at all times
+// so that it can be sent when the LNS enables streaming.
+enum { RMTLOG_CHANNEL = 0xFF };
+
+void rmtlog_ini       ();
+void rmtlog_addLine   (const char* line, int len, int stream);   // called by log.c
+int  rmtlog_enable    (struct s2ctx* s2ctx, str_t levels, u4_t rate, u4_t burst, u4_t backfill);
+void rmtlog_disable   ();
+void rmtlog_pump      (ustime_t now);    // send as much as pacing allows
+void rmtlog_onClose   (struct s2ctx* s2ctx);
+void s2e_handleRmtlog (struct s2ctx* s2ctx, ujdec_t* D);
+
+#endif // _rmtlog_h_
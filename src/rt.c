@@ -231,6 +231,13 @@ uL_t rt_rlsbf8 (const u1_t* buf) {
     return rt_rlsbf4(buf) | ((uL_t)rt_rlsbf4(buf+4) << 32);
 }
 
+uL_t rt_rmsbf8 (const u1_t* buf) {
+    uL_t v = 0;
+    for( int i=0; i<8; i++ )
+        v = (v<<8) | buf[i];
+    return v;
+}
+
 
 void* _rt_malloc(int size, int zero) {
     void* p = malloc(size);
@@ -120,37 +120,120 @@ enum { MOD_ANY= 0*8, MOD_RAL= 1*8, MOD_S2E= 2*8, MOD_WSS= 3*8,
        MOD_TCE= 8*8, MOD_HAL= 9*8, MOD_SIO=10*8, MOD_SYN=11*8,
        MOD_GPS=12*8, MOD_SIM=13*8, MOD_WEB=14*8, MOD_ALL=0xF8 };
 
+extern u1_t log_enabled[256];  // indexed by mod_level - nonzero if messages are logged
+
 void  log_setSlaveIdx (s1_t idx);
 int   log_setLevel (int level);
 str_t log_parseLevels (const char* levels);
 int   log_str2level (const char* level);
-int   log_shallLog (u1_t mod_level);
 void  log_msg (u1_t mod_level, const char* fmt, ...);
 void  log_vmsg (u1_t mod_level, const char* fmt, va_list args);
 int   log_special (u1_t mod_level, dbuf_t* buf);
 void  log_specialFlush (int len);
 void  log_flush ();
 void  log_flushIO ();
+void  log_iniDeferred (int size);
+int   log_pendingDeferred ();
+int   log_renderDeferred (char* buf, int bufsize);
+void  log_setRemoteCapture (int on);
+str_t log_setRemoteLevels (const char* levels);
+
+static inline int log_shallLog (u1_t mod_level) {
+    return log_enabled[mod_level];
+}
+
+// Compile time stripping of log messages:
+//   CFG_logmod_exclude         bit mask of modules (1<<(MOD_xxx>>3)) to strip entirely
+//   CFG_loglvl_exclude         strip levels up to and including this one in all modules
+//   CFG_loglvl_exclude_<MOD>   same for one module only - e.g. -DCFG_loglvl_exclude_RAL=DEBUG
+#ifndef CFG_logmod_exclude
+#define CFG_logmod_exclude 0
+#endif
+#ifndef CFG_loglvl_exclude
+#define CFG_loglvl_exclude -1
+#endif
+#ifndef CFG_loglvl_exclude_ANY
+#define CFG_loglvl_exclude_ANY CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_RAL
+#define CFG_loglvl_exclude_RAL CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_S2E
+#define CFG_loglvl_exclude_S2E CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_WSS
+#define CFG_loglvl_exclude_WSS CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_JSN
+#define CFG_loglvl_exclude_JSN CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_AIO
+#define CFG_loglvl_exclude_AIO CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_CUP
+#define CFG_loglvl_exclude_CUP CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_SYS
+#define CFG_loglvl_exclude_SYS CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_TCE
+#define CFG_loglvl_exclude_TCE CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_HAL
+#define CFG_loglvl_exclude_HAL CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_SIO
+#define CFG_loglvl_exclude_SIO CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_SYN
+#define CFG_loglvl_exclude_SYN CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_GPS
+#define CFG_loglvl_exclude_GPS CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_SIM
+#define CFG_loglvl_exclude_SIM CFG_loglvl_exclude
+#endif
+#ifndef CFG_loglvl_exclude_WEB
+#define CFG_loglvl_exclude_WEB CFG_loglvl_exclude
+#endif
 
+#define LOG_EXCLUDED_LVL(mod) (                                 \
+        (mod)==MOD_ANY ? CFG_loglvl_exclude_ANY :               \
+        (mod)==MOD_RAL ? CFG_loglvl_exclude_RAL :               \
+        (mod)==MOD_S2E ? CFG_loglvl_exclude_S2E :               \
+        (mod)==MOD_WSS ? CFG_loglvl_exclude_WSS :               \
+        (mod)==MOD_JSN ? CFG_loglvl_exclude_JSN :               \
+        (mod)==MOD_AIO ? CFG_loglvl_exclude_AIO :               \
+        (mod)==MOD_CUP ? CFG_loglvl_exclude_CUP :               \
+        (mod)==MOD_SYS ? CFG_loglvl_exclude_SYS :               \
+        (mod)==MOD_TCE ? CFG_loglvl_exclude_TCE :               \
+        (mod)==MOD_HAL ? CFG_loglvl_exclude_HAL :               \
+        (mod)==MOD_SIO ? CFG_loglvl_exclude_SIO :               \
+        (mod)==MOD_SYN ? CFG_loglvl_exclude_SYN :               \
+        (mod)==MOD_GPS ? CFG_loglvl_exclude_GPS :               \
+        (mod)==MOD_SIM ? CFG_loglvl_exclude_SIM :               \
+        (mod)==MOD_WEB ? CFG_loglvl_exclude_WEB :               \
+        CFG_loglvl_exclude)
+
+// Level check before any argument is evaluated - constant folds away
+// for stripped messages, otherwise a single byte load.
+// Debug levels are assumed to be mostly off.
+#define LOG_ENABLED(level) (                                            \
+        !((1<<(((level) & MOD_ALL)>>3)) & (CFG_logmod_exclude)) &&      \
+        ((level) & 7) > LOG_EXCLUDED_LVL((level) & MOD_ALL) &&          \
+        __builtin_expect(log_shallLog(level), ((level) & 7) > DEBUG))
 
 #if defined(CFG_log_file_line)
 #define LOG(level, fmt, ...) {                                  \
-        if( log_shallLog(level) ) {                             \
+        if( LOG_ENABLED(level) ) {                              \
         log_msg((level), "-- %s[%d]", __FILE__, __LINE__);      \
         log_msg((level), fmt, ## __VA_ARGS__);                  \
         }                                                       \
 }
 #else // !defined(CFG_log_file_line)
-#ifndef CFG_logmod_exclude
-#define CFG_logmod_exclude 0
-#endif
-#ifndef CFG_loglvl_exclude
-#define CFG_loglvl_exclude -1
-#endif
 #define LOG(level, fmt, ...) {                                  \
-        if( !((1<<((level)>>3)) & (CFG_logmod_exclude)) &&      \
-            ((level) & 7) > (CFG_loglvl_exclude) &&             \
-            log_shallLog(level) ) {                             \
+        if( LOG_ENABLED(level) ) {                              \
             log_msg((level), fmt, ## __VA_ARGS__);              \
         }                                                       \
 }
@@ -205,6 +288,7 @@ struct datetime rt_datetime (ustime_t ustime);
 
 u2_t rt_rlsbf2 (const u1_t* buf);
 u2_t rt_rmsbf2 (const u1_t* buf);
+uL_t rt_rmsbf8 (const u1_t* buf);
 u4_t rt_rlsbf4 (const u1_t* buf);
 uL_t rt_rlsbf8 (const u1_t* buf);
 
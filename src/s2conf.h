@@ -39,6 +39,7 @@
 #define DFLT_MAX_TXDATA           (16*1024)
 #define DFLT_MAX_WSSDATA               2048
 #define DFLT_TC_RECV_BUFSZ        (40*1024)
+#define DFLT_TC_RECV_MAXSZ      (1024*1024)   // WS recv ring grows up to this for large messages
 #define DFLT_TC_SEND_BUFSZ        (80*1024)
 #define DFLT_RADIO_INIT_WAIT    "\"200ms\""
 #define DFLT_MAX_TXUNITS                  4
@@ -48,6 +49,7 @@
 #define DFLT_RADIODEV  "\"/dev/spidev?.0\""
 #define DFLT_TX_MIN_GAP          "\"10ms\""   // worst case for ODU as of 07.2018 (horrible SPI performance)
 #define DFLT_TX_AIM_GAP          "\"20ms\""   //  -ditto-
+#define DFLT_TX_MAX_AIM_GAP     "\"200ms\""   // upper bound for adapted TX_AIM_GAP
 #define DFLT_TX_MAX_AHEAD        "\"600s\""
 #define DFLT_TXCHECK_FUDGE        "\"5ms\""
 /* TCP keepalive */
@@ -107,6 +109,7 @@ enum {  MAX_URI_LEN = 128 };        // max size of a URI
 enum {  MAX_FILEPATH_LEN = 256 };   // max size of a file path
 
 enum {  TC_RECV_BUFFER_SIZE =   DFLT_TC_RECV_BUFSZ }; // websocket connections to TC (infos/muxs)
+enum {  TC_RECV_BUFFER_MAX  =   DFLT_TC_RECV_MAXSZ };
 enum {  TC_SEND_BUFFER_SIZE =   DFLT_TC_SEND_BUFSZ };
 
 enum {  MAX_HWSPEC_SIZE = 32 };
@@ -122,6 +125,7 @@ enum {  LOGLINE_LEN = 512 };
 
 enum {  RTT_SAMPLES     = 100 };
 enum {  MAX_WSSFRAMES   =  32 };
+enum {  N_TXLAT         =  16 };   // window of radio TX latency samples per txunit
 enum {  MIN_UPJSON_SIZE = 384 };
 enum {  MAX_TXUNITS     = DFLT_MAX_TXUNITS };
 enum {  MAX_130X        = DFLT_MAX_130X };
@@ -163,6 +167,11 @@ void  s2conf_printAll ();
 CONF_PARAM(RADIODEV            , str   , str     ,        DFLT_RADIODEV, "default radio device")
 CONF_PARAM(LOGFILE_SIZE        , u4    , size_mb ,    DFLT_LOGFILE_SIZE, "default size of a logfile")
 CONF_PARAM(LOGFILE_ROTATE      , u4    , u4      ,  DFLT_LOGFILE_ROTATE, "besides current log file keep *.1..N (none if 0)")
+CONF_PARAM(LOGFILE_COMPRESS    , u4    , bool    ,              "false", "gzip rotated log files on the log thread (builds with logzip only)")
+CONF_PARAM(RMTLOG_BACKFILL     , u4    , size_kb ,                  "0", "keep this much recent log text in memory - sent when the LNS enables remote logging (0=off)")
+CONF_PARAM(RMTLOG_RATE         , u4    , u4      ,               "2048", "max average rate of remote log streaming [bytes/s] - LNS may lower it")
+CONF_PARAM(RMTLOG_BURST        , u4    , size_kb ,                  "8", "max burst of remote log streaming - LNS may lower it")
+CONF_PARAM(LOG_DEFERRED        , u4    , size_kb ,                  "0", "queue raw log records in a ring of this size and format them on the log thread (0=format immediately)")
 CONF_PARAM(TCP_KEEPALIVE_EN    , u4    , u4      ,   DFLT_TCP_KEEPALIVE, "TCP keepalive enabled")
 CONF_PARAM(TCP_KEEPALIVE_IDLE  , u4    , u4      ,    DFLT_TCP_KEEPIDLE, "TCP keepalive TCP_KEEPIDLE [s]")
 CONF_PARAM(TCP_KEEPALIVE_INTVL , u4    , u4      ,   DFLT_TCP_KEEPINTVL, "TCP keepalive TCP_KEEPINTVL [s]")
@@ -172,15 +181,20 @@ CONF_PARAM(CUPS_CONN_TIMEOUT   , ustime, tspan_s ,            "\"60s\"", "connec
 CONF_PARAM(CUPS_OKSYNC_INTV    , ustime, tspan_h ,            "\"24h\"", "regular check-in with CUPS for updates")
 CONF_PARAM(CUPS_RESYNC_INTV    , ustime, tspan_m ,             "\"1m\"", "check-in with CUPS for updates after a failure")
 CONF_PARAM(CUPS_BUFSZ          , u4    , size_kb ,      DFLT_CUPS_BUFSZ, "read from CUPS in chunks of this size")
+CONF_PARAM(CUPS_RESUME         , u4    , bool    ,               "true", "continue interrupted update downloads where they stopped")
 CONF_PARAM(GPS_REPORT_DELAY    , ustime, tspan_s ,           "\"120s\"", "delay GPS reports and consolidate")
 CONF_PARAM(GPS_REOPEN_TTY_INTV , ustime, tspan_ms,             "\"1s\"", "recheck TTY open if it failed")
 CONF_PARAM(GPS_REOPEN_FIFO_INTV, ustime, tspan_ms,             "\"1s\"", "recheck if FIFO writer fake GPS")
 CONF_PARAM(CMD_REOPEN_FIFO_INTV, ustime, tspan_ms,             "\"1s\"", "recheck if FIFO writer")
 CONF_PARAM(RX_POLL_INTV        , ustime, tspan_ms,           "\"20ms\"", "interval to poll SX1301 RX FIFO")
 CONF_PARAM(TC_TIMEOUT          , ustime, tspan_s ,            "\"60s\"", "reconnected to muxs")
+CONF_PARAM(TC_MUXS_URI_TTL     , ustime, tspan_s ,             "\"1h\"", "reconnect directly to last muxs URI from INFOS for this long (0=always ask INFOS)")
 CONF_PARAM(CLASS_C_BACKOFF_BY  , ustime, tspan_s ,          "\"100ms\"", "retry interval for class C TX attempts")
 CONF_PARAM(CLASS_C_BACKOFF_MAX , u4    , u4      ,                 "10", "max number of class C TX attempts")
+CONF_PARAM(CLASS_C_PACING      , u4    , bool    ,              "false", "class C: place frames into free queue gaps instead of backoff retries")
+CONF_PARAM(CLASS_C_FAIRSHARE   , u4    , u4      ,                  "4", "class C pacing: leave a slot to other devices after N frames of one device (0=off)")
 CONF_PARAM(RADIO_INIT_WAIT     , ustime, tspan_s , DFLT_RADIO_INIT_WAIT, "max wait for radio init command to finish")
+CONF_PARAM(RADIO_START_WAIT    , ustime, tspan_s ,            "\"15s\"", "max wait for all slaves to bring up their concentrators")
 CONF_PARAM(PPS_VALID_INTV      , ustime, tspan_ms,            "\"10m\"", "max age of last PPS sync for GPS time conversions")
 CONF_PARAM(TIMESYNC_RADIO_INTV , ustime, tspan_ms,         "\"2100ms\"", "interval to resync MCU/SX1301")
 CONF_PARAM(TIMESYNC_LNS_RETRY  , ustime, tspan_s ,           "\"71ms\"", "resend timesync message to server")
@@ -189,10 +203,21 @@ CONF_PARAM(TIMESYNC_LNS_BURST  , u4    , u4      ,                 "10", "volley
 CONF_PARAM(TIMESYNC_REPORTS    , ustime, tspan_s ,             "\"5m\"", "report interval for current timesync status")
 CONF_PARAM(TX_MIN_GAP          , ustime, tspan_s ,      DFLT_TX_MIN_GAP, "min distance between two frames being TXed")
 CONF_PARAM(TX_AIM_GAP          , ustime, tspan_s ,      DFLT_TX_AIM_GAP, "aim for this TX lead time, if delayed should not fall under min")
+CONF_PARAM(TX_AIM_ADAPT        , u4    , u4      ,                 "90", "adapt TX_AIM_GAP to this quantile of measured radio TX latency (0=static)")
+CONF_PARAM(TX_MAX_AIM_GAP      , ustime, tspan_s ,  DFLT_TX_MAX_AIM_GAP, "upper bound for an adapted TX_AIM_GAP")
 CONF_PARAM(TX_MAX_AHEAD        , ustime, tspan_s ,    DFLT_TX_MAX_AHEAD, "maximum time message can be scheduled into the future")
 CONF_PARAM(TXCHECK_FUDGE       , ustime, tspan_s ,   DFLT_TXCHECK_FUDGE, "check radio state this time into ongoing TX")
 CONF_PARAM(BEACON_INTVL        , ustime, tspan_s ,    DFLT_BEACON_INTVL, "beaconing interval")
+CONF_PARAM(WEB_MAX_CONNS       , u4    , u4      ,                  "4", "max concurrent connections to the web server")
+CONF_PARAM(WEB_IDLE_TIMEOUT    , ustime, tspan_s ,            "\"10s\"", "close keep-alive web connections idle for this long")
+CONF_PARAM(UPLINK_SPOOL_SIZE   , u4    , size_kb ,                  "0", "spool uplinks to ~temp/station.spool while LNS is unreachable (0=off)")
+CONF_PARAM(UPLINK_SPOOL_MAXAGE , ustime, tspan_s ,            "\"10m\"", "spooled uplinks older than this are not replayed")
+CONF_PARAM(UPLINK_SPOOL_RATE   , u4    , u4      ,                 "20", "replay spooled uplinks at this many messages per second")
 CONF_PARAM(TLS_SNI             ,     u4,    bool ,               "true", "Set and verify server name of TLS connections")
+CONF_PARAM(TLS_RESUME          ,     u4,    bool ,               "true", "Resume TLS sessions (tickets/session IDs) on reconnect to CUPS/INFOS/MUXS")
+CONF_PARAM(TLS_SESSION_PERSIST ,     u4,    bool ,              "false", "Keep resumable TLS sessions in ~temp/ across restarts (contains session secrets)")
+CONF_PARAM(WS_DEFLATE          ,     u4,    bool ,              "false", "Offer permessage-deflate compression on TC websockets")
+CONF_PARAM(WS_DEFLATE_WBITS    ,     u4,    u4   ,                 "11", "permessage-deflate window bits (9..15) - bounds memory per connection")
 
 #endif // _s2conf_x_
 
@@ -27,12 +27,16 @@
  */
 
 #include <stdio.h>
+#include <math.h>
 #include "s2conf.h"
 #include "uj.h"
 #include "ral.h"
 #include "s2e.h"
 #include "kwcrc.h"
 #include "timesync.h"
+#include "spool.h"
+#include "metrics.h"
+#include "rmtlog.h"
 
 
 u1_t s2e_dcDisabled;    // no duty cycle limits - override for test/dev
@@ -47,6 +51,9 @@ extern inline rps_t rps_make (int sf, int bw);
 // Fwd decl.
 static void s2e_txtimeout (tmr_t* tmr);
 static void s2e_bcntimeout (tmr_t* tmr);
+static void s2e_spooltimeout (tmr_t* tmr);
+static void s2e_radioStarted (tmr_t* tmr);
+static int  paceClassC (s2ctx_t* s2ctx, txjob_t* txjob, ustime_t earliest);
 
 
 static void setDC (s2ctx_t* s2ctx, ustime_t t) {
@@ -86,9 +93,14 @@ void s2e_ini (s2ctx_t* s2ctx) {
         rt_iniTimer(&s2ctx->txunits[u].timer, s2e_txtimeout);
         s2ctx->txunits[u].timer.ctx = s2ctx;
         s2ctx->txunits[u].head = TXIDX_END;
+        s2ctx->txunits[u].aimGap = TX_AIM_GAP;
     }
     rt_iniTimer(&s2ctx->bcntimer, s2e_bcntimeout);
     s2ctx->bcntimer.ctx = s2ctx;
+    rt_iniTimer(&s2ctx->spooltimer, s2e_spooltimeout);
+    s2ctx->spooltimer.ctx = s2ctx;
+    rt_iniTimer(&s2ctx->radiotimer, s2e_radioStarted);
+    s2ctx->radiotimer.ctx = s2ctx;
 }
 
 
@@ -96,6 +108,9 @@ void s2e_free (s2ctx_t* s2ctx) {
     for( int u=0; u < MAX_TXUNITS; u++ )
         rt_clrTimer(&s2ctx->txunits[u].timer);
     rt_clrTimer(&s2ctx->bcntimer);
+    rt_clrTimer(&s2ctx->spooltimer);
+    rt_clrTimer(&s2ctx->radiotimer);
+    rmtlog_onClose(s2ctx);
     memset(s2ctx, 0, sizeof(*s2ctx));
     ts_iniTimesync();
     ral_stop();
@@ -118,6 +133,7 @@ rxjob_t* s2e_nextRxjob (s2ctx_t* s2ctx) {
 
 void s2e_addRxjob (s2ctx_t* s2ctx, rxjob_t* rxjob) {
     // Add newly received frame to rxq
+    metrics.rxFrames += 1;
     // Check for mirror frame (reflection on a neighboring frequency)
     for( rxjob_t* p = &s2ctx->rxq.rxjobs[s2ctx->rxq.first]; p < rxjob; p++ ) {
         if( p->dr == rxjob->dr &&
@@ -138,6 +154,7 @@ void s2e_addRxjob (s2ctx_t* s2ctx, rxjob_t* rxjob) {
                     rxjob-> freq, rxjob->snr/4.0, -rxjob->rssi, p->freq, p->snr/4.0, -p->rssi,
                     rxjob->dr, (s4_t)rt_rlsbf4(&s2ctx->rxq.rxdata[rxjob->off]+rxjob->len-4), rxjob->len);
             }
+            metrics.rxMirrors += 1;
             return;
         }
     }
@@ -145,8 +162,98 @@ void s2e_addRxjob (s2ctx_t* s2ctx, rxjob_t* rxjob) {
     rxq_commitJob(&s2ctx->rxq, rxjob);
 }
 
+// Encode rxjob as updf message - returns 0 if frame was dropped by filters
+static int encodeUpdf (s2ctx_t* s2ctx, rxjob_t* j, ujbuf_t* sendbuf) {
+    dbuf_t lbuf = { .buf = NULL };
+    if( LOG_ENABLED(MOD_S2E|VERBOSE) && log_special(MOD_S2E|VERBOSE, &lbuf) )
+        xprintf(&lbuf, "RX %F DR%d %R snr=%.1f rssi=%d xtime=0x%lX - ",
+                j->freq, j->dr, s2e_dr2rps(s2ctx, j->dr), j->snr/4.0, -j->rssi, j->xtime);
+
+    uj_encOpen(sendbuf, '{');
+    if( !s2e_parse_lora_frame(sendbuf, &s2ctx->rxq.rxdata[j->off], j->len, lbuf.buf ? &lbuf : NULL) ) {
+        // Frame failed sanity checks or stopped by filters
+        sendbuf->pos = 0;
+        metrics.rxFiltered += 1;
+        return 0;
+    }
+    if( lbuf.buf )
+        log_specialFlush(lbuf.pos);
+    double reftime = 0.0;
+    if( s2ctx->muxtime ) {
+        reftime = s2ctx->muxtime +
+            ts_normalizeTimespanMCU(rt_getTime()-s2ctx->reftime) / 1e6;
+    }
+    uj_encKVn(sendbuf,
+              "RefTime",  'T', reftime,
+              "DR",       'i', j->dr,
+              "Freq",     'i', j->freq,
+              "upinfo",   '{',
+              /**/ "rctx",    'I', j->rctx,
+              /**/ "xtime",   'I', j->xtime,
+              /**/ "gpstime", 'I', ts_xtime2gpstime(j->xtime),
+              /**/ "fts",     'i', j->fts,
+              /**/ "rssi",    'i', -(s4_t)j->rssi,
+              /**/ "snr",     'g', j->snr/4.0,
+              /**/ "rxtime",  'T', rt_getUTC()/1e6,
+              "}",
+              NULL);
+    uj_encClose(sendbuf, '}');
+    if( !xeos(sendbuf) ) {
+        LOG(MOD_S2E|ERROR, "JSON encoding exceeds available buffer space: %d", sendbuf->bufsize);
+        return 0;
+    }
+    return 1;
+}
+
+
+// Send spooled uplinks (rate limited) - returns 1 if spool still has data
+static int replaySpool (s2ctx_t* s2ctx) {
+    ustime_t now = rt_getTime();
+    dbuf_t rec;
+    while( spool_next(&rec, rt_getUTC(), UPLINK_SPOOL_MAXAGE) ) {
+        if( now < s2ctx->spoolReplayAt ) {
+            rt_setTimer(&s2ctx->spooltimer, s2ctx->spoolReplayAt);   // rate limit
+            return 1;
+        }
+        ujbuf_t sendbuf = (*s2ctx->getSendbuf)(s2ctx, max(MIN_UPJSON_SIZE, rec.bufsize+1));
+        if( sendbuf.buf == NULL )
+            return 1;
+        memcpy(sendbuf.buf, rec.buf, rec.bufsize);
+        sendbuf.pos = rec.bufsize;
+        (*s2ctx->sendText)(s2ctx, &sendbuf);
+        spool_consume();
+        // Allow short bursts but keep average at UPLINK_SPOOL_RATE
+        s2ctx->spoolReplayAt = max(s2ctx->spoolReplayAt, now - rt_millis(250)) + rt_seconds(1) / max(1, UPLINK_SPOOL_RATE);
+        if( spool_empty() )
+            break;
+    }
+    LOG(MOD_S2E|INFO, "Uplink spool drained: appended=%u replayed=%u expired=%u dropped=%u",
+        spool_stats.appended, spool_stats.replayed, spool_stats.expired, spool_stats.dropped);
+    memset(&spool_stats, 0, sizeof(spool_stats));
+    return 0;
+}
+
+
+static void s2e_spooltimeout (tmr_t* tmr) {
+    s2e_flushRxjobs((s2ctx_t*)tmr->ctx);
+}
+
+
 void s2e_flushRxjobs (s2ctx_t* s2ctx) {
+    // While link is down or spooled frames are pending new frames queue up behind them
+    int spooling = 0;
+    if( spool_active() && (s2ctx->linkDown || !spool_empty()) )
+        spooling = s2ctx->linkDown || replaySpool(s2ctx);
+
     while( s2ctx->rxq.first < s2ctx->rxq.next ) {
+        if( spooling ) {
+            char json[MIN_UPJSON_SIZE + 2*MAX_RXFRAME_LEN];
+            ujbuf_t b = dbuf_ini(json);
+            rxjob_t* j = &s2ctx->rxq.rxjobs[s2ctx->rxq.first++];
+            if( encodeUpdf(s2ctx, j, &b) && !spool_append(b.buf, b.pos, rt_getUTC()) )
+                LOG(MOD_S2E|ERROR, "Failed to spool uplink (%d bytes)", b.pos);
+            continue;
+        }
         // Get a send buffer - parse frame / check filter
         ujbuf_t sendbuf = (*s2ctx->getSendbuf)(s2ctx, MIN_UPJSON_SIZE);
         if( sendbuf.buf == NULL ) {
@@ -154,44 +261,10 @@ void s2e_flushRxjobs (s2ctx_t* s2ctx) {
             return;
         }
         rxjob_t* j = &s2ctx->rxq.rxjobs[s2ctx->rxq.first++];
-        dbuf_t lbuf = { .buf = NULL };
-        if( log_special(MOD_S2E|VERBOSE, &lbuf) )
-            xprintf(&lbuf, "RX %F DR%d %R snr=%.1f rssi=%d xtime=0x%lX - ",
-                    j->freq, j->dr, s2e_dr2rps(s2ctx, j->dr), j->snr/4.0, -j->rssi, j->xtime);
-
-        uj_encOpen(&sendbuf, '{');
-        if( !s2e_parse_lora_frame(&sendbuf, &s2ctx->rxq.rxdata[j->off], j->len, lbuf.buf ? &lbuf : NULL) ) {
-            // Frame failed sanity checks or stopped by filters
-            sendbuf.pos = 0;
-            continue;
-        }
-        if( lbuf.buf )
-            log_specialFlush(lbuf.pos);
-        double reftime = 0.0;
-        if( s2ctx->muxtime ) {
-            reftime = s2ctx->muxtime +
-                ts_normalizeTimespanMCU(rt_getTime()-s2ctx->reftime) / 1e6;
-        }
-        uj_encKVn(&sendbuf,
-                  "RefTime",  'T', reftime,
-                  "DR",       'i', j->dr,
-                  "Freq",     'i', j->freq,
-                  "upinfo",   '{',
-                  /**/ "rctx",    'I', j->rctx,
-                  /**/ "xtime",   'I', j->xtime,
-                  /**/ "gpstime", 'I', ts_xtime2gpstime(j->xtime),
-                  /**/ "fts",     'i', j->fts,
-                  /**/ "rssi",    'i', -(s4_t)j->rssi,
-                  /**/ "snr",     'g', j->snr/4.0,
-                  /**/ "rxtime",  'T', rt_getUTC()/1e6,
-                  "}",
-                  NULL);
-        uj_encClose(&sendbuf, '}');
-        if( !xeos(&sendbuf) ) {
-            LOG(MOD_S2E|ERROR, "JSON encoding exceeds available buffer space: %d", sendbuf.bufsize);
-        } else {
+        if( encodeUpdf(s2ctx, j, &sendbuf) ) {
             (*s2ctx->sendText)(s2ctx, &sendbuf);
             assert(sendbuf.buf==NULL);
+            metrics.updfSent += 1;
         }
     }
 }
@@ -403,6 +476,40 @@ static void updateAirtimeTxpow (s2ctx_t* s2ctx, txjob_t* txjob) {
     txjob->txpow = calcTxpow(s2ctx, txjob);
 }
 
+// Track how long it takes to hand a frame to the radio. The TX_AIM_ADAPT quantile is estimated
+// incrementally (stochastic gradient step on the quantile loss, step scaled by the running
+// mean absolute deviation) - no samples are kept. Every N_TXLAT samples the TX lead time of the
+// txunit is recomputed: twice the latency on top of TX_MIN_GAP, never less than TXCHECK_FUDGE
+// above TX_MIN_GAP to absorb event loop jitter, and at most TX_MAX_AIM_GAP.
+static void updateAimGap (s2ctx_t* s2ctx, u1_t txunit, ustime_t latency) {
+    if( TX_AIM_ADAPT == 0 )
+        return;
+    s2txunit_t* u = &s2ctx->txunits[txunit];
+    double x = latency;
+    double p = min(TX_AIM_ADAPT, 99) / 100.0;
+    if( u->txlatCnt++ == 0 ) {
+        u->txlatQ = x;
+        u->txlatDev = x / 2;
+    } else {
+        u->txlatDev += (fabs(x - u->txlatQ) - u->txlatDev) / N_TXLAT;
+        u->txlatQ = max(0.0, u->txlatQ + (x > u->txlatQ ? p : p - 1) * u->txlatDev / N_TXLAT);
+    }
+    if( u->txlatCnt % N_TXLAT != 0 )
+        return;
+    ustime_t q = (ustime_t)u->txlatQ;
+    ustime_t aimGap = max(TX_MIN_GAP + TXCHECK_FUDGE, min(TX_MAX_AIM_GAP, TX_MIN_GAP + 2*q));
+    LOG(MOD_S2E|VERBOSE, "TX latency ant#%d: q%d=%~T dev=%~T - TX lead time %~T (was %~T)",
+        txunit, TX_AIM_ADAPT, q, (ustime_t)u->txlatDev, aimGap, u->aimGap);
+    u->aimGap = aimGap;
+}
+
+// Latency from deciding to TX until the radio has the frame. Measured around ral_tx for a local
+// radio - slaves report it in their TX response since it includes the pipe to the slave.
+void s2e_txLatency (s2ctx_t* s2ctx, u1_t txunit, ustime_t latency) {
+    metrics_observe(MH_RAL_TX, latency/1e6);
+    updateAimGap(s2ctx, txunit, latency);
+}
+
 static int calcPriority (txjob_t* txjob) {
     int prio = txjob->prio;
     if( txjob->rx2freq || ((txjob->txflags & TXFLAG_CLSC) && txjob->retries < CLASS_C_BACKOFF_MAX) )
@@ -434,6 +541,8 @@ static int altTxTime (s2ctx_t* s2ctx, txjob_t* txjob, ustime_t earliest) {
                 return 0;
             }
         }
+        if( CLASS_C_PACING )
+            return paceClassC(s2ctx, txjob, earliest);
         if( txjob->retries > CLASS_C_BACKOFF_MAX ) {
             LOG(MOD_S2E|VERBOSE, "%J - class C out of TX tries (%d in %~T)",
                 txjob, txjob->retries, txjob->retries*CLASS_C_BACKOFF_BY);
@@ -507,6 +616,87 @@ static int s2e_canTxPerChnlDC (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled)
 }
 
 
+// Class C pacing - place a frame directly into the first gap of the txunit queue.
+// Instead of probing in steps of CLASS_C_BACKOFF_BY the slot is derived in one walk over the queue:
+//  - a gap must hold the airtime plus TX_MIN_GAP to either neighbor
+//  - duty cycle is projected from current DC state and all queued frames on the same band/channel,
+//    and the new frame must not use up DC needed by frames already queued behind it
+//  - frames of the same device keep their order, after every CLASS_C_FAIRSHARE frames of one device
+//    a gap of equal size is left for other devices
+// The slot must lie within CLASS_C_BACKOFF_MAX*CLASS_C_BACKOFF_BY, otherwise the frame is dropped.
+//
+static int paceClassC (s2ctx_t* s2ctx, txjob_t* txjob, ustime_t earliest) {
+    if( txjob->retries >= CLASS_C_BACKOFF_MAX ) {
+        LOG(MOD_S2E|VERBOSE, "%J - class C out of TX tries (%d)", txjob, txjob->retries);
+        return 0;
+    }
+    txjob->retries += 1;
+    u1_t txunit = ral_rctx2txunit(txjob->rctx);
+    ustime_t airtime = txjob->airtime;
+    ustime_t t0 = max(earliest, txjob->txtime);
+    ustime_t t = t0;
+
+    // DC governing this frame - mirrors region's canTx
+    int dcres = -1;
+    u4_t dcrate = 0;
+    if( !s2e_dcDisabled ) {
+        ustime_t dcfree = USTIME_MIN;
+        if( s2ctx->canTx == s2e_canTxEU868 ) {
+            dcres = freq2band(txjob->freq);
+            dcfree = s2ctx->txunits[txunit].dc_eu868bands[dcres];
+            dcrate = DC_EU868BAND_RATE[dcres];
+        }
+        else if( s2ctx->canTx == s2e_canTxPerChnlDC ) {
+            dcres = txjob->dnchnl;
+            dcfree = s2ctx->txunits[txunit].dc_perChnl[dcres];
+            dcrate = s2ctx->dc_chnlRate;
+        }
+        if( dcfree == USTIME_MAX ) {
+            LOG(MOD_S2E|VERBOSE, "%J %F - class C dropped - DC blocked", txjob, txjob->freq);
+            return 0;
+        }
+        if( dcfree == USTIME_MIN )
+            dcrate = 0;   // not tracked
+        else
+            t = max(t, dcfree);
+    }
+
+    txjob_t* head = txq_idx2job(&s2ctx->txq, s2ctx->txunits[txunit].head);
+    int devq = 0;
+    for( txjob_t* j = head; j; j = txq_nextJob(&s2ctx->txq, j) ) {
+        if( (j->txflags & TXFLAG_CLSC) && j->deveui == txjob->deveui ) {
+            devq += 1;
+            t = max(t, j->txtime + j->airtime + TX_MIN_GAP);
+        }
+    }
+    if( devq && CLASS_C_FAIRSHARE && devq % CLASS_C_FAIRSHARE == 0 )
+        t += airtime + TX_MIN_GAP;
+
+    // Queue is ordered by txtime - once a frame is passed only its end/DC expiry constrains the slot
+    ustime_t after = t;
+    for( txjob_t* j = head; j; j = txq_nextJob(&s2ctx->txq, j) ) {
+        ustime_t need = airtime + TX_MIN_GAP;
+        ustime_t jend = j->txtime + j->airtime + TX_MIN_GAP;
+        if( dcrate && (dcres == (s2ctx->canTx == s2e_canTxEU868 ? freq2band(j->freq) : j->dnchnl)) ) {
+            need = max(need, airtime * dcrate);
+            jend = max(jend, j->txtime + (ustime_t)j->airtime * dcrate);
+        }
+        after = max(after, jend);
+        if( t + need > j->txtime )
+            t = max(t, after);
+    }
+    if( t > t0 + CLASS_C_BACKOFF_MAX * CLASS_C_BACKOFF_BY ) {
+        LOG(MOD_S2E|VERBOSE, "%J - class C no TX slot within %~T (next %>.3T)",
+            txjob, CLASS_C_BACKOFF_MAX * CLASS_C_BACKOFF_BY, rt_ustime2utc(t));
+        return 0;
+    }
+    txjob->xtime += t - txjob->txtime;
+    txjob->txtime = t;
+    LOG(MOD_S2E|XDEBUG, "%J - class C paced by %~T (%d queued for device)", txjob, t - t0, devq);
+    return 1;
+}
+
+
 // Add a txjob to the TX queue and insert ordered by txtime.
 // Only basic exclusion constraints are checked for newly arriving txjobs:
 // Independent on antenna choice:
@@ -518,7 +708,6 @@ static int s2e_canTxPerChnlDC (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled)
 // to kick start s2e_nextTxAction
 //
 int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
-    ustime_t earliest = now + TX_AIM_GAP;
     u1_t txunit;
     if( !relocate ) {
         // txjob is fresh entry from LNS and not one that got reschduled due to TX conflicts
@@ -526,6 +715,7 @@ int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
         txunit = txjob->txunit = ral_rctx2txunit(txjob->rctx);
         txjob->altAnts = ral_altAntennas(txunit);
         updateAirtimeTxpow(s2ctx, txjob);
+        ustime_t earliest = now + s2ctx->txunits[txunit].aimGap;
 
         if( txtime > now + TX_MAX_AHEAD ) {
             LOG(MOD_S2E|WARNING, "%J - Tx job too far ahead: %~T", txjob, txtime-now);
@@ -540,22 +730,24 @@ int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
   check_alt: {
         u1_t alts = txjob->altAnts;
         if( alts==0 ) {
-            // No more alternative antennas - try later TX time
-            if( !altTxTime(s2ctx, txjob, earliest) ) {
+            // No more alternative antennas - try later TX time on the preferred antenna
+            txunit = txjob->txunit = ral_rctx2txunit(txjob->rctx);
+            if( !altTxTime(s2ctx, txjob, now + s2ctx->txunits[txunit].aimGap) ) {
                 LOG(MOD_S2E|WARNING, "%J - unable to place frame", txjob);
                 
                 return 0;
             }
             // and reset antenna options
-            txunit = txjob->txunit = ral_rctx2txunit(txjob->rctx);
             txjob->altAnts = ral_altAntennas(txunit);
         } else {
             // Try to find alternative antenna
             txunit = 0;
             while( (alts & (1<<txunit)) == 0 )
                 txunit += 1;
-            txjob->txunit = txunit;
             txjob->altAnts &= ~(1<<txunit);
+            if( txjob->txtime < now + s2ctx->txunits[txunit].aimGap )
+                goto check_alt;  // antenna needs more TX lead time
+            txjob->txunit = txunit;
         }
     }
   start: {
@@ -606,6 +798,7 @@ int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
 //
 ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
     ustime_t now = rt_getTime();
+    ustime_t aimGap = s2ctx->txunits[txunit].aimGap;
     txidx_t *phead = &s2ctx->txunits[txunit].head;
  again:
     if( phead[0] == TXIDX_END )
@@ -636,6 +829,7 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
             if( txs != TXSTATUS_EMITTING ) {
                 // Something went wrong - should be emitting
                 LOG(MOD_S2E|ERROR, "%J - radio is not emitting frame - abandoning TX, trying alternative", curr);
+                metrics.txFailed += 1;
                 ral_txabort(txunit);
                 curr->txflags &= ~TXFLAG_TXING;
                 goto check_alt;
@@ -659,17 +853,20 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
     if( txdelta < TX_MIN_GAP ) {
         // Missed TX start time - try alternative or drop frame
         LOG(MOD_S2E|ERROR, "%J - missed TX time: txdelta=%~T min=%~T", curr, txdelta, TX_MIN_GAP);
+        metrics.txMissed += 1;
       check_alt:
         txq_unqJob(&s2ctx->txq, phead);
-        if( !s2e_addTxjob(s2ctx, curr, /*relocate*/1, now) )  // note: might change queue head! (reload @ again)
+        if( !s2e_addTxjob(s2ctx, curr, /*relocate*/1, now) ) { // note: might change queue head! (reload @ again)
             txq_freeJob(&s2ctx->txq, curr);
+            metrics.txDropped += 1;
+        }
         goto again;
     }
     // Txtime time too far out Head is TXable - is it time to feed the radio?
-    if( txdelta > TX_AIM_GAP ) {
+    if( txdelta > aimGap ) {
         LOG(MOD_S2E|DEBUG, "%J - next TX start ahead by %~T (%>.6T)",
             curr, txdelta, rt_ustime2utc(curr->txtime));
-        return curr->txtime - TX_AIM_GAP;
+        return curr->txtime - aimGap;
     }
 
     // Re-calc exact xtime based on latest timesync data
@@ -719,16 +916,26 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
         curr->dr, s2e_dr2rps(s2ctx, curr->dr),
         curr->len, &s2ctx->txq.txdata[curr->off], curr->len);
 
+#if defined(CFG_ral_master_slave)
+    int txerr = ral_tx(curr, s2ctx, ccaDisabled);  // slave reports latency with its TX response
+#else
+    ustime_t t0 = rt_getTime();
     int txerr = ral_tx(curr, s2ctx, ccaDisabled);
+    s2e_txLatency(s2ctx, txunit, rt_getTime() - t0);
+#endif
     if( txerr != RAL_TX_OK ) {
         if( txerr == RAL_TX_NOCA ) {
             LOG(MOD_S2E|ERROR, "%J - channel busy - trying alternative", curr);
+            metrics.txNoCA += 1;
         } else {
             LOG(MOD_S2E|ERROR, "%J - radio layer failed to TX - trying alternative", curr);
+            metrics.txFailed += 1;
         }
         goto check_alt;
     }
     curr->txflags |= TXFLAG_TXING;
+    metrics.txStarted += 1;
+    metrics.txAirtime += curr->airtime;
 
     // Unqueue all overlapping subsequent txjobs and find alternatives (antenna/txtime)
     // If no alternatives drop txjob.
@@ -857,6 +1064,13 @@ inline static void upch_insert (chdefl_t* upchs, uint idx, u4_t freq, u1_t bw, u
     upchs->rps[idx].maxSF = maxSF;
 }
 
+// All radios configured by router_config are up (or gave up) - station is ready
+static void s2e_radioStarted (tmr_t* tmr) {
+    s2ctx_t* s2ctx = (s2ctx_t*)tmr->ctx;
+    if( !s2ctx->linkDown )
+        sys_inState(SYSIS_TC_CONNECTED);
+}
+
 static int handle_router_config (s2ctx_t* s2ctx, ujdec_t* D) {
     char hwspec[MAX_HWSPEC_SIZE] = { 0 };
     ujbuf_t sx130xconf = { .buf=NULL };
@@ -1197,7 +1411,7 @@ static int handle_router_config (s2ctx_t* s2ctx, ujdec_t* D) {
     }
     LOG(MOD_S2E|INFO, "Configuring for region: %s%s -- %F..%F",
         s2ctx->region_s, s2ctx->ccaEnabled ? " (CCA)":"", s2ctx->min_freq, s2ctx->max_freq);
-    if( log_shallLog(MOD_S2E|INFO) ) {
+    if( LOG_ENABLED(MOD_S2E|INFO) ) {
         for( int dr=0; dr<16; dr++ ) {
             int rps = s2ctx->dr_defs[dr];
             if( rps == RPS_ILLEGAL ) {
@@ -1494,7 +1708,7 @@ void handle_dnmsg (s2ctx_t* s2ctx, ujdec_t* D) {
                 LOG(MOD_S2E|WARNING, "Ignoring 'dnmsg' with neither RX1/RX2 frequencies");
                 return;
             }
-            if( !altTxTime(s2ctx, txjob, now+TX_AIM_GAP) ) {
+            if( !altTxTime(s2ctx, txjob, now+s2ctx->txunits[txjob->txunit].aimGap) ) {
                 LOG(MOD_S2E|WARNING, "Ignoring 'dnmsg' with no viable RX2");
                 return;
             }
@@ -1640,6 +1854,202 @@ void handle_dnsched (s2ctx_t* s2ctx, ujdec_t* D) {
 }
 
 
+// Bulk downlink for multicast/FUOTA campaigns:
+//   {"msgtype":"dnbulk", "pdus":[HEX,..], "frames":[{"pdu":INDEX, "DR":.., "Freq":.., ..},..]}
+// Payloads are listed once in 'pdus' (must precede 'frames') and frames refer to them by index.
+// Repeated payloads are decoded once and occupy TX data space only once.
+// Frames are filled into free txjobs while parsing and are committed and scheduled as a group
+// after the whole message has been parsed - a malformed message does not leave partial state.
+// A frame is timed by 'xtime', 'gpstime' (class B) or neither (class C - next free slot).
+//
+void handle_dnbulk (s2ctx_t* s2ctx, ujdec_t* D) {
+    ustime_t now = rt_getTime();
+    txoff_t  pduoff[MAX_TXJOBS];
+    u1_t     pdulen[MAX_TXJOBS];
+    u1_t     pduused[MAX_TXJOBS];
+    txjob_t* frames[MAX_TXJOBS];
+    u1_t     framepdu[MAX_TXJOBS];
+    int npdus = 0, nframes = 0, ndata = 0, nskipped = 0;
+    ujcrc_t field;
+    while( (field = uj_nextField(D)) ) {
+        switch(field) {
+        case J_msgtype: {
+            uj_skipValue(D);
+            break;
+        }
+        case J_MuxTime: {
+            s2e_updateMuxtime(s2ctx, uj_num(D), now);
+            break;
+        }
+        case J_pdus: {
+            if( npdus || nframes )
+                uj_error(D, "Field 'pdus' must occur once and before 'frames' in 'dnbulk'");
+            int slot;
+            uj_enterArray(D);
+            while( (slot = uj_nextSlot(D)) >= 0 ) {
+                if( npdus == MAX_TXJOBS )
+                    uj_error(D, "Too many pdus in 'dnbulk' message (max %d)", MAX_TXJOBS);
+                uj_str(D);
+                int xlen = min(D->str.len/2, 255);
+                u1_t* p = txq_reserveData(&s2ctx->txq, ndata + xlen);
+                if( p == NULL )
+                    uj_error(D, "Out of TX data space");
+                pdulen[npdus] = uj_hexstr(D, p + ndata, xlen);
+                pduoff[npdus] = ndata;
+                pduused[npdus] = 0;
+                ndata += pdulen[npdus];
+                npdus += 1;
+            }
+            uj_exitArray(D);
+            break;
+        }
+        case J_frames: {
+            int slot;
+            uj_enterArray(D);
+            while( (slot = uj_nextSlot(D)) >= 0 ) {
+                txjob_t* txjob = txq_reserveNextJob(&s2ctx->txq, nframes ? frames[nframes-1] : NULL);
+                if( txjob == NULL ) {
+                    nskipped += 1;
+                    uj_skipValue(D);
+                    continue;
+                }
+                int flags = 0;
+                uj_enterObject(D);
+                while( (field = uj_nextField(D)) ) {
+                    switch(field) {
+                    case J_DevEUI:
+                    case J_DevEui: {
+                        txjob->deveui = uj_eui(D);
+                        break;
+                    }
+                    case J_diid: {
+                        txjob->diid = uj_int(D);
+                        break;
+                    }
+                    case J_priority: {
+                        txjob->prio = uj_intRange(D, 0, 255);
+                        break;
+                    }
+                    case J_DR: {
+                        check_dr(s2ctx, D, &txjob->dr);
+                        flags |= 0x01;
+                        break;
+                    }
+                    case J_Freq: {
+                        check_dnfreq(s2ctx, D, &txjob->freq, &txjob->dnchnl);
+                        flags |= 0x02;
+                        break;
+                    }
+                    case J_pdu: {
+                        framepdu[nframes] = uj_intRange(D, 0, npdus-1);
+                        flags |= 0x04;
+                        break;
+                    }
+                    case J_xtime: {
+                        txjob->xtime = uj_int(D);
+                        break;
+                    }
+                    case J_gpstime: {  // GPS microseconds
+                        txjob->gpstime = uj_uint(D);
+                        break;
+                    }
+                    case J_rctx: {
+                        txjob->rctx = uj_int(D);
+                        flags |= 0x08;
+                        break;
+                    }
+                    case J_preamble: {
+                        txjob->preamble = uj_uint(D);
+                        break;
+                    }
+                    case J_addcrc: {
+                        txjob->addcrc = uj_uint(D);
+                        break;
+                    }
+                    default: {
+                        LOG(MOD_S2E|WARNING, "Unknown field in dnbulk.frames[%d] - ignored: %s", slot, D->field.name);
+                        uj_skipValue(D);
+                        break;
+                    }
+                    }
+                }
+                uj_exitObject(D);
+                if( (flags & 0x07) != 0x07 ) {
+                    LOG(MOD_S2E|WARNING, "Some mandatory fields in dnbulk.frames[%d] are missing (flags=0x%X)", slot, flags);
+                    continue;  // txjob is reused for next frame
+                }
+                if( (flags & 0x08) == 0 && txjob->xtime )
+                    txjob->rctx = ral_xtime2rctx(txjob->xtime);
+                txjob->len = pdulen[framepdu[nframes]];
+                pduused[framepdu[nframes]] = 1;
+                frames[nframes++] = txjob;
+            }
+            uj_exitArray(D);
+            break;
+        }
+        default: {
+            LOG(MOD_S2E|WARNING, "Unknown field in dnbulk - ignored: %s", D->field.name);
+            uj_skipValue(D);
+            break;
+        }
+        }
+    }
+    if( nskipped )
+        LOG(MOD_S2E|ERROR, "Out of TX jobs - dropped %d frames of 'dnbulk' message", nskipped);
+
+    // Squeeze out payloads no frame refers to and commit the rest as one block
+    u1_t* data = txq_reserveData(&s2ctx->txq, 0);
+    int used = 0;
+    for( int i=0; i<npdus; i++ ) {
+        if( !pduused[i] )
+            continue;
+        memmove(data + used, data + pduoff[i], pdulen[i]);
+        pduoff[i] = used;
+        used += pdulen[i];
+    }
+    txoff_t off = txq_commitData(&s2ctx->txq, used);
+    for( int i=0; i<nframes; i++ )
+        txq_commitJobData(&s2ctx->txq, frames[i], off + pduoff[framepdu[i]]);
+
+    int nqueued = 0;
+    for( int i=0; i<nframes; i++ ) {
+        txjob_t* txjob = frames[i];
+        u1_t txunit = txjob->txunit = ral_rctx2txunit(txjob->rctx);
+        if( txjob->gpstime ) {
+            txjob->xtime = ts_gpstime2xtime(txunit, txjob->gpstime);
+            txjob->txtime = ts_xtime2ustime(txjob->xtime);
+            txjob->txflags = TXFLAG_PING;
+        }
+        else if( txjob->xtime ) {
+            txjob->txtime = ts_xtime2ustime(txjob->xtime);
+            txjob->txflags = TXFLAG_CLSA;
+        }
+        else {
+            // Class C - altTxTime switches over to RX2 params and finds a slot
+            txjob->txflags = TXFLAG_CLSC;
+            txjob->rx2freq = txjob->freq;
+            txjob->rx2dr   = txjob->dr;
+            txjob->dnchnl2 = txjob->dnchnl;
+            if( !altTxTime(s2ctx, txjob, now+s2ctx->txunits[txunit].aimGap) ) {
+                txq_freeJob(&s2ctx->txq, txjob);
+                continue;
+            }
+        }
+        if( txjob->xtime == 0 || txjob->txtime == 0 ) {
+            LOG(MOD_S2E|ERROR, "%J - dropped due to time conversion problems (MCU/GPS out of sync, obsolete input) - xtime=%ld", txjob, txjob->xtime);
+            txq_freeJob(&s2ctx->txq, txjob);
+            continue;
+        }
+        if( !s2e_addTxjob(s2ctx, txjob, /*initial placement*/0, now) ) {
+            txq_freeJob(&s2ctx->txq, txjob);
+            continue;
+        }
+        nqueued += 1;
+    }
+    LOG(MOD_S2E|INFO, "DNBULK %d/%d frames queued - %d bytes TX data for %d payloads",
+        nqueued, nframes+nskipped, used, npdus);
+}
+
 void handle_timesync (s2ctx_t* s2ctx, ujdec_t* D) {
     ustime_t rxtime = rt_getTime();
     ustime_t txtime = 0;
@@ -1677,8 +2087,10 @@ void handle_timesync (s2ctx_t* s2ctx, ujdec_t* D) {
     }
     if( xtime )
         ts_setTimesyncLns(xtime, gpstime);
-    if( txtime && gpstime )
+    if( txtime && gpstime ) {
+        metrics_observe(MH_LNS_RTT, (rxtime - txtime)/1e6);
         ts_processTimesyncLns(txtime, rxtime, gpstime);
+    }
 }
 
 
@@ -1791,7 +2203,7 @@ int s2e_onMsg (s2ctx_t* s2ctx, char* json, ujoff_t jsonlen) {
         LOG(MOD_S2E|ERROR, "Parsing of JSON message failed - ignored");
         return 1;   // return fail? would trigger a reconnect
     }
-    if( s2ctx->region == 0 && (msgtype == J_dnmsg || msgtype == J_dnsched || msgtype == J_dnframe) ) {
+    if( s2ctx->region == 0 && (msgtype == J_dnmsg || msgtype == J_dnsched || msgtype == J_dnbulk || msgtype == J_dnframe) ) {
         // Might happen if messages are still queued
         LOG(MOD_S2E|WARNING, "Received '%.*s' before 'router_config' - dropped", D.str.len, D.str.beg);
         return 1;
@@ -1808,7 +2220,7 @@ int s2e_onMsg (s2ctx_t* s2ctx, char* json, ujoff_t jsonlen) {
     }
     case J_router_config: {
         ok = handle_router_config(s2ctx, &D);
-        if( ok ) sys_inState(SYSIS_TC_CONNECTED);
+        if( ok ) ral_onStarted(&s2ctx->radiotimer, s2e_radioStarted);
         break;
     }
     case J_dnframe: {
@@ -1824,6 +2236,10 @@ int s2e_onMsg (s2ctx_t* s2ctx, char* json, ujoff_t jsonlen) {
         handle_dnsched(s2ctx, &D);
         break;
     }
+    case J_dnbulk: {
+        handle_dnbulk(s2ctx, &D);
+        break;
+    }
     case J_timesync: {
         handle_timesync(s2ctx, &D);
         break;
@@ -1840,6 +2256,10 @@ int s2e_onMsg (s2ctx_t* s2ctx, char* json, ujoff_t jsonlen) {
         s2e_handleRmtsh(s2ctx, &D);
         break;
     }
+    case J_rmtlog: {
+        s2e_handleRmtlog(s2ctx, &D);
+        break;
+    }
     case J_error: {
         ujcrc_t  field;
         while( (field = uj_nextField(&D)) ) {
@@ -93,6 +93,10 @@ enum { DR_ILLEGAL = 16 };
 typedef struct s2txunit {
     ustime_t dc_eu868bands[DC_NUM_BANDS];
     ustime_t dc_perChnl[MAX_DNCHNLS+1];
+    ustime_t aimGap;            // TX lead time - TX_AIM_GAP adapted to measured radio latency
+    double   txlatQ;            // running TX_AIM_ADAPT quantile of ral_tx latency (us)
+    double   txlatDev;          // running mean absolute deviation from txlatQ (us)
+    u4_t     txlatCnt;          // samples seen
     txidx_t  head;
     tmr_t    timer;
 } s2txunit_t;
@@ -134,6 +138,10 @@ typedef struct s2ctx {
     s2txunit_t txunits[MAX_TXUNITS];
     s2bcn_t    bcn;      // beacon definition
     tmr_t      bcntimer;
+    tmr_t      spooltimer; // paces replay of spooled uplinks
+    ustime_t   spoolReplayAt; // earliest time for next spooled uplink
+    tmr_t      radiotimer; // signals readiness once radios are up
+    u1_t       linkDown; // connection to LNS lost - divert uplinks to spool
 
 } s2ctx_t;
 
@@ -161,6 +169,7 @@ void     s2e_flushRxjobs  (s2ctx_t*);
 int      s2e_onMsg        (s2ctx_t*, char* json, ujoff_t jsonlen);
 int      s2e_onBinary     (s2ctx_t*, u1_t* data, ujoff_t datalen);
 ustime_t s2e_nextTxAction (s2ctx_t*, u1_t txunit);
+void     s2e_txLatency    (s2ctx_t*, u1_t txunit, ustime_t latency);
 int      s2e_handleCommands (ujcrc_t msgtype, s2ctx_t* s2ctx, ujdec_t* D);
 void     s2e_handleRmtsh    (s2ctx_t* s2ctx, ujdec_t* D);
 
@@ -0,0 +1,173 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+#include "ral.h"
+
+#define MAXCOFF_125 (( 925000 - 125000)/2)
+#define MAXCOFF_250 ((1000000 - 250000)/2)
+#define MAXCOFF_500 ((1100000 - 500000)/2)
+
+typedef struct {
+    int       started, done;
+    int       nch;                      // channels allocated
+    int       chips;                    // chips with channels
+    u1_t      used[MAX_130X][10];       // modem slots taken
+    u4_t      rff_freq[MAX_130X][2];
+    chdefl_t* upchs;
+    u1_t      seen[MAX_UPCHNLS];
+} allocres_t;
+
+static void check_cb (void* ctx, challoc_t* ch, int flag) {
+    allocres_t* R = ctx;
+    switch( flag ) {
+    case CHALLOC_START: {
+        TCHECK(!R->started);
+        R->started = 1;
+        break;
+    }
+    case CHALLOC_CHIP_START: {
+        TCHECK(R->started && !R->done);
+        break;
+    }
+    case CHALLOC_CH: {
+        int chip = ch->chip, chan = ch->chan, rff = ch->rff;
+        TCHECK(chip < MAX_130X && chan < 10 && !R->used[chip][chan]);
+        R->used[chip][chan] = 1;
+        // Same center frequency reported for all channels of a frontend
+        TCHECK(R->rff_freq[chip][rff] == 0 || R->rff_freq[chip][rff] == ch->rff_freq);
+        R->rff_freq[chip][rff] = ch->rff_freq;
+        s4_t coff = abs((s4_t)(ch->chdef.freq - ch->rff_freq));
+        if( ch->chdef.rps.maxSF == FSK ) {
+            TCHECK(chan == 9 && coff <= MAXCOFF_125);
+        } else if( ch->chdef.rps.bw == BW125 ) {
+            TCHECK(chan < 8 && coff <= MAXCOFF_125);
+        } else {
+            TCHECK(chan == 8 && coff <= (ch->chdef.rps.bw == BW250 ? MAXCOFF_250 : MAXCOFF_500));
+        }
+        int found = 0;
+        for( int i=0; i < MAX_UPCHNLS; i++ ) {
+            if( R->upchs->freq[i] == ch->chdef.freq && !R->seen[i] ) {
+                R->seen[i] = found = 1;
+                break;
+            }
+        }
+        TCHECK(found);
+        R->nch += 1;
+        break;
+    }
+    case CHALLOC_CHIP_DONE: {
+        int n = 0;
+        for( int i=0; i < 10; i++ )
+            n += R->used[ch->chipid][i];
+        TCHECK(n == ch->chans);
+        if( n ) {
+            R->chips += 1;
+            TCHECK(ch->minFreq <= ch->maxFreq);
+        }
+        break;
+    }
+    case CHALLOC_DONE: {
+        TCHECK(R->started && !R->done);
+        R->done = 1;
+        break;
+    }
+    }
+}
+
+static void addChannels (chdefl_t* upchs, u4_t freq, u4_t step, int n, int bw, int minSF, int maxSF) {
+    int i = 0;
+    while( i < MAX_UPCHNLS && upchs->freq[i] )
+        i++;
+    for( ; n > 0 && i < MAX_UPCHNLS; n--, i++, freq += step ) {
+        upchs->freq[i] = freq;
+        upchs->rps[i] = (struct chrps) { .minSF = minSF, .maxSF = maxSF, .bw = bw };
+    }
+}
+
+static void checkAlloc (chdefl_t* upchs, int expChannels, int expChips) {
+    allocres_t R = { .upchs = upchs };
+    TCHECK(ral_challoc(upchs, check_cb, &R));
+    TCHECK(R.done);
+    TCHECK(R.nch == expChannels);
+    TCHECK(R.chips == expChips);
+}
+
+
+void selftest_challoc () {
+    if( MAX_130X < 8 )
+        return;
+    chdefl_t upchs;
+
+    // US915 - 64 x 125kHz + 8 x 500kHz
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 902300000, 200000, 64, BW125, SF10, SF7);
+    addChannels(&upchs, 903000000, 1600000, 8, BW500, SF8, SF8);
+    checkAlloc(&upchs, 72, 8);
+
+    // US915 sub-band 2 - typical 8 channel gateway
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 903900000, 200000, 8, BW125, SF10, SF7);
+    addChannels(&upchs, 904600000, 0, 1, BW500, SF8, SF8);
+    checkAlloc(&upchs, 9, 1);
+
+    // AU915 - 64 x 125kHz + 8 x 500kHz
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 915200000, 200000, 64, BW125, SF12, SF7);
+    addChannels(&upchs, 915900000, 1600000, 8, BW500, SF8, SF8);
+    checkAlloc(&upchs, 72, 8);
+
+    // CN470 - 48 channel gateway
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 470300000, 200000, 48, BW125, SF12, SF7);
+    checkAlloc(&upchs, 48, 6);
+
+    // CN470 - more channels than chips - fill all chips
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 470300000, 200000, MAX_UPCHNLS, BW125, SF12, SF7);
+    checkAlloc(&upchs, 8*MAX_130X, MAX_130X);
+
+    // Frequencies not in order - 125kHz channels split across both frontends
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 869300000, -400000, 4, BW125, SF12, SF7);
+    addChannels(&upchs, 867600000, 0, 1, BW125, FSK, FSK);
+    // Greedy fill puts 868.1..868.9 on frontend 0 and 869.3 on frontend 1 which leaves no room
+    // for FSK at 867.6 and needs a second chip. Split 867.6/868.1 + 868.5..869.3 fits one chip.
+    checkAlloc(&upchs, 5, 1);
+
+    // Same with a fast LoRa channel
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 868100000, 400000, 4, BW125, SF12, SF7);
+    addChannels(&upchs, 867800000, 0, 1, BW250, SF7, SF7);
+    checkAlloc(&upchs, 5, 1);
+
+    // Channels too far apart for one chip
+    memset(&upchs, 0, sizeof(upchs));
+    addChannels(&upchs, 863100000, 2000000, 3, BW125, SF12, SF7);
+    checkAlloc(&upchs, 3, 2);
+}
@@ -0,0 +1,93 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include "selftests.h"
+#include "rt.h"
+
+
+static void test_levels () {
+    TCHECK(log_str2level("3") == (INFO|MOD_ALL));
+    TCHECK(log_str2level("DEBUG") == (DEBUG|MOD_ALL));
+    TCHECK(log_str2level("ral:xdeb") == (MOD_RAL|XDEBUG));
+    TCHECK(log_str2level("xyz:INFO") == -1);
+    TCHECK(log_str2level("LOUD") == -1);
+
+    TCHECK(log_parseLevels("ERROR,S2E:DEBUG,RAL:VERB") == NULL);
+    for( int ml=0; ml < 256; ml++ ) {
+        int mod = ml & MOD_ALL, lvl = ml & 7;
+        int exp = mod == MOD_S2E ? lvl >= DEBUG : mod == MOD_RAL ? lvl >= VERBOSE : lvl >= ERROR;
+        TCHECK(log_shallLog(ml) == exp);
+    }
+    TCHECK(log_setLevel(MOD_RAL|NOTICE) == VERBOSE);
+    TCHECK(!log_shallLog(MOD_RAL|INFO) && log_shallLog(MOD_RAL|NOTICE));
+    TCHECK(log_setLevel(MOD_ALL|XDEBUG) == -1);
+    for( int ml=0; ml < 256; ml++ )
+        TCHECK(log_shallLog(ml));
+    str_t bad = "WARN,GPS:XXX";
+    TCHECK(log_parseLevels(bad) == bad+5);
+}
+
+
+// Cost of disabled debug log statements in the RX path
+static volatile int sink;
+
+static void bench_disabled () {
+    enum { ROUNDS = 1000000 };
+    log_setLevel(MOD_ALL|INFO);
+    ustime_t t0 = rt_getTime();
+    for( int i=0; i < ROUNDS; i++ ) {
+        LOG(MOD_RAL|XDEBUG, "RX %F %R snr=%.1f rssi=%d", 868100000+i, i&0x1F, (i&0xFF)/4.0, -i&0x7F);
+        LOG(MOD_S2E|DEBUG, "RX %F DR%d xtime=0x%lX", 868100000+i, i%6, (sL_t)i<<20);
+        sink += i;
+    }
+    ustime_t tmacro = rt_getTime() - t0;
+    t0 = rt_getTime();
+    for( int i=0; i < ROUNDS; i++ ) {
+        // Arguments evaluated and checked inside the call
+        log_msg(MOD_RAL|XDEBUG, "RX %F %R snr=%.1f rssi=%d", 868100000+i, i&0x1F, (i&0xFF)/4.0, -i&0x7F);
+        log_msg(MOD_S2E|DEBUG, "RX %F DR%d xtime=0x%lX", 868100000+i, i%6, (sL_t)i<<20);
+        sink += i;
+    }
+    ustime_t tcall = rt_getTime() - t0;
+    fprintf(stderr, "log bench: %d disabled log pairs - LOG %.2fns, log_msg call %.2fns per pair\n",
+            ROUNDS, tmacro*1e3/ROUNDS, tcall*1e3/ROUNDS);
+}
+
+
+void selftest_log () {
+    u1_t saved[16];
+    for( int m=0; m < 16; m++ ) {
+        saved[m] = log_setLevel(m<<3);
+        log_setLevel((m<<3) | saved[m]);
+    }
+    test_levels();
+    bench_disabled();
+    for( int m=0; m < 16; m++ )
+        log_setLevel((m<<3) | saved[m]);
+}
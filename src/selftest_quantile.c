@@ -0,0 +1,106 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include "selftests.h"
+#include "quantile.h"
+
+// Deterministic test data - independent of any seeding of rand()
+static u4_t rndState = 0x2545F491;
+static int rnd () {
+    rndState ^= rndState << 13;
+    rndState ^= rndState >> 17;
+    rndState ^= rndState << 5;
+    return rndState & 0x7FFFFFFF;
+}
+
+static int cmp_s4 (const void* a, const void* b) {
+    s4_t va = *(s4_t*)a, vb = *(s4_t*)b;
+    return va < vb ? -1 : va > vb;
+}
+
+// Feed a window (reusing w across windows) and compare against selection from a sorted copy.
+// Quantiles beyond the binned range are reported as the window maximum.
+static void check_window (wquant_t* w, s4_t* v, int n) {
+    wq_reset(w);
+    for( int i=0; i<n; i++ )
+        TCHECK(wq_add(w, v[i]) == i+1);
+    qsort(v, n, sizeof(v[0]), cmp_s4);
+    TCHECK(wq_min(w) == v[0]);
+    TCHECK(wq_max(w) == v[n-1]);
+    for( int p=0; p<=100; p+=5 ) {
+        s4_t q = v[min((p*n+50)/100, n-1)];
+        TCHECK(wq_quantile(w, p) == (q >= WQ_RANGE-1 ? v[n-1] : q));
+    }
+}
+
+static s4_t v[5000];
+
+void selftest_quantile () {
+    static wquant_t w;
+    wq_ini(&w);
+    TCHECK(wq_quantile(&w, 90) == 0 && wq_min(&w) == 0 && wq_max(&w) == 0);
+    wq_add(&w, 7);
+    wq_add(&w, -3);   // counts as 0
+    wq_add(&w, 5);
+    TCHECK(wq_min(&w) == 0 && wq_max(&w) == 7);
+    TCHECK(wq_quantile(&w, 90) == 7);
+    TCHECK(wq_quantile(&w, 30) == 5);
+    TCHECK(wq_quantile(&w, 0) == 0);
+    wq_reset(&w);
+    TCHECK(w.cnt == 0);
+    for( int b=0; b<WQ_RANGE; b++ )
+        TCHECK(w.bins[b] == 0);
+
+    for( int k=0; k<200; k++ ) {
+        int n = 1 + (k * 37) % (k < 150 ? 64 : SIZE_ARRAY(v));
+        // Uniform
+        for( int i=0; i<n; i++ ) v[i] = rnd() % 200;
+        check_window(&w, v, n);
+        // Heavy tail - like drift samples with occasional outliers beyond the binned range
+        for( int i=0; i<n; i++ ) v[i] = rnd() % 8 == 0 ? rnd() % 100000 : rnd() % 50;
+        check_window(&w, v, n);
+        // Mostly beyond the binned range
+        for( int i=0; i<n; i++ ) v[i] = WQ_RANGE - 4 + rnd() % 8;
+        check_window(&w, v, n);
+        // Descending and constant
+        for( int i=0; i<n; i++ ) v[i] = n-i;
+        check_window(&w, v, n);
+        for( int i=0; i<n; i++ ) v[i] = 42;
+        check_window(&w, v, n);
+    }
+    // Timesync window sizes with the rank used for its thresholds
+    wq_reset(&w);
+    for( int i=19; i>=0; i-- ) wq_add(&w, i);
+    TCHECK(wq_quantile(&w, 90) == 18 && wq_quantile(&w, 80) == 16 && wq_quantile(&w, 50) == 10);
+    // Window size does not matter
+    wq_reset(&w);
+    for( int i=0; i<60000; i++ )
+        wq_add(&w, i % 100);
+    TCHECK(wq_quantile(&w, 90) == 90 && wq_quantile(&w, 50) == 50 && wq_max(&w) == 99);
+}
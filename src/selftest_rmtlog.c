@@ -0,0 +1,251 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+#include "s2conf.h"
+#include "s2e.h"
+#include "rmtlog.h"
+
+static s2ctx_t ctx;
+static char    sbuf[4096];
+static int     wsBusy;
+static char    stream[16384];   // text received through binary frames
+static int     streamLen;
+static int     nframes;
+static char    reply[512];      // last text message
+static int     logOnGetbuf;     // lines logged while handing out the send buffer
+
+static void addLines (str_t prefix, int from, int n, int stream);
+
+static dbuf_t t_getSendbuf (s2ctx_t* s2ctx, int minsize) {
+    dbuf_t b = { .buf=NULL, .bufsize=0, .pos=0 };
+    if( logOnGetbuf ) {
+        int n = logOnGetbuf;
+        logOnGetbuf = 0;
+        addLines("E-logged-in-getSendbuf-", 0, n, 1);
+    }
+    if( !wsBusy && minsize <= sizeof(sbuf) ) {
+        b.buf = sbuf;
+        b.bufsize = sizeof(sbuf);
+    }
+    return b;
+}
+
+static void t_sendBinary (s2ctx_t* s2ctx, dbuf_t* b) {
+    TCHECK(b->pos > 1 && (u1_t)b->buf[0] == RMTLOG_CHANNEL);
+    TCHECK(streamLen + b->pos-1 <= sizeof(stream));
+    memcpy(stream + streamLen, b->buf+1, b->pos-1);
+    streamLen += b->pos-1;
+    nframes += 1;
+}
+
+static void t_sendText (s2ctx_t* s2ctx, dbuf_t* b) {
+    snprintf(reply, sizeof(reply), "%.*s", b->pos, b->buf);
+}
+
+static void resetStream () {
+    streamLen = nframes = 0;
+}
+
+static void addLines (str_t prefix, int from, int n, int stream) {
+    char line[64];
+    for( int i=from; i < from+n; i++ ) {
+        int len = snprintf(line, sizeof(line), "%s%04d\n", prefix, i);
+        rmtlog_addLine(line, len, stream);
+    }
+}
+
+static int streamed (str_t text) {
+    return streamLen == strlen(text) && memcmp(stream, text, streamLen) == 0;
+}
+
+static void onMsg (str_t json) {
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), "%s", json);
+    reply[0] = 0;
+    s2e_onMsg(&ctx, buf, n);
+}
+
+
+static void test_backfill () {
+    addLines("B", 0, 1000, 0);   // ring of 4K holds the last 512 records of 8 bytes
+    resetStream();
+    TCHECK(rmtlog_enable(&ctx, "S2E:DEBUG", 100000, 65536, 80));
+    rmtlog_pump(rt_getTime());
+    TCHECK(streamed("B0990\nB0991\nB0992\nB0993\nB0994\nB0995\nB0996\nB0997\nB0998\nB0999\n"));
+    TCHECK(nframes == 1);
+
+    // Live lines - only those selected by remote levels are streamed
+    resetStream();
+    addLines("L", 0, 2, 0);
+    addLines("S", 0, 2, 1);
+    rmtlog_pump(rt_getTime());
+    TCHECK(streamed("S0000\nS0001\n"));
+
+    // Levels are applied on top of local levels
+    TCHECK(log_shallLog(MOD_S2E|DEBUG) && !log_shallLog(MOD_S2E|XDEBUG));
+    TCHECK(!log_shallLog(MOD_RAL|DEBUG) && log_shallLog(MOD_RAL|INFO));
+    resetStream();
+    LOG(MOD_S2E|DEBUG, "remote only %d", 42);
+    LOG(MOD_RAL|DEBUG, "nowhere %d", 43);
+    rmtlog_pump(rt_getTime());
+    TCHECK(streamLen > 0 && stream[streamLen-1] == '\n');
+    TCHECK(strstr(stream, "[S2E:DEBU] remote only 42\n") != NULL && !strstr(stream, "nowhere"));
+
+    // WS send buffer busy - keep lines
+    resetStream();
+    wsBusy = 1;
+    addLines("W", 0, 1, 1);
+    rmtlog_pump(rt_getTime());
+    TCHECK(nframes == 0);
+    wsBusy = 0;
+    rmtlog_pump(rt_getTime());
+    TCHECK(streamed("W0000\n"));
+    rmtlog_disable();
+    TCHECK(!log_shallLog(MOD_S2E|DEBUG));
+}
+
+
+static void test_ratelimit () {
+    TCHECK(rmtlog_enable(&ctx, "DEBUG", 1000, 2000, 0));
+    ustime_t t0 = rt_getTime();
+    resetStream();
+    addLines("R-rate-limited-remote-log-line-", 0, 60, 1);   // 36 bytes per line
+    rmtlog_pump(t0);
+    int sent = streamLen + nframes;
+    TCHECK(sent <= 2000 && sent > 2000 - 2*LOGLINE_LEN);
+    rmtlog_pump(t0 + rt_millis(500));
+    TCHECK(streamLen + nframes <= 2500);
+    rmtlog_pump(t0 + rt_seconds(1));
+    sent = streamLen + nframes;
+    TCHECK(sent <= 3000 && sent > 3000 - 2*LOGLINE_LEN);
+    rmtlog_pump(t0 + rt_seconds(10));
+    TCHECK(streamLen == 60*36);
+    TCHECK(memcmp(stream + streamLen - 36, "R-rate-limited-remote-log-line-0059\n", 36) == 0);
+
+    // Overflow of ring while rate limited - oldest lines dropped and reported
+    resetStream();
+    addLines("D-dropped-when-ring-overflows-----", 0, 200, 1);   // 39 bytes per line: 200*41 > 4K ring
+    for( int k=1; k <= 10; k++ )
+        rmtlog_pump(t0 + rt_seconds(100*k));
+    char* eol = memchr(stream, '\n', streamLen);
+    TCHECK(eol != NULL && strstr(stream, "Remote log:") != NULL && strstr(stream, "Remote log:") < eol);
+    int ndropped = atoi(strstr(stream, "Remote log:") + 12);
+    int nlines = 0;
+    for( char* p = eol+1; p < stream+streamLen; p++ )
+        nlines += *p == '\n';
+    TCHECK(ndropped > 0 && ndropped + nlines == 200);
+    TCHECK(memcmp(stream + streamLen - 39, "D-dropped-when-ring-overflows-----0199\n", 39) == 0);
+    rmtlog_disable();
+}
+
+
+// Lines logged from inside getSendbuf evict records the frame was sized for
+static void test_logDuringSend () {
+    TCHECK(rmtlog_enable(&ctx, "DEBUG", 1000000, 65536, 0));
+    resetStream();
+    addLines("A-before-send-----", 0, 50, 1);      // 23+2 bytes per record
+    logOnGetbuf = 150;                              // 28+2 bytes per record - 150+50 overflow a 4K ring
+    for( int k=0; k < 10; k++ )
+        rmtlog_pump(rt_getTime());
+    TCHECK(streamLen > 0 && stream[streamLen-1] == '\n');
+    // Every line must be complete and genuine - no stale ring bytes
+    int nlines = 0, ndropped = 0;
+    for( char* p = stream; p < stream+streamLen; ) {
+        char* eol = memchr(p, '\n', stream+streamLen-p);
+        TCHECK(eol != NULL);
+        if( eol == NULL )
+            break;
+        int len = eol+1-p;
+        if( len == 23 && memcmp(p, "A-before-send-----", 18) == 0 ) {
+            nlines += 1;
+        } else if( len == 28 && memcmp(p, "E-logged-in-getSendbuf-", 23) == 0 ) {
+            nlines += 1;
+        } else {
+            *eol = 0;
+            char* r = strstr(p, "Remote log: ");
+            *eol = '\n';
+            TCHECK(r != NULL);
+            if( r )
+                ndropped += atoi(r+12);
+        }
+        p = eol+1;
+    }
+    TCHECK(ndropped > 0 && ndropped + nlines == 200);
+    TCHECK(memcmp(stream + streamLen - 28, "E-logged-in-getSendbuf-0149\n", 28) == 0);
+    rmtlog_disable();
+}
+
+
+static void test_msg () {
+    onMsg("{\"msgtype\":\"rmtlog\",\"enable\":true,\"levels\":\"XYZ:DEBUG\"}");
+    TCHECK(strstr(reply, "\"enable\":false") != NULL);
+    TCHECK(!log_shallLog(MOD_S2E|DEBUG));
+
+    onMsg("{\"msgtype\":\"rmtlog\",\"enable\":true,\"levels\":\"S2E:DEBUG\",\"rate\":500,\"burst\":999999}");
+    TCHECK(strstr(reply, "\"enable\":true") != NULL);
+    TCHECK(strstr(reply, "\"rate\":500") != NULL);
+    TCHECK(strstr(reply, "\"burst\":65536") != NULL);   // capped by RMTLOG_BURST
+    TCHECK(log_shallLog(MOD_S2E|DEBUG));
+
+    // Closing LNS session stops streaming
+    rmtlog_onClose(&ctx);
+    TCHECK(!log_shallLog(MOD_S2E|DEBUG));
+    onMsg("{\"msgtype\":\"rmtlog\",\"enable\":true}");
+    TCHECK(strstr(reply, "\"enable\":true") != NULL);
+    onMsg("{\"msgtype\":\"rmtlog\",\"enable\":false}");
+    TCHECK(strstr(reply, "\"enable\":false") != NULL);
+}
+
+
+void selftest_rmtlog () {
+    u4_t savedBackfill = RMTLOG_BACKFILL, savedRate = RMTLOG_RATE, savedBurst = RMTLOG_BURST;
+    u1_t saved[16];
+    for( int m=0; m < 16; m++ )
+        saved[m] = log_setLevel((m<<3)|INFO);
+    RMTLOG_BACKFILL = 4096;
+    RMTLOG_RATE = 1000000;
+    RMTLOG_BURST = 65536;
+    ctx.getSendbuf = t_getSendbuf;
+    ctx.sendBinary = t_sendBinary;
+    ctx.sendText = t_sendText;
+
+    rmtlog_ini();
+    test_backfill();
+    test_ratelimit();
+    test_logDuringSend();
+    test_msg();
+
+    RMTLOG_BACKFILL = 0;
+    rmtlog_disable();   // drop ring
+    RMTLOG_BACKFILL = savedBackfill;
+    RMTLOG_RATE = savedRate;
+    RMTLOG_BURST = savedBurst;
+    for( int m=0; m < 16; m++ )
+        log_setLevel((m<<3) | saved[m]);
+}
@@ -0,0 +1,137 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+#include "spool.h"
+
+static void appendN (int from, int n, int len, ustime_t utc) {
+    u1_t data[300];
+    for( int i=0; i<n; i++ ) {
+        memset(data, from+i, len);
+        TCHECK(spool_append(data, len, utc));
+    }
+}
+
+// Pop next record and check it is the expected one
+static void expectRec (int id, int len, ustime_t utc, ustime_t maxage) {
+    dbuf_t rec;
+    TCHECK(spool_next(&rec, utc, maxage));
+    TCHECK(rec.bufsize == len);
+    TCHECK((u1_t)rec.buf[0] == (u1_t)id && (u1_t)rec.buf[len-1] == (u1_t)id);
+    spool_consume();
+}
+
+
+void selftest_spool () {
+    enum { SZ = SPOOL_HDR_SIZE + 10*(SPOOL_REC_HDR+100) };
+    u1_t* mem = rt_mallocN(u1_t, SZ);
+    dbuf_t rec;
+
+    // Fresh memory gets formatted
+    TCHECK(spool_attach(mem, SZ) == 0);
+    TCHECK(spool_empty() && spool_used() == 0);
+    TCHECK(spool_next(&rec, 0, 0) == 0);
+    memset(&spool_stats, 0, sizeof(spool_stats));
+
+    // In order replay
+    appendN(1, 3, 100, 1000);
+    TCHECK(spool_used() == 3*(SPOOL_REC_HDR+100));
+    expectRec(1, 100, 1000, 0);
+    expectRec(2, 100, 1000, 0);
+
+    // Content survives re-attaching (e.g. after a restart)
+    TCHECK(spool_attach(mem, SZ) == 1);
+    expectRec(3, 100, 1000, 0);
+    TCHECK(spool_next(&rec, 1000, 0) == 0);
+    TCHECK(spool_empty());
+
+    // Records wrap around - head stays where replay left it (not at the front)
+    u4_t h = rt_rlsbf4(&mem[8]);
+    TCHECK(h == SPOOL_HDR_SIZE + 3*(SPOOL_REC_HDR+100));
+    appendN(10, 9, 100, 2000);
+    TCHECK(spool_stats.dropped == 0);
+    TCHECK(rt_rlsbf4(&mem[8]) == h);                                       // nothing moved
+    TCHECK(rt_rlsbf4(&mem[12]) == SPOOL_HDR_SIZE + 2*(SPOOL_REC_HDR+100)); // wrapped
+    TCHECK(spool_used() == 9*(SPOOL_REC_HDR+100));
+    TCHECK(spool_attach(mem, SZ) == 1);
+    appendN(20, 1, 50, 2000);
+    TCHECK(spool_stats.dropped == 0);
+    // Full spool drops oldest records
+    appendN(21, 1, 50, 2000);
+    TCHECK(spool_stats.dropped == 1);
+    for( int i=11; i<19; i++ )
+        expectRec(i, 100, 2000, 0);
+    expectRec(20, 50, 2000, 0);
+    expectRec(21, 50, 2000, 0);
+    TCHECK(spool_next(&rec, 2000, 0) == 0);
+
+    // Empty spool with no room before the end restarts at the front
+    appendN(22, 6, 100, 2000);
+    for( int i=22; i<28; i++ )
+        expectRec(i, 100, 2000, 0);
+    h = rt_rlsbf4(&mem[8]);
+    TCHECK(h == rt_rlsbf4(&mem[12]) && h + SPOOL_REC_HDR+200 > SZ);
+    appendN(28, 1, 200, 2000);
+    TCHECK(rt_rlsbf4(&mem[8]) == SPOOL_HDR_SIZE);
+    TCHECK(rt_rlsbf4(&mem[12]) == SPOOL_HDR_SIZE + SPOOL_REC_HDR+200);
+    // Crash after moving tail but before head - wrap marker keeps it consistent and empty
+    u4_t t = SPOOL_HDR_SIZE;
+    mem[8] = h; mem[9] = h>>8; mem[10] = h>>16; mem[11] = h>>24;
+    mem[12] = t; mem[13] = t>>8; mem[14] = t>>16; mem[15] = t>>24;
+    TCHECK(spool_attach(mem, SZ) == 1);
+    TCHECK(spool_next(&rec, 2000, 0) == 0);
+    TCHECK(spool_empty());
+
+    // Age based expiry
+    appendN(30, 2, 10, 1000);
+    appendN(32, 2, 10, 5000);
+    expectRec(32, 10, 6000, 2000);
+    TCHECK(spool_stats.expired == 2);
+    expectRec(33, 10, 6000, 2000);
+
+    // Record larger than spool is rejected
+    u1_t big[SZ];
+    TCHECK(spool_append(big, SZ, 0) == 0);
+
+    // Torn tail after a crash: record header says more than was written
+    appendN(40, 2, 100, 0);
+    t = rt_rlsbf4(&mem[12]);
+    t -= 20;
+    mem[12] = t; mem[13] = t>>8; mem[14] = t>>16; mem[15] = t>>24;
+    TCHECK(spool_attach(mem, SZ) == 1);
+    expectRec(40, 100, 0, 0);
+    TCHECK(spool_next(&rec, 0, 0) == 0);
+
+    // Garbage header - reformat
+    mem[0] ^= 0xFF;
+    TCHECK(spool_attach(mem, SZ) == 0);
+    TCHECK(spool_empty());
+
+    spool_free();
+    rt_free(mem);
+}
@@ -0,0 +1,95 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+
+#if defined(CFG_lgw1)
+#include "sx130xconf.h"
+
+// Binary radio config handed from master to slaves must survive the trip
+// bit for bit and anything damaged or from another build must be refused.
+
+static void parseConf (struct sx130xconf* conf) {
+    char json[] =
+        "{\"lorawan_public\":true,\"clksrc\":1,"
+        "\"radio_0\":{\"type\":\"SX1257\",\"rssi_offset\":-166.0,\"tx_enable\":true,\"antenna_gain\":3},"
+        "\"radio_1\":{\"type\":\"SX1257\",\"rssi_offset\":-166.0,\"tx_enable\":false}}";
+    memset(conf, 0, sizeof(*conf));
+    TCHECK(sx130xconf_parse(conf, json, strlen(json)));
+    chdefl_t upchs;
+    memset(&upchs, 0, sizeof(upchs));
+    for( int i=0; i < 8; i++ ) {
+        upchs.freq[i] = 867100000 + i*200000;
+        upchs.rps[i] = (struct chrps) { .minSF = SF12, .maxSF = SF7, .bw = BW125 };
+    }
+    TCHECK(sx130xconf_challoc(conf, &upchs));
+}
+
+
+void selftest_sx130xconf () {
+    struct sx130xconf conf, back;
+    struct sx130xconf_bin bin;
+
+    parseConf(&conf);
+    TCHECK(conf.rfconf[0].enable && conf.rfconf[0].freq_hz != 0);
+    TCHECK(conf.txpowAdjust == 3*TXPOW_SCALE);
+
+    // Round trip
+    sx130xconf_compile(&bin, &conf);
+    TCHECK(bin.magic == SX130XCONF_BIN_MAGIC);
+    TCHECK(bin.size == sizeof(struct sx130xconf));
+    memset(&back, 0xAA, sizeof(back));
+    TCHECK(sx130xconf_load(&back, &bin));
+    TCHECK(memcmp(&back, &conf, sizeof(conf)) == 0);
+
+    // Any flipped byte in the payload is caught by the CRC
+    u1_t* p = (u1_t*)&bin.conf;
+    for( int i=0; i < sizeof(bin.conf); i += 7 ) {
+        p[i] ^= 0x10;
+        TCHECK(!sx130xconf_load(&back, &bin));
+        p[i] ^= 0x10;
+    }
+    bin.crc ^= 1;
+    TCHECK(!sx130xconf_load(&back, &bin));
+    bin.crc ^= 1;
+
+    // Layout or format from a different build
+    bin.size += 4;
+    TCHECK(!sx130xconf_load(&back, &bin));
+    bin.size -= 4;
+    bin.magic ^= 0x100;
+    TCHECK(!sx130xconf_load(&back, &bin));
+    bin.magic ^= 0x100;
+
+    // Restored image is accepted again
+    memset(&back, 0, sizeof(back));
+    TCHECK(sx130xconf_load(&back, &bin));
+    TCHECK(memcmp(&back, &conf, sizeof(conf)) == 0);
+}
+
+#endif // defined(CFG_lgw1)
@@ -0,0 +1,72 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include "selftests.h"
+#include "s2conf.h"
+#include "timesync.h"
+#include "ral.h"
+
+#define SKEW_PPM   40     // MCU clock runs fast against SX130X
+#define N_SYNCS    18     // fewer than the drift window - adapted drift threshold would reject the outliers first
+#define SPI_DELAY  80     // outlier - late MCU reading due to a stalled SPI transaction (us)
+
+static ustime_t trueUstime (sL_t dx) {
+    return rt_seconds(1000) + dx + (sL_t)round(dx * SKEW_PPM / 1e6);
+}
+
+void selftest_timesync () {
+    ustime_t utcOffset = rt_utcOffset, utcOffset_ts = rt_utcOffset_ts;
+    ts_iniTimesync();
+
+    sL_t xtime0 = ts_newXtimeSession(0) + rt_seconds(10);
+    sL_t dx = 0;
+    for( int i=0; i<N_SYNCS; i++ ) {
+        timesync_t sync = { .xtime = xtime0 + dx, .ustime = trueUstime(dx) + (i%3) - 1 };   // +/-1us jitter
+        if( i == 1 || i == 6 )
+            sync.ustime += SPI_DELAY;
+        ts_updateTimesync(0, 10, &sync);
+        dx += TIMESYNC_RADIO_INTV + (i%5)*1000;
+    }
+    // Extrapolate well beyond the last sync - pure offset would be off by SKEW_PPM
+    // and a fit dragged by the outlier still in the window by several micros.
+    for( int k=0; k<=3; k++ ) {
+        sL_t x = dx + k*rt_seconds(10);
+        ustime_t us = ts_xtime2ustime(xtime0 + x);
+        TCHECK(labs(us - trueUstime(x)) <= 3);
+        TCHECK(labs(ts_ustime2xtime(0, us) - (xtime0 + x)) <= 1);
+    }
+    TCHECK(fabs(ts_normalizeTimespanMCU(rt_seconds(100)) - rt_seconds(100)*(1 - SKEW_PPM/1e6)) <= 2);
+
+    // Other txunits convert only once they have their own time sync
+    TCHECK(ts_ustime2xtime(1, trueUstime(dx)) == 0);
+
+    ts_iniTimesync();
+    rt_utcOffset = utcOffset;
+    rt_utcOffset_ts = utcOffset_ts;
+}
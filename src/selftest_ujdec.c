@@ -713,6 +713,154 @@ static void test_indexedField_intRange() {
 }
 
 
+// Strings and whitespace crossing 16 byte scan blocks at every offset
+static void test_bulkScan() {
+    ujdec_t D;
+    char ref[64];
+
+    for( int k=0; k < 40; k++ ) {
+        // String with escape at position k
+        int n = 0;
+        jsonbuf[n++] = '"';
+        for( int i=0; i < 40; i++ ) {
+            if( i == k ) {
+                jsonbuf[n++] = '\\';
+                jsonbuf[n++] = 'n';
+                ref[i] = '\n';
+            } else {
+                jsonbuf[n++] = ref[i] = 'a' + (i % 26);
+            }
+        }
+        ref[40] = 0;
+        jsonbuf[n++] = '"';
+        uj_iniDecoder(&D, jsonbuf, n);
+        if( uj_decode(&D) )
+            TFAIL("bulk string");   // LCOV_EXCL_LINE
+        TCHECK(strcmp(uj_str(&D), ref) == 0);
+        TCHECK(D.str.len == 40);
+        ujcrc_t crc = 0;
+        for( int i=0; i < 40; i++ )
+            crc = UJ_UPDATE_CRC(crc, ref[i]);
+        TCHECK(D.str.crc == UJ_FINISH_CRC(crc));
+        uj_assertEOF(&D);
+
+        // Unterminated string of length k
+        jsonbuf[0] = '"';
+        memset(jsonbuf+1, 'x', k);
+        uj_iniDecoder(&D, jsonbuf, k+1);
+        if( !uj_decode(&D) ) {
+            uj_str(&D);
+            TFAIL("bulk unterminated");   // LCOV_EXCL_LINE
+        }
+
+        // Value preceded and followed by k whitespace chars
+        n = 0;
+        for( int i=0; i < k; i++ )
+            jsonbuf[n++] = " \t\r\n"[i & 3];
+        jsonbuf[n++] = '7';
+        for( int i=0; i < k; i++ )
+            jsonbuf[n++] = " \n"[i & 1];
+        uj_iniDecoder(&D, jsonbuf, n);
+        if( uj_decode(&D) )
+            TFAIL("bulk wsp");   // LCOV_EXCL_LINE
+        TCHECK(7 == uj_int(&D));
+        uj_assertEOF(&D);
+    }
+
+    // Long strings are no keywords - only leading chars are hashed
+    jsonbuf[0] = '"';
+    memset(jsonbuf+1, 'k', 2*UJ_CRC_MAXLEN);
+    jsonbuf[2*UJ_CRC_MAXLEN+1] = '"';
+    uj_iniDecoder(&D, jsonbuf, 2*UJ_CRC_MAXLEN+2);
+    if( uj_decode(&D) )
+        TFAIL("bulk long");   // LCOV_EXCL_LINE
+    uj_str(&D);
+    TCHECK(D.str.len == 2*UJ_CRC_MAXLEN);
+    ujcrc_t crc = 0;
+    for( int i=0; i < UJ_CRC_MAXLEN; i++ )
+        crc = UJ_UPDATE_CRC(crc, 'k');
+    TCHECK(D.str.crc == UJ_FINISH_CRC(crc));
+}
+
+
+// Pretty printed station_conf/router_config sized document
+static int makeBigConf (char* buf, int bufsize) {
+    ujbuf_t b = { .buf=buf, .bufsize=bufsize, .pos=0 };
+    xprintf(&b, "{\n  \"msgtype\": \"router_config\",\n  \"sx1301_conf\": [\n");
+    for( int r=0; r < 16; r++ ) {
+        xprintf(&b, "%s    {\n", r ? ",\n" : "");
+        xprintf(&b, "      \"device\": \"/dev/spidev%d.0\",\n      \"lorawan_public\": true,\n      \"clksrc\": %d,\n", r, r&1);
+        xprintf(&b, "      \"radio_0\": {\"enable\": true, \"type\": \"SX1257\", \"freq\": 867500000, \"rssi_offset\": -166.0, \"tx_enable\": true},\n");
+        xprintf(&b, "      \"radio_1\": {\"enable\": true, \"type\": \"SX1257\", \"freq\": 868500000, \"rssi_offset\": -166.0, \"tx_enable\": false},\n");
+        for( int c=0; c < 8; c++ )
+            xprintf(&b, "      \"chan_multiSF_%d\": {\"enable\": true, \"radio\": %d, \"if\": %d},\n", c, c/4, -400000+c*200000);
+        xprintf(&b, "      \"description\": \"concentrator board #%d - \\\"reference\\\" layout with two radios and eight multi-SF channels\",\n", r);
+        xprintf(&b, "      \"calibration\": \"");
+        for( int i=0; i < 512; i++ )
+            xprintf(&b, "%02X", (i*r+17) & 0xFF);
+        xprintf(&b, "\"\n    }");
+    }
+    xprintf(&b, "\n  ]\n}\n");
+    return xeos(&b) ? b.pos : -1;
+}
+
+static void test_bigConf() {
+    enum { BIGSZ = 64*1024, ROUNDS = 100 };
+    char* doc = rt_mallocN(char, BIGSZ);
+    char* work = rt_mallocN(char, BIGSZ);
+    int n = makeBigConf(doc, BIGSZ);
+    TCHECK(n > 16*1024);
+    ujdec_t D;
+    ustime_t tskip = 0, tdec = 0;
+    for( int r=0; r < ROUNDS; r++ ) {
+        memcpy(work, doc, n);
+        ustime_t t0 = rt_getTime();
+        uj_iniDecoder(&D, work, n);
+        if( uj_decode(&D) )
+            TFAIL("bigconf skip");   // LCOV_EXCL_LINE
+        ujbuf_t v = uj_skipValue(&D);
+        uj_assertEOF(&D);
+        tskip += rt_getTime() - t0;
+        TCHECK(v.bufsize == n-1);
+        TCHECK(memcmp(work, doc, n) == 0);   // skip leaves text alone
+
+        t0 = rt_getTime();
+        uj_iniDecoder(&D, work, n);
+        if( uj_decode(&D) )
+            TFAIL("bigconf decode");   // LCOV_EXCL_LINE
+        uj_nextValue(&D);
+        uj_enterObject(&D);
+        int boards = 0;
+        ujcrc_t field;
+        while( (field = uj_nextField(&D)) ) {
+            if( field == J_msgtype ) {
+                TCHECK(J_router_config == uj_keyword(&D));
+                continue;
+            }
+            uj_enterArray(&D);
+            while( uj_nextSlot(&D) >= 0 ) {
+                uj_enterObject(&D);
+                while( uj_nextField(&D) ) {
+                    if( uj_nextValue(&D) == UJ_STRING && D.str.len == 1024 )
+                        boards += 1;
+                    uj_skipValue(&D);
+                }
+                uj_exitObject(&D);
+            }
+            uj_exitArray(&D);
+        }
+        uj_exitObject(&D);
+        uj_assertEOF(&D);
+        tdec += rt_getTime() - t0;
+        TCHECK(boards == 16);
+    }
+    fprintf(stderr, "uj bench: %d byte config - skip %.1f MB/s, decode %.1f MB/s\n",
+            n, (double)n*ROUNDS/max(1,tskip), (double)n*ROUNDS/max(1,tdec));
+    rt_free(doc);
+    rt_free(work);
+}
+
+
 void selftest_ujdec () {
     jsonbuf = rt_mallocN(char, BUFSZ);
 
@@ -733,6 +881,8 @@ void selftest_ujdec () {
     test_skip();
     test_comment();
     test_indexedField_intRange();
+    test_bulkScan();
+    test_bigConf();
 
     free(jsonbuf);
 }
@@ -26,8 +26,11 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
+#include <stdio.h>
 #include "selftests.h"
 #include "uj.h"
+#include "xq.h"
 
 #define BUFSZ (2*1024)
 
@@ -174,6 +177,241 @@ static void test_simple_values() {
 }
 
 
+// Compare own number formatting against libc printf
+static u4_t lcg = 1;
+static double rnd (double lo, double hi) {
+    lcg = lcg * 1103515245 + 12345;
+    u4_t a = lcg;
+    lcg = lcg * 1103515245 + 12345;
+    return lo + (hi-lo) * (((uL_t)a << 32 | lcg) >> 11) * (1.0/(1ULL<<53));
+}
+
+static int checkNum (ujbuf_t* B, double v) {
+    char ref[8192];
+    int ok = 1;
+    B->pos = 0;
+    uj_encNum(B, v);
+    snprintf(ref, sizeof(ref), "%g", v);
+    ok &= xeos(B) && strcmp(ref, B->buf) == 0;
+    B->pos = 0;
+    uj_encTime(B, v);
+    snprintf(ref, sizeof(ref), "%.6f", v);
+    ok &= xeos(B) && strcmp(ref, B->buf) == 0;
+    B->pos = 0;
+    xprintf(B, "%.0f|%.1f|%.2f|%.3f|%.4f|%.5f|%.6f|%.7f|%.8f|%.9f|%f|%g|%.10f|%12.3f",
+            v, v, v, v, v, v, v, v, v, v, v, v, v, v);
+    snprintf(ref, sizeof(ref), "%.0f|%.1f|%.2f|%.3f|%.4f|%.5f|%.6f|%.7f|%.8f|%.9f|%f|%g|%.10f|%12.3f",
+             v, v, v, v, v, v, v, v, v, v, v, v, v, v);
+    ok &= xeos(B) && strcmp(ref, B->buf) == 0;
+    if( !ok )
+        fprintf(stderr, "Number format mismatch: %.17g -> %s\n", v, B->buf);
+    return ok;
+}
+
+static void test_numbers () {
+    enum { NBUF = 8192 };
+    char* jsonbuf = rt_mallocN(char, NBUF);
+    ujbuf_t B = { .buf = jsonbuf, .bufsize = NBUF, .pos = 0 };
+    char ref[100];
+
+    static const sL_t IVALS[] = {
+        0, 1, -1, 9, 10, -10, 99, 100, 12345, -99999, 2147483647, -2147483647-1,
+        4294967295LL, 1000000000000LL, 0x7FFFFFFFFFFFFFFFLL, -0x7FFFFFFFFFFFFFFFLL-1
+    };
+    for( int i=0; i < SIZE_ARRAY(IVALS); i++ ) {
+        sL_t v = IVALS[i];
+        B.pos = 0;
+        uj_encInt(&B, v);
+        snprintf(ref, sizeof(ref), "%lld", (long long)v);
+        TCHECK(xeos(&B) && strcmp(ref, B.buf) == 0);
+        B.pos = 0;
+        uj_encUint(&B, v);
+        snprintf(ref, sizeof(ref), "%llu", (unsigned long long)v);
+        TCHECK(xeos(&B) && strcmp(ref, B.buf) == 0);
+        B.pos = 0;
+        xprintf(&B, "%d|%u|%ld|%lu|%5d", (int)v, (int)v, v, v, (int)v);
+        snprintf(ref, sizeof(ref), "%d|%u|%lld|%llu|%5d", (int)v, (unsigned)v, (long long)v, (unsigned long long)v, (int)v);
+        TCHECK(xeos(&B) && strcmp(ref, B.buf) == 0);
+    }
+
+    static const double FVALS[] = {
+        0.0, -0.0, 1.0, -1.0, 0.5, 1.5, 2.5, -2.5, 0.0078125, 0.0000005, 0.0000015, 0.0000025,
+        9.999995, 9.9999949999, 0.1, 0.2, 0.3, 1e-4, 9.99999e-5, 0.00010000049, 999999.4, 999999.5,
+        999999.49999, 123456.5, 1234567.0, 1e17, 9.99e17, 1e18, 1e19, 1e100, -1e300, 5e-324,
+        1234.5678901234, 868.1, 868.3, 923.3, -123.75, 12.0000005, 0.125, 1/3.0, 2/3.0,
+        NAN, -NAN, INFINITY, -INFINITY
+    };
+    for( int i=0; i < SIZE_ARRAY(FVALS); i++ )
+        TCHECK(checkNum(&B, FVALS[i]));
+
+    // Exact ties at various positions - ties to even
+    for( int k=-2000; k <= 2000; k++ ) {
+        TCHECK(checkNum(&B, k/2.0));
+        TCHECK(checkNum(&B, k/1024.0));
+        TCHECK(checkNum(&B, k/(double)(1<<20)));
+    }
+    static const double RANGES[][2] = {
+        { 0, 1 }, { -1e-3, 1e-3 }, { -1e-4, 1e-4 }, { 0, 1e6 }, { -2e6, 2e6 },
+        { 1e9, 1e12 }, { -1e18, 1e18 }, { 0, 1e21 }, { 1e6, 3e8 }
+    };
+    int nfail = 0;
+    for( int r=0; r < SIZE_ARRAY(RANGES); r++ ) {
+        for( int i=0; i < 2000; i++ )
+            nfail += !checkNum(&B, rnd(RANGES[r][0], RANGES[r][1]));
+    }
+    TCHECK(nfail == 0);
+
+    // Truncation works like snprintf
+    B.pos = 0;
+    B.bufsize = 4;
+    uj_encNum(&B, 1.25e-3);
+    TCHECK(0 == xeos(&B));
+    TCHECK(strcmp("0.0", B.buf) == 0);
+    B.pos = 0;
+    xprintf(&B, "%f", 1.5);
+    TCHECK(0 == xeos(&B));
+    TCHECK(strcmp("1.5", B.buf) == 0);
+
+    free(jsonbuf);
+}
+
+
+// Deferred formatting: capture arguments now, render later
+static int capture (u1_t* data, int size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vxprintf_capture(data, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+#define replay(B, fmt, ...) ({                                  \
+        u1_t data[1024];                                        \
+        int n = capture(data, sizeof(data), fmt, ##__VA_ARGS__); \
+        (B)->pos = 0;                                           \
+        n < 0 ? n : xprintf_replay(B, fmt, data, n);            \
+    })
+
+static void test_capture () {
+    char* jsonbuf = rt_mallocN(char, BUFSZ);
+    char* refbuf = rt_mallocN(char, BUFSZ);
+    ujbuf_t B = { .buf = jsonbuf, .bufsize = BUFSZ, .pos = 0 };
+    ujbuf_t R = { .buf = refbuf, .bufsize = BUFSZ, .pos = 0 };
+    txjob_t txjob = { .deveui = 0x0102030405060708, .diid = 1234, .txunit = 1 };
+    char str[] = "abcdefghij";
+    u1_t hex[] = { 0x01, 0xAB, 0xCD, 0xEF };
+
+#define CHECK_REPLAY(fmt, ...) {                                \
+        R.pos = 0;                                              \
+        xprintf(&R, fmt, ##__VA_ARGS__);                        \
+        TCHECK(replay(&B, fmt, ##__VA_ARGS__) == 1);            \
+        TCHECK(strcmp(R.buf, B.buf) == 0);                      \
+    }
+    CHECK_REPLAY("plain text - no args");
+    CHECK_REPLAY("100%% %d %u %x %X %c|", -17, 17, 0xABC, 0xABC, 'A');
+    CHECK_REPLAY("%ld %lu %lx %5d %-5d|%05d", (sL_t)-1, (uL_t)-1, (uL_t)0x1234567890, 42, 42, 42);
+    CHECK_REPLAY("%f %.3f %g %10.2f %.1f", 1.5, -2.0/3, 868.1e6, 3.14159, 0.05);
+    CHECK_REPLAY("[%s] [%.3s] [%.*s] [%*s] [%-*s] [%s]", str, str, 4, str, 12, str, 12, str, (char*)NULL);
+    CHECK_REPLAY("%H|%.2H|%B", 4, hex, 4, hex, 4, hex);
+    CHECK_REPLAY("%M %E %:E %T %.3T %~T", 0x1A2B3C4DA1B2C3D4, 0x91A2B3C4D5E6F708, 0x91A2B3C4D5E6F708,
+                 (ustime_t)1451649600*1000000+123456, (ustime_t)1451649600*1000000+123456, (ustime_t)3723*1000000);
+    CHECK_REPLAY("%F %.3F %~F %R %R %J", 868100000, 868100000, 923300000, 0, 6, &txjob);
+    CHECK_REPLAY("%p trailing %", (void*)refbuf);
+    CHECK_REPLAY("%*.*s|", 8, 2, str);
+#undef CHECK_REPLAY
+
+    // Referenced memory is copied at capture time
+    {
+        u1_t data[256];
+        char tmp[] = "hello";
+        int n = capture(data, sizeof(data), "%s|%H|%J", tmp, 2, tmp, &txjob);
+        memset(tmp, 'X', 5);
+        txjob.diid = 0;
+        B.pos = 0;
+        TCHECK(xprintf_replay(&B, "%s|%H|%J", data, n) == 1);
+        TCHECK(strcmp(B.buf, "hello|6865|102:304:506:708 diid=1234 [ant#1]") == 0);
+    }
+    // Strings referenced by %.*s need not be NUL terminated
+    char unterminated[4] = { 'w', 'x', 'y', 'z' };
+    TCHECK(replay(&B, "%.*s", 3, unterminated) == 1 && strcmp(B.buf, "wxy") == 0);
+
+    // Capture space exhausted
+    u1_t small[16];
+    TCHECK(16 == capture(small, sizeof(small), "%d %d", 1, 2));
+    TCHECK(-1 == capture(small, sizeof(small), "%d %d %d", 1, 2, 3));
+    TCHECK(-1 == capture(small, sizeof(small), "%s", str));
+
+    // Cost of capturing vs formatting a typical TX log line
+    enum { ROUNDS = 20000 };
+    static const char TXFMT[] = "%J - starting TX in %~T: %F %.1fdBm ant#%d(%d) %R frame=%12.4H";
+    ustime_t t0 = rt_getTime();
+    for( int i=0; i < ROUNDS; i++ ) {
+        R.pos = 0;
+        xprintf(&R, TXFMT, &txjob, (ustime_t)19876, 868100000, 14.0, 0, 1, 3, 4, hex);
+    }
+    ustime_t tfmt = rt_getTime() - t0;
+    int n = 0;
+    t0 = rt_getTime();
+    for( int i=0; i < ROUNDS; i++ ) {
+        u1_t data[256];
+        n += capture(data, sizeof(data), TXFMT, &txjob, (ustime_t)19876, 868100000, 14.0, 0, 1, 3, 4, hex);
+    }
+    ustime_t tcap = rt_getTime() - t0;
+    TCHECK(n > 0);
+    fprintf(stderr, "xprintf bench: %d log lines - format %ldus, capture %ldus\n",
+            ROUNDS, (long)tfmt, (long)tcap);
+    free(refbuf);
+    free(jsonbuf);
+}
+
+
+// Encoding throughput of typical uplink messages
+static void bench_uplink () {
+    enum { ROUNDS = 50000 };
+    char* jsonbuf = rt_mallocN(char, BUFSZ);
+    ujbuf_t B = { .buf = jsonbuf, .bufsize = BUFSZ, .pos = 0 };
+    uL_t sum = 0;
+    ustime_t t0 = rt_getTime();
+    for( int i=0; i < ROUNDS; i++ ) {
+        B.pos = 0;
+        uj_encOpen(&B, '{');
+        uj_encKVn(&B,
+                  "msgtype",  's', "updf",
+                  "MHdr",     'i', 0x40,
+                  "DevAddr",  'i', 0x26011234 + i,
+                  "FCtrl",    'i', 0x80,
+                  "FCnt",     'i', i,
+                  "FOpts",    's', "",
+                  "FPort",    'i', 1,
+                  "FRMPayload",'s', "A1B2C3D4E5F6",
+                  "MIC",      'i', -1234567890 + i,
+                  "RefTime",  'T', 1690000000.123456 + i*0.0173,
+                  "DR",       'i', i % 6,
+                  "Freq",     'u', 868100000 + (i % 8)*200000,
+                  "upinfo",   '{',
+                  /**/ "rctx",    'I', (sL_t)0,
+                  /**/ "xtime",   'I', (sL_t)0x1800000012345678 + i*1000,
+                  /**/ "gpstime", 'I', (sL_t)1374000000000000 + i*1000,
+                  /**/ "fts",     'i', -1,
+                  /**/ "rssi",    'i', -50 - i % 70,
+                  /**/ "snr",     'g', 9.25 - (i % 40)*0.5,
+                  /**/ "rxtime",  'T', 1690000000.654321 + i*0.0173,
+                  /**/ "}",
+                  NULL);
+        uj_encClose(&B, '}');
+        TCHECK(xeos(&B));
+        sum += B.pos;
+    }
+    ustime_t dt = max(1, rt_getTime() - t0);
+    fprintf(stderr, "uj enc bench: %d uplinks %ld bytes - %.0f msgs/s\n",
+            ROUNDS, (long)sum, ROUNDS * 1e6 / dt);
+    free(jsonbuf);
+}
+
+
 void selftest_ujenc () {
     test_simple_values();
+    test_numbers();
+    test_capture();
+    bench_uplink();
 }
@@ -117,5 +117,12 @@ void selftest_xprintf () {
     TCHECK(0==xeol(&B2));
     TCHECK(strncmp(B2.buf, "123456\n12\n", B2.bufsize)==0);
 
+    // Element overflowing the buffer must not let later elements write past the end
+    char guarded[16];
+    memset(guarded, 'X', sizeof(guarded));
+    ujbuf_t B3 = { .buf=guarded, .bufsize=8, .pos=0 };
+    TCHECK(0==xprintf(&B3, "%s %s %g", "0123456789", "abcdef", 1.5));
+    TCHECK(B3.pos == B3.bufsize && guarded[7] == 0 && guarded[8] == 'X');
+
     free(outbuf);
 }
@@ -145,6 +145,39 @@ void selftest_txq () {
     TCHECK(n==MAX_TXJOBS);
     TCHECK(txq.txdataInUse==0);
 
+    // Batch of txjobs sharing committed data
+    {
+        txjob_t* b0 = txq_reserveNextJob(&txq, NULL);
+        txjob_t* b1 = txq_reserveNextJob(&txq, b0);
+        txjob_t* b2 = txq_reserveNextJob(&txq, b1);
+        TCHECK(b0 != b1 && b1 != b2 && b0 != b2);
+        TCHECK(b0 == txq_reserveNextJob(&txq, NULL));
+        u1_t* d = txq_reserveData(&txq, 15);
+        memset(d, 0xAA, 10);
+        memset(d+10, 0xBB, 5);
+        txoff_t off = txq_commitData(&txq, 15);
+        TCHECK(off == 0 && txq.txdataInUse == 15);
+        b0->len = 10; txq_commitJobData(&txq, b0, off);
+        b1->len = 5;  txq_commitJobData(&txq, b1, off+10);
+        b2->len = 10; txq_commitJobData(&txq, b2, off);
+        txjob_t* b3 = txq_reserveJob(&txq);
+        memset(txq_reserveData(&txq, 7), 0xCC, 7);
+        b3->len = 7;
+        txq_commitJob(&txq, b3);
+        TCHECK(b3->off == 15 && txq.txdataInUse == 22);
+
+        txq_freeJob(&txq, b0);      // b2 still refers to same data
+        TCHECK(txq.txdataInUse == 22 && b2->off == 0 && txq.txdata[b2->off+9] == 0xAA);
+        txq_freeJob(&txq, b1);
+        TCHECK(txq.txdataInUse == 17 && b3->off == 10 && txq.txdata[b3->off] == 0xCC);
+        txq_freeJob(&txq, b2);
+        TCHECK(txq.txdataInUse == 7 && b3->off == 0 && txq.txdata[6] == 0xCC);
+        txq_freeJob(&txq, b3);
+        TCHECK(txq.txdataInUse == 0);
+        n = in_queue(&txq, txq.freeJobs);
+        TCHECK(n==MAX_TXJOBS);
+    }
+
     do {
         if( (j = txq_reserveJob(&txq)) == NULL )
             TFAIL("Fail");    // LCOV_EXCL_LINE
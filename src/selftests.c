@@ -45,6 +45,15 @@ static void (*const selftest_fns[])() = {
     selftest_ujenc,
     selftest_xprintf,
     selftest_fs,
+    selftest_quantile,
+    selftest_spool,
+    selftest_log,
+    selftest_rmtlog,
+    selftest_challoc,
+    selftest_timesync,
+#if defined(CFG_lgw1)
+    selftest_sx130xconf,
+#endif
     NULL
 };
 
@@ -49,6 +49,15 @@ extern void selftest_ujdec ();
 extern void selftest_ujenc ();
 extern void selftest_xprintf ();
 extern void selftest_fs ();
+extern void selftest_quantile ();
+extern void selftest_spool ();
+extern void selftest_log ();
+extern void selftest_rmtlog ();
+extern void selftest_challoc ();
+extern void selftest_timesync ();
+#if defined(CFG_lgw1)
+extern void selftest_sx130xconf ();
+#endif
 
 void selftest_fail (const char* expr, const char* file, int line);
 void selftests ();
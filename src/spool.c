@@ -0,0 +1,240 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "s2conf.h"
+#include "sys.h"
+#include "spool.h"
+
+#define SPOOL_MAGIC 0x4C4F4F50   // "POOL"
+
+spoolstats_t spool_stats;
+
+static u1_t* spool;       // mapped file or memory area
+static u4_t  spoolSize;
+static u1_t  spoolMapped; // spool must be unmapped
+static u1_t  spoolIni;    // spool_ini has been attempted
+
+
+static u4_t rd4 (u4_t off) { return rt_rlsbf4(&spool[off]); }
+
+static void wr4 (u4_t off, u4_t v) {
+    spool[off+0] = v;
+    spool[off+1] = v>>8;
+    spool[off+2] = v>>16;
+    spool[off+3] = v>>24;
+}
+
+static u4_t head () { return rd4(8); }
+static u4_t tail () { return rd4(12); }
+
+static u4_t recSize (u4_t off) {
+    return SPOOL_REC_HDR + rt_rlsbf2(&spool[off]);
+}
+
+// No record at off - continue at the front
+static int wrapAt (u4_t off) {
+    return off + SPOOL_REC_HDR > spoolSize || rt_rlsbf2(&spool[off]) == SPOOL_WRAP;
+}
+
+static void markWrap (u4_t off) {
+    if( off + SPOOL_REC_HDR <= spoolSize ) {
+        spool[off+0] = SPOOL_WRAP & 0xFF;
+        spool[off+1] = SPOOL_WRAP >> 8;
+    }
+}
+
+
+int spool_attach (u1_t* mem, u4_t size) {
+    spool = mem;
+    spoolSize = size;
+    u4_t h = head(), t = tail();
+    if( rd4(0) == SPOOL_MAGIC && rd4(4) == size &&
+        h >= SPOOL_HDR_SIZE && h <= size && t >= SPOOL_HDR_SIZE && t <= size ) {
+        // Check record chain - a crash may have left a partial record
+        u4_t off = h;
+        int wrapped = 0;
+        while( off != t ) {
+            if( wrapAt(off) ) {
+                if( wrapped || t > h )
+                    break;
+                wrapped = 1;
+                off = SPOOL_HDR_SIZE;
+                continue;
+            }
+            u4_t end = off + recSize(off);
+            if( end > size || ((wrapped || t > h) && end > t) )
+                break;
+            off = end;
+        }
+        if( off == t )
+            return 1;
+        LOG(MOD_S2E|WARNING, "Uplink spool corrupt at offset %u - discarding tail", off);
+        wr4(12, off);
+        return 1;
+    }
+    wr4(0, SPOOL_MAGIC);
+    wr4(4, size);
+    wr4(8, SPOOL_HDR_SIZE);
+    wr4(12, SPOOL_HDR_SIZE);
+    return 0;
+}
+
+
+int spool_ini () {
+    if( spoolIni )
+        return spool != NULL;
+    spoolIni = 1;
+    if( UPLINK_SPOOL_SIZE == 0 )
+        return 0;
+    u4_t size = max(UPLINK_SPOOL_SIZE, SPOOL_HDR_SIZE + SPOOL_REC_HDR + MIN_UPJSON_SIZE);
+    str_t fn = sys_makeFilepath("~temp/station.spool", 0);
+    u1_t* mem = sys_mapFile(fn, size);
+    if( mem == NULL ) {
+        rt_free((void*)fn);
+        return 0;
+    }
+    spoolMapped = 1;
+    if( spool_attach(mem, size) && !spool_empty() )
+        LOG(MOD_S2E|INFO, "Uplink spool %s holds %u bytes from previous run", fn, spool_used());
+    rt_free((void*)fn);
+    return 1;
+}
+
+
+void spool_free () {
+    if( spoolMapped )
+        sys_unmapFile(spool, spoolSize);
+    spool = NULL;
+    spoolSize = 0;
+    spoolMapped = 0;
+    spoolIni = 0;
+}
+
+
+int spool_active () {
+    return spoolIni ? spool != NULL : spool_ini();
+}
+
+
+int spool_empty () {
+    return spool == NULL || head() == tail();
+}
+
+
+u4_t spool_used () {
+    if( spool == NULL )
+        return 0;
+    u4_t h = head(), t = tail();
+    return t >= h ? t - h : (spoolSize - h) + (t - SPOOL_HDR_SIZE);
+}
+
+
+int spool_append (const void* data, int len, ustime_t utc) {
+    if( spool == NULL )
+        return 0;
+    u4_t need = SPOOL_REC_HDR + len;
+    if( len >= SPOOL_WRAP || need >= spoolSize - SPOOL_HDR_SIZE )
+        return 0;
+    u4_t h = head(), t = tail(), at;
+    while(1) {
+        if( t + need <= spoolSize ) {
+            if( h <= t || t + need < h ) {
+                at = t;
+                break;
+            }
+        }
+        else if( h == t ) {
+            // Empty but no room before the end - move both to the front.
+            // A crash in between leaves head at the wrap marker, i.e. still empty.
+            markWrap(t);
+            wr4(12, SPOOL_HDR_SIZE);
+            wr4(8, SPOOL_HDR_SIZE);
+            h = t = SPOOL_HDR_SIZE;
+            continue;
+        }
+        else if( h < t && SPOOL_HDR_SIZE + need < h ) {
+            at = SPOOL_HDR_SIZE;
+            break;
+        }
+        // Full - drop oldest record. Head moves before its space is reused.
+        if( wrapAt(h) ) {
+            h = SPOOL_HDR_SIZE;
+        } else {
+            h += recSize(h);
+            spool_stats.dropped += 1;
+        }
+        wr4(8, h);
+    }
+    if( at != t )
+        markWrap(t);
+    u1_t* p = &spool[at];
+    p[0] = len;
+    p[1] = len>>8;
+    for( int i=0; i<8; i++ )
+        p[2+i] = (uL_t)utc >> (8*i);
+    memcpy(p+SPOOL_REC_HDR, data, len);
+    wr4(12, at + need);   // commit record - tail moves last
+    spool_stats.appended += 1;
+    return 1;
+}
+
+
+int spool_next (dbuf_t* rec, ustime_t utc, ustime_t maxage) {
+    if( spool == NULL )
+        return 0;
+    u4_t h = head(), t = tail(), h0 = h;
+    while( h != t ) {
+        if( wrapAt(h) ) {
+            h = SPOOL_HDR_SIZE;
+            continue;
+        }
+        ustime_t rutc = (ustime_t)rt_rlsbf8(&spool[h+2]);
+        if( maxage <= 0 || utc - rutc <= maxage ) {
+            rec->buf = (char*)&spool[h+SPOOL_REC_HDR];
+            rec->bufsize = rt_rlsbf2(&spool[h]);
+            rec->pos = 0;
+            break;
+        }
+        h += recSize(h);
+        spool_stats.expired += 1;
+    }
+    if( h != h0 )
+        wr4(8, h);
+    return h != t;
+}
+
+
+void spool_consume () {
+    if( spool_empty() )
+        return;
+    u4_t h = head();
+    if( wrapAt(h) )
+        h = SPOOL_HDR_SIZE;
+    wr4(8, h + recSize(h));
+    spool_stats.replayed += 1;
+}
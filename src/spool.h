@@ -0,0 +1,67 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _spool_h_
+#define _spool_h_
+
+#include "rt.h"
+
+// Bounded store-and-forward spool for encoded uplink messages.
+// Records are appended to a memory mapped file in ~temp/ while the link to the LNS
+// is down and replayed in order once it is back. When full the oldest records are
+// dropped, records older than a max age are skipped during replay.
+//
+// Layout: header [magic(4) size(4) head(4) tail(4)] followed by a ring of records
+//         [len(2) utc(8) data(len)] from head to tail. A record never wraps - if it does
+//         not fit before the end a wrap marker (len=SPOOL_WRAP) is left behind, or nothing
+//         if less than SPOOL_REC_HDR bytes remain, and it goes to the front.
+// Records between head and tail are never moved or overwritten. Appending writes into
+// free space and then advances tail; dropping/consuming only advances head.
+// Thus, a crash at any point leaves a consistent spool behind.
+enum { SPOOL_HDR_SIZE = 16, SPOOL_REC_HDR = 10, SPOOL_WRAP = 0xFFFF };
+
+typedef struct spoolstats {
+    u4_t appended;
+    u4_t replayed;
+    u4_t expired;     // too old when it was their turn to be replayed
+    u4_t dropped;     // oldest records pushed out by a full spool
+} spoolstats_t;
+
+extern spoolstats_t spool_stats;
+
+int  spool_ini     ();                         // map ~temp/station.spool - 0 if disabled/failed
+void spool_free    ();
+int  spool_attach  (u1_t* mem, u4_t size);     // use memory area - returns 1 if it had valid content
+int  spool_active  ();                         // spool available
+int  spool_empty   ();
+u4_t spool_used    ();                         // bytes occupied by records
+int  spool_append  (const void* data, int len, ustime_t utc);
+int  spool_next    (dbuf_t* rec, ustime_t utc, ustime_t maxage);  // skip expired, peek at oldest record
+void spool_consume ();                         // drop record returned by spool_next
+
+#endif // _spool_h_
@@ -414,6 +414,11 @@ int sx130xconf_parse_setup (struct sx130xconf* sx130xconf, int slaveIdx,
             return 0;
     }
 
+    return sx130xconf_parse(sx130xconf, json, jsonlen);
+}
+
+
+int sx130xconf_parse (struct sx130xconf* sx130xconf, char* json, int jsonlen) {
     ujdec_t D;
     uj_iniDecoder(&D, json, jsonlen);
     if( uj_decode(&D) ) {
@@ -493,6 +498,29 @@ int sx130xconf_challoc (struct sx130xconf* sx130xconf, chdefl_t* upchs) {
     return ral_challoc(upchs, sx130xconf_challoc_cb, sx130xconf);
 }
 
+void sx130xconf_compile (struct sx130xconf_bin* bin, const struct sx130xconf* sx130xconf) {
+    memset(bin, 0, sizeof(*bin));
+    bin->magic = SX130XCONF_BIN_MAGIC;
+    bin->size  = sizeof(bin->conf);
+    memcpy(&bin->conf, sx130xconf, sizeof(bin->conf));
+    bin->crc   = rt_crc32(0, &bin->conf, sizeof(bin->conf));
+}
+
+int sx130xconf_load (struct sx130xconf* sx130xconf, const struct sx130xconf_bin* bin) {
+    if( bin->magic != SX130XCONF_BIN_MAGIC || bin->size != sizeof(bin->conf) ) {
+        LOG(MOD_RAL|ERROR, "Binary radio config has unexpected format: magic=0x%08X size=%d (expecting size=%d)",
+            bin->magic, bin->size, (int)sizeof(bin->conf));
+        return 0;
+    }
+    u4_t crc = rt_crc32(0, &bin->conf, sizeof(bin->conf));
+    if( crc != bin->crc ) {
+        LOG(MOD_RAL|ERROR, "Binary radio config corrupted: crc=0x%08X (expecting 0x%08X)", crc, bin->crc);
+        return 0;
+    }
+    memcpy(sx130xconf, &bin->conf, sizeof(*sx130xconf));
+    return 1;
+}
+
 static void dump_boardConf (struct lgw_conf_board_s* board) {
 #if defined(CFG_sx1302)
     LOG(MOD_RAL|INFO, "[LGW sx1302] full_duplex=%d clksrc=%d lorawan_public=%d",
@@ -624,8 +652,10 @@ static void dump_lbtConf (struct sx130xconf* sx130xconf) {
 }
 
 
-int sx130xconf_start (struct sx130xconf* sx130xconf, u4_t cca_region) {
+// Fills in phases MP_SETCONF, MP_LBT and MP_LGW_START [us] - radio init is up to the caller
+int sx130xconf_start (struct sx130xconf* sx130xconf, u4_t cca_region, u4_t phases[MP_MAX]) {
     str_t errmsg = "";
+    ustime_t t0 = rt_getTime();
     lgw_stop();
     LOG(MOD_RAL|INFO,"Lora gateway library version: %s", lgw_version_info());
 
@@ -690,11 +720,15 @@ int sx130xconf_start (struct sx130xconf* sx130xconf, u4_t cca_region) {
         }
     }
 
+    phases[MP_SETCONF] = rt_getTime() - t0;
+    t0 = rt_getTime();
+
     dump_lbtConf(sx130xconf);
     if( cca_region && !setup_LBT(sx130xconf, cca_region) ) {
         errmsg = "setup_LBT";
         goto fail;
     }
+    phases[MP_LBT] = rt_getTime() - t0;
 
 #if defined(CFG_sx1302)
     LOG(MOD_RAL|INFO, "Station device: %s:%s (PPS capture %sabled)",
@@ -708,7 +742,7 @@ int sx130xconf_start (struct sx130xconf* sx130xconf, u4_t cca_region) {
 #endif
     log_flushIO();  // flush output since lgw_start may block for quite some time on some concentrators
 
-    ustime_t t0 = rt_getTime();
+    t0 = rt_getTime();
     int err = lgw_start();
     if( err != LGW_HAL_SUCCESS ) {
         errmsg = "lgw_start";
@@ -722,7 +756,8 @@ int sx130xconf_start (struct sx130xconf* sx130xconf, u4_t cca_region) {
         errmsg = "LGW GPS Enable";
         goto fail;
     }
-    LOG(MOD_RAL|INFO, "Concentrator started (%~T)", rt_getTime()- t0);
+    phases[MP_LGW_START] = rt_getTime() - t0;
+    LOG(MOD_RAL|INFO, "Concentrator started (%~T)", (ustime_t)phases[MP_LGW_START]);
 #if defined(CFG_smtcpico)
     {
         // Avoid timing issues with picocell MCU firmware - re-adjusts time after first TX
@@ -38,6 +38,7 @@
 #endif
 #include "s2conf.h"
 #include "ral.h" //chdefl_t
+#include "metrics.h"
 
 
 #define SX130X_ANT_NIL    0
@@ -59,11 +60,26 @@ struct sx130xconf {
     char  device[MAX_DEVICE_LEN];   // SPI device, FTDI spec etc.
 };
 
+// Binary image of a fully resolved sx130xconf (parsed and channels allocated).
+// The master builds it once per router_config and hands it to slaves which
+// then bring up the radio without touching any JSON.
+#define SX130XCONF_BIN_MAGIC 0x53583130  // "SX10" - bump if the image format changes
+
+struct sx130xconf_bin {
+    u4_t magic;
+    u4_t size;     // sizeof(struct sx130xconf) - catches layout mismatches between master/slave binaries
+    u4_t crc;      // CRC32 over conf
+    struct sx130xconf conf;
+};
+
 extern str_t station_conf_USAGE;
 
 int  sx130xconf_parse_setup (struct sx130xconf* sx130xconf, int slaveIdx, str_t hwspec, char* json, int jsonlen);
+int  sx130xconf_parse (struct sx130xconf* sx130xconf, char* json, int jsonlen);  // overlay sx130x_conf JSON - no config files
 int  sx130xconf_challoc (struct sx130xconf* sx130xconf, chdefl_t* upchs);
-int  sx130xconf_start (struct sx130xconf* sx130xconf, u4_t region);
+int  sx130xconf_start (struct sx130xconf* sx130xconf, u4_t region, u4_t phases[MP_MAX]);
+void sx130xconf_compile (struct sx130xconf_bin* bin, const struct sx130xconf* sx130xconf);
+int  sx130xconf_load (struct sx130xconf* sx130xconf, const struct sx130xconf_bin* bin);
 
 
 #endif // defined(CFG_lgw1)
@@ -197,21 +197,17 @@ int writeFile (str_t file, const char* data, int datalen) {
     return err;
 }
 
-dbuf_t sys_webFile (str_t filename) {
+int sys_webOpen (str_t filename, struct stat* st) {
     if( !webDir )
-        goto err;
+        return -1;
     char filepath[MAX_FILEPATH_LEN];
     dbuf_t b = dbuf_ini(filepath);
     xputs(&b, webDir, -1);
     
     xputs(&b, filename[0]=='/' ? filename+1 : filename, -1);
-    if( !xeos(&b) ) {
-      err:
-        b.buf = NULL;
-        b.pos = b.bufsize = 0;
-        return b;
-    }
-    return readFile(b.buf, 0);
+    if( !xeos(&b) || fs_stat(b.buf, st) == -1 || S_ISDIR(st->st_mode) )
+        return -1;
+    return fs_open(b.buf, O_RDONLY);
 }
 
 dbuf_t sys_readFile (str_t filename) {
@@ -45,6 +45,7 @@ extern uL_t   prefixEUI;
 void  sys_ini ();
 void  sys_fatal (int code);
 void  sys_addLog (str_t line, int len);     // output/store one log line - *is* always \n treminated
+void  sys_wakeLog (int urgent);             // deferred log records are pending
 #if defined(CFG_sysrandom)
 int  sys_random (u1_t* buf, int len);
 #else
@@ -54,6 +55,13 @@ sL_t  sys_time ();
 sL_t  sys_utc  ();  // native UTC time - return 0 if not avail.
 uL_t  sys_eui  ();
 void  sys_usleep(sL_t us);
+// Ring buffer whose pages are mapped twice back to back - any range of up to *size
+// bytes starting inside the ring is contiguous in memory. *size is rounded up to pages.
+u1_t* sys_allocRing (int* size);
+void  sys_freeRing  (u1_t* ring, int size);
+// Shared writable mapping of a file resized to size bytes - NULL on error
+u1_t* sys_mapFile   (str_t filename, int size);
+void  sys_unmapFile (u1_t* map, int size);
 
 enum {
     SYSIS_TC_CONNECTED    = 1,
@@ -79,6 +87,21 @@ void  sys_credComplete (int cred_cat, int len);
 void  sys_updateStart  (int len);
 void  sys_updateWrite  (u1_t* data, int off, int len);
 int   sys_updateCommit (int len);
+int   sys_updateSuspend ();                  // interrupted - keep partial data, return bytes persisted or -1
+int   sys_updateResume  (int off, int len);  // continue a suspended update at off
+int   sys_updateResumable (int off);         // partial data of a suspended update still has at least off bytes
+
+typedef struct updstats {
+    u4_t     total;       // announced size of update
+    u4_t     received;    // bytes handed to sys_updateWrite
+    u4_t     written;     // bytes persisted
+    u4_t     resumedAt;   // offset an interrupted transfer was resumed from
+    ustime_t started;
+    ustime_t duration;    // start to commit
+    ustime_t writeTime;   // time spent writing/syncing to storage
+    s1_t     status;      // 0=in progress/none, 1=committed, -1=failed
+} updstats_t;
+void  sys_updateStats  (updstats_t* stats);   // last/ongoing update - total==0 if none
 void  sys_resetConfigUpdate ();
 void  sys_commitConfigUpdate ();
 void  sys_backupConfig (int cred_cat);
@@ -98,6 +121,8 @@ dbuf_t sys_sigKey (int key_id);
 u4_t   sys_crcSigkey (int key_id);
 dbuf_t sys_readFile (str_t filename);   // should this be here? - only used in sx130xconf.c
 str_t  sys_makeFilepath (str_t fn, int complain);
+dbuf_t sys_checkFile (str_t filename);   // like sys_readFile but silent if file does not exist
+void   sys_writeFile (str_t filename, dbuf_t* data);
 
 void   sys_iniTC ();
 void   sys_stopTC ();
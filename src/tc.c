@@ -37,9 +37,36 @@
 tc_t* TC;
 static s1_t tstateLast;
 
+// Last muxs URI obtained from INFOS - lets a reconnect skip the INFOS round trip.
+// Survives tc_free/tc_ini and is bound to the INFOS URI and credential set it came from.
+static struct {
+    char     muxsuri[MAX_URI_LEN+3];   // same encoding as tc->muxsuri
+    char     infosuri[MAX_URI_LEN];
+    u1_t     credset;
+    ustime_t expires;                  // 0 = nothing cached
+} muxsCache;
+
+// Reconnect metrics
+static struct {
+    u4_t     via[3];       // MUXS connections established - indexed by TC_VIA_*
+    u4_t     fallbacks;    // cached muxs URI failed - fell back to INFOS
+    ustime_t downSince;    // connection to MUXS lost at this time (0 = never connected)
+    ustime_t lastLatency;  // time from losing MUXS until reconnected
+} tcStats;
+
+static const char* const VIA_NAMES[] = { "INFOS", "cached URI", "retry" };
+
+
+static void tc_dropMuxsCache () {
+    muxsCache.expires = 0;
+}
+
 
 static void tc_done (tc_t* tc, s1_t tstate) {
+    if( tc->tstate == TC_MUXS_CONNECTED )
+        tcStats.downSince = rt_getTime();
     tc->tstate = tstate;
+    tc->s2ctx.linkDown = 1;  // radio may keep running - spool uplinks
     ws_free(&tc->ws);
     rt_yieldTo(&tc->timeout, tc->ondone);
     sys_inState(SYSIS_TC_DISCONNECTED);
@@ -59,6 +86,27 @@ static void tc_muxs_connection (conn_t* _conn, int ev) {
         rt_clrTimer(&tc->timeout);
         tc->tstate = TC_MUXS_CONNECTED;
         LOG(MOD_TCE|VERBOSE, "Connected to MUXS.");
+        ustime_t now = rt_getTime();
+        tcStats.via[tc->muxsvia] += 1;
+        if( tcStats.downSince ) {
+            tcStats.lastLatency = now - tcStats.downSince;
+            LOG(MOD_TCE|INFO, "MUXS reconnected via %s after %~T (infos=%u cached=%u retry=%u fallbacks=%u)",
+                VIA_NAMES[tc->muxsvia], tcStats.lastLatency,
+                tcStats.via[TC_VIA_INFOS], tcStats.via[TC_VIA_CACHE], tcStats.via[TC_VIA_RETRY], tcStats.fallbacks);
+        }
+        if( tc->muxsvia == TC_VIA_INFOS && TC_MUXS_URI_TTL > 0 ) {
+            str_t tcuri = sys_uri(SYS_CRED_TC, tc->credset);
+            if( tcuri && strlen(tcuri) < sizeof(muxsCache.infosuri) ) {
+                memcpy(muxsCache.muxsuri, tc->muxsuri, sizeof(muxsCache.muxsuri));
+                strcpy(muxsCache.infosuri, tcuri);
+                muxsCache.credset = tc->credset;
+                muxsCache.expires = now + TC_MUXS_URI_TTL;
+            }
+            rt_free((void*)tcuri);
+        }
+        tc->muxsvia = TC_VIA_RETRY;
+        tc->muxsfails = 0;
+        tc->s2ctx.linkDown = 0;
         dbuf_t b = ws_getSendbuf(&tc->ws, MIN_UPJSON_SIZE);
         assert(b.buf != NULL);   // this should not fail on a fresh connection
         uj_encOpen(&b, '{');
@@ -122,6 +170,7 @@ static void tc_connect_muxs (tc_t* tc) {
     char* path     = &u[(u1_t)u[2]];
 
     ws_ini(&tc->ws, TC_RECV_BUFFER_SIZE, TC_SEND_BUFFER_SIZE);
+    tc->ws.rbufmax = TC_RECV_BUFFER_MAX;
     if( tlsmode == URI_TLS && !conn_setup_tls(&tc->ws, SYS_CRED_TC, SYS_CRED_REG, hostname) ) {
         goto errexit;
     }
@@ -223,6 +272,7 @@ static void tc_info_request (conn_t* _conn, int ev) {
             goto failed;
         }
         LOG(MOD_TCE|INFO, "Infos: %s %s %s", router, muxsid, muxsuri);
+        tc->muxsvia = TC_VIA_INFOS;
         err = TC_INFOS_GOT_URI;
       failed:
         tc->tstate = err;
@@ -276,6 +326,7 @@ tc_t* tc_ini (tmrcb_t ondone) {
     assert(TC_RECV_BUFFER_SIZE > MAX_HOSTNAME_LEN + MAX_PORT_LEN + 2);
     tc_t* tc = rt_malloc(tc_t);
     ws_ini(&tc->ws, TC_RECV_BUFFER_SIZE, TC_SEND_BUFFER_SIZE);
+    tc->ws.rbufmax = TC_RECV_BUFFER_MAX;
     rt_iniTimer(&tc->timeout, tc_timeout);
     tc->tstate = TC_INI;
     tc->credset = SYS_CRED_REG;
@@ -315,6 +366,18 @@ void tc_start (tc_t* tc) {
     char hostname[MAX_HOSTNAME_LEN];
     char port[MAX_PORT_LEN];
     int   ok;
+    if( muxsCache.expires ) {
+        ustime_t ttl = muxsCache.expires - rt_getTime();
+        if( ttl > 0 && muxsCache.credset == tc->credset && strcmp(muxsCache.infosuri, tcuri) == 0 ) {
+            LOG(MOD_TCE|INFO, "Skipping INFOS - connecting to cached MUXS URI (valid for %~T)", ttl);
+            rt_free((void*)tcuri);
+            memcpy(tc->muxsuri, muxsCache.muxsuri, sizeof(tc->muxsuri));
+            tc->muxsvia = TC_VIA_CACHE;
+            tc_connect_muxs(tc);
+            return;
+        }
+        tc_dropMuxsCache();
+    }
     if( (ok = uri_checkHostPortUri(tcuri, "ws", hostname, MAX_HOSTNAME_LEN, port, MAX_PORT_LEN)) == URI_BAD ) {
         LOG(MOD_TCE|ERROR,"Bad TC URI: %s", tc);
         goto errexit;
@@ -349,7 +412,13 @@ void tc_continue (tc_t* tc) {
         return;
     }
 
-    if( tstate == TC_INFOS_BACKOFF ) {
+    if( tc->muxsvia == TC_VIA_CACHE || tstate == TC_INFOS_BACKOFF ) {
+        if( tc->muxsvia == TC_VIA_CACHE ) {
+            // Cached muxs URI did not work - ask INFOS right away
+            LOG(MOD_TCE|INFO, "Cached MUXS URI failed - falling back to INFOS");
+            tc_dropMuxsCache();
+            tcStats.fallbacks += 1;
+        }
         int retries_old = tc->retries;
         tmrcb_t ondone = tc->ondone;
         assert(TC == tc);
@@ -366,8 +435,12 @@ void tc_continue (tc_t* tc) {
     }
 
     if( tc->muxsuri[0] != URI_BAD ) {
-        // We have a muxs uri
-        if( tc->retries <= 4 && tstate == TC_ERR_CLOSED ) {
+        // We have a muxs uri - a dropped connection is retried directly.
+        // A failed or timed out reconnect gets one more attempt (muxs restarting),
+        // after that the muxs is likely gone and INFOS should tell us where to go.
+        int retry = tstate == TC_ERR_CLOSED ||
+            ((tstate == TC_ERR_FAILED || tstate == TC_ERR_TIMEOUT) && tc->muxsfails++ == 0);
+        if( tc->retries <= 4 && retry ) {
             // Try to reconnect with increasing backoff
             int backoff = 1 << tc->retries;
             tc->tstate = TC_MUXS_BACKOFF;
@@ -375,6 +448,11 @@ void tc_continue (tc_t* tc) {
             LOG(MOD_TCE|INFO, "MUXS reconnect backoff %ds (retry %d)", backoff, tc->retries);
             return;
         }
+        if( tc->muxsfails ) {
+            // Muxs refused a reconnect - cached URI points to the same place
+            tc_dropMuxsCache();
+            tcStats.fallbacks += 1;
+        }
         tc->muxsuri[0] = URI_BAD;
         tc->retries = 1;
     }
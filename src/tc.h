@@ -50,12 +50,20 @@ enum {
     TC_ERR_DEAD          = -6,
 };
 
+enum {
+    TC_VIA_INFOS = 0,     // muxs URI just obtained from INFOS
+    TC_VIA_CACHE,         // cached muxs URI from an earlier INFOS answer
+    TC_VIA_RETRY,         // reconnect after an established muxs connection closed
+};
+
 typedef struct tc {
     ws_t     ws;          // WS connection state
     tmr_t    timeout;
     s1_t     tstate;      // state of TC engine
     u1_t     credset;     // connect via this credential set
     u1_t     retries;
+    u1_t     muxsvia;     // how we got muxsuri - TC_VIA_*
+    u1_t     muxsfails;   // failed direct reconnects to muxsuri
     char     muxsuri[MAX_URI_LEN+3];
     tmrcb_t  ondone;
     s2ctx_t  s2ctx;
@@ -32,6 +32,8 @@
 #include "tc.h"
 #include "timesync.h"
 #include "ral.h"
+#include "quantile.h"
+#include "metrics.h"
 
 #if defined(CFG_smtcpico)
 #define _MAX_DT 300
@@ -41,10 +43,14 @@
 
 #define SYNC_QUAL_GOOD        100  // values considered good
 #define SYNC_QUAL_THRES        90  // cut off quantile - for sync quality
-#define N_SYNC_QUAL            30  // size of sync quality table
+#define N_SYNC_QUAL            30  // window of sync quality samples
 #define MCU_DRIFT_THRES        90  // cut off quantile - for MCU sync quality
 #define PPS_DRIFT_THRES        80  // cut off quantile - for PPS sync quality
-#define N_DRIFTS               20  // size of quantile table MCU/PPS
+#define N_DRIFTS               20  // window of drift samples MCU/PPS
+#define N_CLKFIT               16  // window of MCU/SX130X samples for least squares clock model
+#define CLKFIT_MIN              4  // min samples before skew of clock model is applied
+#define CLKFIT_OUTLIER        3.0  // drop samples with residual beyond this multiple of rms
+#define CLKFIT_MIN_RESIDUAL   5.0  //   - but never below this residual (us)
 #define QUICK_RETRIES           3
 #define PPM       ((sL_t)1000000)  // 1sec in micros
 #define iPPM_SCALE             10  // keep drifts in deci ppm as ints
@@ -60,27 +66,24 @@
 #define UTC_GPS_EPOCH_US 315964800 // UTC epoch expressed in s since GPS epoch
 
 #define ustimeRoundSecs(x) (((x) + PPM/2) / PPM * PPM)
-#define ustime2xtime(sync, _ustime) ((sync)->xtime + ((_ustime)-(sync)->ustime))
 #define xtime2ustime(sync, _xtime)  ((sync)->ustime + ((_xtime)-(sync)->xtime))
-#define xtime2xtime(src_sync, dst_sync, _xtime)                 \
-    (((dst_sync)->xtime - (src_sync)->xtime) +                  \
-     ((src_sync)->ustime - (dst_sync)->ustime) + (_xtime))
 
 
-struct quants {
-    int qmin, q50, q80, qmax;
+_Static_assert(N_DRIFTS <= WQ_MAX_SAMPLES && N_SYNC_QUAL <= WQ_MAX_SAMPLES, "quantile windows too large");
+
+// Window of absolute drifts with exact quantiles
+struct drift_quants {
+    wquant_t win;
+    int      thresQ;
 };
 
 static struct txunit_stats {
     int excessive_drift_cnt;
     int drift_thres;   // drift threshold (MCU_DRIFT_THRES quantile)
-    int mcu_drifts[N_DRIFTS];
-    int mcu_drifts_widx;
+    struct drift_quants mcu_drifts;
 } txunit_stats[MAX_TXUNITS];
-static int         sum_mcu_drifts;    // sum of txunit_stats[0].mcu_drifts
 
-static int         pps_drifts[N_DRIFTS];
-static int         pps_drifts_widx;
+static struct drift_quants pps_drifts;
 static int         pps_drifts_thres; // drift threshold (PPS_DRIFT_THRES quantile)
 static u4_t        no_pps_thres;     // when to issue next error
 static ustime_t    ppsOffset;        // denotes where the PPS occurs on ustime_t, -1: unknown, otherwise 0..1e6-1
@@ -91,13 +94,25 @@ static ustime_t    lastReport;       // report time sync status regularly
 static timesync_t  timesyncs[MAX_TXUNITS];
 static timesync_t  ppsSync;          // last good PPS sync
 static s1_t        syncWobble;
+
+// Linear clock model per txunit: ustime = ustime0 + (xtime - xtime0) * (1 + skew)
+// Fitted by least squares over the last N_CLKFIT accepted time syncs.
+static struct clkmodel {
+    sL_t     xtimes[N_CLKFIT];
+    ustime_t ustimes[N_CLKFIT];
+    int      n, widx;
+    sL_t     xtime0;
+    ustime_t ustime0;
+    double   skew;
+} clkmodels[MAX_TXUNITS];
 static u1_t        wsBufFull;
-static int         syncQual[N_SYNC_QUAL];
-static int         syncQual_widx;
+static wquant_t    syncQual;        // window of absolute sync qualities
+static int         syncQual_last;
 static int         syncQual_thres;  // current threshold
 
 // Fwd decl
 static void onTimesyncLns (tmr_t* tmr);
+static ustime_t clk_xtime2ustime (u1_t txunit, sL_t xtime);
 
 
 static void timesyncReport (int force) {
@@ -105,14 +120,14 @@ static void timesyncReport (int force) {
     if( !force && now < lastReport + TIMESYNC_REPORTS )
         return;
     lastReport = now;
-    uL_t pps_ustime = timesyncs[0].pps_xtime != 0 ? xtime2ustime(&timesyncs[0], timesyncs[0].pps_xtime) : 0;
+    uL_t pps_ustime = timesyncs[0].pps_xtime != 0 ? clk_xtime2ustime(0, timesyncs[0].pps_xtime) : 0;
     LOG(MOD_SYN|INFO, "Time sync: NOW          ustime=0x%012lX utc=0x%lX gpsOffset=0x%lX ppsOffset=%ld syncQual=%d\n",
-        now, rt_ustime2utc(now),  gpsOffset, ppsOffset, syncQual[0]);
+        now, rt_ustime2utc(now),  gpsOffset, ppsOffset, syncQual_last);
     LOG(MOD_SYN|INFO, "Time sync: MCU/SX130X#0 ustime=0x%012lX xtime=0x%lX pps_ustime=0x%lX pps_xtime=0x%lX",
         timesyncs[0].ustime, timesyncs[0].xtime, pps_ustime, timesyncs[0].pps_xtime);
     if( !ppsOffset )
         return;
-    pps_ustime = xtime2ustime(&timesyncs[0], ppsSync.pps_xtime);
+    pps_ustime = clk_xtime2ustime(0, ppsSync.pps_xtime);
     LOG(MOD_SYN|INFO, "Time sync: Last PPS     ustime=0x%012lX xtime=0x%lX pps_ustime=0x%lX pps_xtime=0x%lX",
         ppsSync.ustime, ppsSync.xtime, pps_ustime, ppsSync.pps_xtime);
     if( !gpsOffset )
@@ -128,63 +143,128 @@ static int encodeDriftPPM (double drift) {
     return (int)round((drift - 1.0) * PPM * iPPM_SCALE);
 }
 
-static double decodeDriftPPM (double scaled_ppm) {
-    return 1.0 + scaled_ppm / (PPM * fPPM_SCALE);
+static void drift_quants_ini (struct drift_quants* dq, int thresQ) {
+    wq_ini(&dq->win);
+    dq->thresQ = thresQ;
 }
 
-static double decodePPM (double scaled_ppm) {
-    return scaled_ppm / fPPM_SCALE;
+// Returns true if a window of N_DRIFTS samples is complete
+static int drift_quants_add (struct drift_quants* dq, int drift) {
+    return wq_add(&dq->win, abs(drift)) >= N_DRIFTS;
 }
 
-static int cmp_abs_int (const void* a, const void* b) {
-    return abs(*(int*)a) - abs(*(int*)b);
+// Report stats of completed window and start a new one
+static int log_drift_stats (str_t msg, struct drift_quants* dq) {
+    wquant_t* w = &dq->win;
+    int thres = wq_quantile(w, dq->thresQ);
+    LOG(MOD_SYN|INFO, "%s: min: %4.1fppm  q50: %4.1fppm  q80: %4.1fppm  max: %4.1fppm - threshold q%d: %4.1fppm",
+        msg,
+        wq_min(w) / fPPM_SCALE, wq_quantile(w, 50) / fPPM_SCALE,
+        wq_quantile(w, 80) / fPPM_SCALE, wq_max(w) / fPPM_SCALE,
+        dq->thresQ, thres / fPPM_SCALE);
+    wq_reset(w);
+    return thres;
 }
 
-static int drift_stats (int* drifts, struct quants *q, int thresQ, int* auxQ) {
-    int sorted_drifts[N_DRIFTS];
-    memcpy(sorted_drifts, drifts, sizeof(sorted_drifts));
-    qsort(sorted_drifts,N_DRIFTS,sizeof(sorted_drifts[0]), cmp_abs_int);
-    q->qmin = sorted_drifts[0];
-    q->q50  = sorted_drifts[N_DRIFTS/2];
-    q->q80  = sorted_drifts[(N_DRIFTS*80+50)/100];
-    q->qmax = sorted_drifts[N_DRIFTS-1];
-    if( auxQ )
-        *auxQ = sorted_drifts[(*auxQ*N_DRIFTS+50)/100];
-    return sorted_drifts[(thresQ*N_DRIFTS+50)/100];
+
+// Fit offset/skew relative to the newest sample. Used samples are marked in mask.
+// Returns number of samples used.
+static int clkfit (struct clkmodel* m, u4_t mask, double* offset, double* slope) {
+    int newest = (m->widx + N_CLKFIT - 1) % N_CLKFIT;
+    double sx = 0, su = 0, sxx = 0, sxu = 0;
+    int n = 0;
+    for( int i=0; i<m->n; i++ ) {
+        if( !(mask & (1<<i)) )
+            continue;
+        double dx = m->xtimes[i] - m->xtimes[newest];
+        double du = m->ustimes[i] - m->ustimes[newest];
+        sx += dx; su += du; sxx += dx*dx; sxu += dx*du;
+        n += 1;
+    }
+    double det = n*sxx - sx*sx;
+    if( n < 2 || det <= 0 ) {
+        *offset = 0;
+        *slope = 1.0;
+        return n;
+    }
+    *slope = (n*sxu - sx*su) / det;
+    *offset = (su - *slope*sx) / n;
+    return n;
 }
 
-static int log_drift_stats (str_t msg, int* drifts, int thresQ, int* auxQ) {
-    struct quants q;
-    int thres = drift_stats(drifts, &q, thresQ, auxQ);
-    LOG(MOD_SYN|INFO, "%s: min: %+4.1fppm  q50: %+4.1fppm  q80: %+4.1fppm  max: %+4.1fppm - threshold q%d: %+4.1fppm",
-        msg,
-        q.qmin / fPPM_SCALE, q.q50 / fPPM_SCALE, q.q80 / fPPM_SCALE, q.qmax / fPPM_SCALE,
-        thresQ, thres / fPPM_SCALE);
-    return thres;
+static void clkmodelUpdate (u1_t txunit, const timesync_t* curr) {
+    struct clkmodel* m = &clkmodels[txunit];
+    if( m->n && ral_xtime2sess(m->xtimes[(m->widx + N_CLKFIT - 1) % N_CLKFIT]) != ral_xtime2sess(curr->xtime) )
+        m->n = m->widx = 0;   // new SX130X session - counter restarted
+    m->xtimes[m->widx] = curr->xtime;
+    m->ustimes[m->widx] = curr->ustime;
+    m->widx = (m->widx + 1) % N_CLKFIT;
+    m->n = min(m->n + 1, N_CLKFIT);
+    m->xtime0 = curr->xtime;
+    m->ustime0 = curr->ustime;
+    m->skew = 0.0;
+    if( m->n < CLKFIT_MIN )
+        return;
+
+    int newest = (m->widx + N_CLKFIT - 1) % N_CLKFIT;
+    u4_t mask = (1<<m->n) - 1;
+    double offset, slope;
+    clkfit(m, mask, &offset, &slope);
+    // Reject outliers (e.g. delayed SPI transactions) and refit
+    double rss = 0;
+    for( int i=0; i<m->n; i++ ) {
+        double r = (m->ustimes[i] - m->ustimes[newest]) - offset - slope * (m->xtimes[i] - m->xtimes[newest]);
+        rss += r*r;
+    }
+    double lim = max(CLKFIT_MIN_RESIDUAL, CLKFIT_OUTLIER * sqrt(rss / m->n));
+    for( int i=0; i<m->n; i++ ) {
+        double r = (m->ustimes[i] - m->ustimes[newest]) - offset - slope * (m->xtimes[i] - m->xtimes[newest]);
+        if( fabs(r) > lim )
+            mask &= ~(1<<i);
+    }
+    if( clkfit(m, mask, &offset, &slope) < CLKFIT_MIN )
+        return;
+    double skew = slope - 1.0;
+    if( fabs(skew) * PPM > _MAX_DT ) {
+        LOG(MOD_SYN|WARNING, "Clock model MCU/SX130X#%d: implausible skew %.1fppm - ignored", txunit, skew*PPM);
+        return;
+    }
+    m->ustime0 = curr->ustime + (ustime_t)round(offset);
+    m->skew = skew;
+    LOG(MOD_SYN|XDEBUG, "Clock model MCU/SX130X#%d: skew=%.2fppm offset=%.1fus (%d/%d samples)",
+        txunit, skew*PPM, offset, __builtin_popcount(mask), m->n);
+}
+
+static ustime_t clk_xtime2ustime (u1_t txunit, sL_t xtime) {
+    const struct clkmodel* m = &clkmodels[txunit];
+    sL_t dx = xtime - m->xtime0;
+    return m->ustime0 + dx + (sL_t)round(dx * m->skew);
+}
+
+static sL_t clk_ustime2xtime (u1_t txunit, ustime_t ustime) {
+    const struct clkmodel* m = &clkmodels[txunit];
+    sL_t du = ustime - m->ustime0;
+    return m->xtime0 + (sL_t)round(du / (1.0 + m->skew));
 }
 
 
 ustime_t ts_normalizeTimespanMCU (ustime_t timespan) {
-    
-    
-    return (ustime_t)round(timespan / decodeDriftPPM((double)sum_mcu_drifts / N_DRIFTS));
-    return (ustime_t)round( timespan / (1.0 + sum_mcu_drifts / (PPM*iPPM_SCALE) / N_DRIFTS) );
+    return (ustime_t)round(timespan / (1.0 + clkmodels[0].skew));
 }
 
 ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
-    syncQual[syncQual_widx] = quality;
-    syncQual_widx = (syncQual_widx + 1) % N_SYNC_QUAL;
-    if( syncQual_widx == 0 ) {
-        int sorted_qual[N_SYNC_QUAL];
-        memcpy(sorted_qual, syncQual, sizeof(sorted_qual));
-        qsort(sorted_qual,N_SYNC_QUAL,sizeof(sorted_qual[0]),cmp_abs_int);
-        int thres = sorted_qual[(N_SYNC_QUAL*SYNC_QUAL_THRES+50)/100];
+    syncQual_last = quality;
+    metrics_observe(MH_SYNC_QUALITY, abs(quality));
+    if( wq_add(&syncQual, abs(quality)) >= N_SYNC_QUAL ) {
+        int thres = wq_quantile(&syncQual, SYNC_QUAL_THRES);
         LOG(MOD_SYN|INFO, "Time sync qualities: min=%d q%d=%d max=%d (previous q%d=%d)",
-            sorted_qual[0], SYNC_QUAL_THRES, thres, sorted_qual[N_SYNC_QUAL-1], SYNC_QUAL_THRES, syncQual_thres);
-        syncQual_thres = max(SYNC_QUAL_GOOD, abs(thres));
+            wq_min(&syncQual), SYNC_QUAL_THRES, thres, wq_max(&syncQual), SYNC_QUAL_THRES, syncQual_thres);
+        syncQual_thres = max(SYNC_QUAL_GOOD, thres);
+        wq_reset(&syncQual);
     }
     if( abs(quality) > syncQual_thres ) {
         LOG(MOD_SYN|VERBOSE, "Time sync rejected: quality=%d threshold=%d", quality, syncQual_thres);
+        metrics.tsRejected += 1;
         return TIMESYNC_RADIO_INTV;
     }
 
@@ -192,6 +272,7 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     if( last->ustime == 0 ) {
         // Very first call - just setup last
         *last = *curr;
+        clkmodelUpdate(txunit, curr);
         return TIMESYNC_RADIO_INTV;
     }
     ustime_t dus = curr->ustime - last->ustime;
@@ -207,17 +288,10 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     }
     struct txunit_stats* stats = &txunit_stats[txunit];
     int drift_ppm = encodeDriftPPM( (double)dus/(double)dxc );
-    if( txunit == 0 )
-        sum_mcu_drifts += drift_ppm - stats->mcu_drifts[stats->mcu_drifts_widx];
-    stats->mcu_drifts[stats->mcu_drifts_widx] = drift_ppm;
-    stats->mcu_drifts_widx = (stats->mcu_drifts_widx + 1) % N_DRIFTS;
-    if( stats->mcu_drifts_widx == 0 ) {
-        
-        
-        
-        int thres = log_drift_stats("MCU/SX130X drift stats", stats->mcu_drifts, MCU_DRIFT_THRES, NULL);
-        stats->drift_thres = max(MIN_MCU_DRIFT_THRES, min(MAX_MCU_DRIFT_THRES, abs(thres)));
-        double mean_ppm = decodePPM( ((double)sum_mcu_drifts) / N_DRIFTS);
+    if( drift_quants_add(&stats->mcu_drifts, drift_ppm) ) {
+        int thres = log_drift_stats("MCU/SX130X drift stats", &stats->mcu_drifts);
+        stats->drift_thres = max(MIN_MCU_DRIFT_THRES, min(MAX_MCU_DRIFT_THRES, thres));
+        double mean_ppm = clkmodels[0].skew * PPM;
         LOG(MOD_SYN|INFO, "Mean MCU drift vs SX130X#0: %.1fppm",  mean_ppm);
         if( rt_utcOffset_ts != 0 && !ppsSync.pps_xtime) {
             rt_utcOffset -= (curr->ustime - rt_utcOffset_ts) * mean_ppm/PPM;
@@ -275,10 +349,8 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     // Update PPS drift stats
     double pps_drift = (double)(curr->pps_xtime - last->pps_xtime)
         / (double)((curr->pps_xtime - last->pps_xtime + PPM/2) / PPM * PPM);
-    pps_drifts[pps_drifts_widx] = encodeDriftPPM(pps_drift);
-    pps_drifts_widx = (pps_drifts_widx + 1) % N_DRIFTS;
-    if( pps_drifts_widx == 0 )
-        pps_drifts_thres = log_drift_stats("PPS/SX130X drift stats", pps_drifts, PPS_DRIFT_THRES, NULL);
+    if( drift_quants_add(&pps_drifts, encodeDriftPPM(pps_drift)) )
+        pps_drifts_thres = log_drift_stats("PPS/SX130X drift stats", &pps_drifts);
 
     ustime_t pps_ustime = xtime2ustime(curr, curr->pps_xtime);
     ustime_t off = pps_ustime % PPM;
@@ -312,6 +384,7 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     ppsSync = *curr;
   done:
     *last = *curr;
+    clkmodelUpdate(txunit, curr);
     return delay;
 }
 
@@ -331,7 +404,7 @@ sL_t ts_gpstime2xtime (u1_t txunit, sL_t gpstime) {
         return 0;
     }
     sL_t xtime = gpstime - gpsOffset + ppsSync.pps_xtime;
-    return txunit==0 ? xtime : xtime2xtime(&ppsSync, &timesyncs[txunit], xtime);
+    return txunit==0 ? xtime : clk_ustime2xtime(txunit, clk_xtime2ustime(0, xtime));
 }
 
 
@@ -352,8 +425,7 @@ sL_t ts_xtime2gpstime (sL_t xtime) {
 sL_t ts_ustime2xtime (u1_t txunit, ustime_t ustime) {
     if( txunit >= MAX_TXUNITS || timesyncs[txunit].xtime == 0 )
         return 0; // cannot convert
-    const timesync_t* sync = &timesyncs[txunit];
-    return ustime2xtime(sync, ustime);
+    return clk_ustime2xtime(txunit, ustime);
 }
 
 
@@ -370,7 +442,7 @@ ustime_t ts_xtime2ustime (sL_t xtime) {
             xtime, ral_xtime2sess(xtime), ral_xtime2sess(sync->xtime));
         return 0;
     }
-    return xtime2ustime(sync, xtime);
+    return clk_xtime2ustime(txunit, xtime);
 }
 
 
@@ -384,9 +456,7 @@ sL_t ts_xtime2xtime (sL_t xtime, u1_t dst_txunit) {
         LOG(MOD_SYN|ERROR, "Cannot convert xtime=%ld from txunit#%d to txunit#%d", xtime, src_txunit, dst_txunit);
         return 0; // cannot convert
     }
-    const timesync_t* src_sync = &timesyncs[src_txunit];
-    const timesync_t* dst_sync = &timesyncs[dst_txunit];
-    return xtime2xtime(src_sync, dst_sync, xtime);
+    return clk_ustime2xtime(dst_txunit, clk_xtime2ustime(src_txunit, xtime));
 }
 
 
@@ -427,15 +497,18 @@ void ts_iniTimesync () {
     no_pps_thres = NO_PPS_ALARM_INI;
     memset(&ppsSync, 0, sizeof(ppsSync));   // no PPS ever seen
     memset(&txunit_stats, 0, sizeof(txunit_stats));
-    for( int i=0; i<MAX_TXUNITS; i++ )
+    for( int i=0; i<MAX_TXUNITS; i++ ) {
         txunit_stats[i].drift_thres = MAX_MCU_DRIFT_THRES;
+        drift_quants_ini(&txunit_stats[i].mcu_drifts, MCU_DRIFT_THRES);
+    }
+    drift_quants_ini(&pps_drifts, PPS_DRIFT_THRES);
+    wq_ini(&syncQual);
     syncWobble = -1;
-    pps_drifts_widx = 0;
     syncQual_thres = INT_MAX;
     syncLnsCnt = 0;
     lastReport = 0;
-    sum_mcu_drifts = 0;
     memset(timesyncs, 0, sizeof(timesyncs));
+    memset(clkmodels, 0, sizeof(clkmodels));
     rt_clrTimer(&syncLnsTmr);
 }
 
@@ -503,7 +576,7 @@ void ts_processTimesyncLns (ustime_t txtime, ustime_t rxtime, sL_t gpstime) {
     if( sys_modePPS == PPS_FUZZY ) {
         // In this timing mode the PPS of the gateway and the PPS of the server are not aligned.
         // This mode facilitates beaconing while not perfectly aligned to an absolute GPS time.
-        sL_t xtime = ustime2xtime(&timesyncs[0], (txtime + rxtime)/2);
+        sL_t xtime = clk_ustime2xtime(0, (txtime + rxtime)/2);
         LOG(MOD_SYN|INFO, "Timesync with LNS - fuzzy PPS: tx/rx=0x%lX..0x%lX xtime=0x%lX gpsOffset=0x%lX", txtime, rxtime, xtime, gpsOffset);
         ts_setTimesyncLns(xtime, gpstime);
         return;
@@ -535,8 +608,7 @@ void ts_processTimesyncLns (ustime_t txtime, ustime_t rxtime, sL_t gpstime) {
     // Only one solution - calculate the GPS time label
     //    us_s (localtime) equivalent to gps_s (GPS seconds since epoch)
     // Translate into a seconds offset
-    const timesync_t* sync0 = &timesyncs[0];
-    sL_t pps_xtime_inferred = ustime2xtime(sync0, us_s);    // inferred PPS pulse in xtime (subject to ustime->xtime error)
+    sL_t pps_xtime_inferred = clk_ustime2xtime(0, us_s);    // inferred PPS pulse in xtime (subject to ustime->xtime error)
     sL_t delta  = ustimeRoundSecs(pps_xtime_inferred - ppsSync.pps_xtime);  // seconds between last latched PPS and inferred
     sL_t pps_xtime = ppsSync.pps_xtime + delta;
     sL_t jitter = pps_xtime - pps_xtime_inferred;
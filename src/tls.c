@@ -130,6 +130,10 @@ tlsconf_t* tls_makeConf (mbedtls_x509_crt* trust, mbedtls_x509_crt* mycert, mbed
     if( (ret = mbedtls_ssl_conf_max_frag_len(&conf->sslconfig, CFG_max_tls_frag_len)) != 0)
         rt_fatal("mbedtls_ssl_conf_max_frag_len", ret);
 #endif // CFG_max_tls_frag_len
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf->sslconfig,
+                                     TLS_RESUME ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif // MBEDTLS_SSL_SESSION_TICKETS
 #if defined(CFG_tlsdebug)
     mbedtls_ssl_conf_dbg(&conf->sslconfig, log_mbedDebug, NULL );
     mbedtls_debug_set_threshold(tls_dbgLevel);  // 0=off, 1=error, 2=state change, 3=info, 4=verbose
@@ -294,6 +298,200 @@ void tls_freeSession (tlsctx_p tlsctx) {
     }
 }
 
+
+// --------------------------------------------------------------------------------
+//
+// Session resumption
+//
+// --------------------------------------------------------------------------------
+//
+// Sessions are cached per credential category (CUPS/TC) and peer (host:port).
+// A reconnect offers the cached session (ticket or session ID) and, if the server
+// still knows it, skips certificate exchange and key agreement.
+// TC alternates between INFOS and MUXS - hence more than one slot per category.
+//
+enum { TLS_SESS_SLOTS = 2 };
+enum { MAX_PEER_LEN = MAX_HOSTNAME_LEN+MAX_PORT_LEN+2 };
+
+typedef struct tlssess {
+    mbedtls_ssl_session sess;
+    ustime_t used;              // last use - 0 = slot empty
+    s1_t     credset;           // credential set the session was established with
+    char     peer[MAX_PEER_LEN];
+} tlssess_t;
+
+static tlssess_t* sessCache[SYS_CRED_MAX];
+
+
+static void persistSessions (int cred_cat) {
+    if( !TLS_SESSION_PERSIST )
+        return;
+    tlssess_t* cache = sessCache[cred_cat];
+    int bufsize = TLS_SESS_SLOTS * (MAX_PEER_LEN + 4096);   // session blob includes peer cert
+    u1_t* buf = rt_mallocN(u1_t, bufsize);
+    dbuf_t b = { .buf=(char*)buf, .bufsize=bufsize, .pos=0 };
+    for( int i=0; i < TLS_SESS_SLOTS; i++ ) {
+        tlssess_t* e = &cache[i];
+        if( e->used == 0 )
+            continue;
+        // Record: credset(1) peerlen(1) peer blen(2,LE) blob
+        int plen = strlen(e->peer);
+        size_t blen = 0;
+        int off = b.pos + 4 + plen;
+        if( off > b.bufsize ||
+            mbedtls_ssl_session_save(&e->sess, buf+off, b.bufsize-off, &blen) != 0 )
+            continue;
+        buf[b.pos+0] = e->credset;
+        buf[b.pos+1] = plen;
+        memcpy(buf+b.pos+2, e->peer, plen);
+        buf[b.pos+2+plen] = blen;
+        buf[b.pos+3+plen] = blen>>8;
+        b.pos = off + blen;
+    }
+    char fn[32];
+    snprintf(fn, sizeof(fn), "~temp/tls-%s.session", sys_credcat2str(cred_cat));
+    sys_writeFile(fn, &b);
+    rt_free(buf);
+}
+
+
+static void loadSessions (int cred_cat) {
+    char fn[32];
+    snprintf(fn, sizeof(fn), "~temp/tls-%s.session", sys_credcat2str(cred_cat));
+    dbuf_t b = sys_checkFile(fn);
+    if( b.buf == NULL )
+        return;
+    u1_t* p = (u1_t*)b.buf;
+    int pos = 0, slot = 0;
+    while( slot < TLS_SESS_SLOTS && pos+4 <= b.bufsize ) {
+        int plen = p[pos+1];
+        if( plen >= MAX_PEER_LEN || pos+4+plen > b.bufsize )
+            break;
+        int blen = p[pos+2+plen] | (p[pos+3+plen]<<8);
+        int off = pos+4+plen;
+        if( off+blen > b.bufsize )
+            break;
+        tlssess_t* e = &sessCache[cred_cat][slot];
+        if( mbedtls_ssl_session_load(&e->sess, p+off, blen) == 0 ) {
+            e->credset = p[pos];
+            memcpy(e->peer, p+pos+2, plen);
+            e->peer[plen] = 0;
+            e->used = rt_getTime();
+            slot += 1;
+        } else {
+            mbedtls_ssl_session_free(&e->sess);
+            mbedtls_ssl_session_init(&e->sess);
+        }
+        pos = off+blen;
+    }
+    LOG(MOD_AIO|INFO, "Loaded %d TLS session(s) from %s", slot, fn);
+    rt_free(b.buf);
+}
+
+
+// Find cached session for peer - if alloc is set evict the least recently used slot if none found
+static tlssess_t* findSession (int cred_cat, const char* peer, int alloc) {
+    if( !TLS_RESUME || cred_cat < 0 || cred_cat >= SYS_CRED_MAX )
+        return NULL;
+    if( sessCache[cred_cat] == NULL ) {
+        sessCache[cred_cat] = rt_mallocN(tlssess_t, TLS_SESS_SLOTS);
+        for( int i=0; i < TLS_SESS_SLOTS; i++ )
+            mbedtls_ssl_session_init(&sessCache[cred_cat][i].sess);
+        if( TLS_SESSION_PERSIST )
+            loadSessions(cred_cat);
+    }
+    tlssess_t* cache = sessCache[cred_cat];
+    tlssess_t* lru = &cache[0];
+    for( int i=0; i < TLS_SESS_SLOTS; i++ ) {
+        if( cache[i].used && strcmp(cache[i].peer, peer) == 0 )
+            return &cache[i];
+        if( cache[i].used < lru->used )
+            lru = &cache[i];
+    }
+    if( !alloc )
+        return NULL;
+    mbedtls_ssl_session_free(&lru->sess);
+    mbedtls_ssl_session_init(&lru->sess);
+    lru->used = 0;
+    return lru;
+}
+
+
+int tls_resumeSession (tlsctx_p tlsctx, int cred_cat, int cred_set, const char* peer) {
+    tlssess_t* e = findSession(cred_cat, peer, 0);
+    if( e == NULL )
+        return 0;
+    if( e->credset != cred_set ) {
+        // Session belongs to other client credentials - don't mix identities
+        tls_dropSession(cred_cat, peer);
+        return 0;
+    }
+    int ret;
+    if( (ret = mbedtls_ssl_set_session(tlsctx, &e->sess)) != 0 ) {
+        log_mbedError(MOD_AIO|WARNING, ret, "Failed to offer cached TLS session to %s", peer);
+        return 0;
+    }
+    e->used = rt_getTime();
+    return 1;
+}
+
+
+int tls_saveSession (tlsctx_p tlsctx, int cred_cat, int cred_set, const char* peer) {
+    tlssess_t* e = findSession(cred_cat, peer, 1);
+    if( e == NULL )
+        return 0;
+    mbedtls_ssl_session sess;
+    mbedtls_ssl_session_init(&sess);
+    int ret;
+    if( (ret = mbedtls_ssl_get_session(tlsctx, &sess)) != 0 ) {
+        log_mbedError(MOD_AIO|WARNING, ret, "Failed to retrieve TLS session for %s", peer);
+        mbedtls_ssl_session_free(&sess);
+        return 0;
+    }
+    // An abbreviated handshake reuses the master secret of the offered session.
+    // A full handshake derives a fresh one - session IDs cannot tell them apart
+    // since with tickets the client makes up a random ID which the server echoes.
+    int resumed = (e->used && e->credset == cred_set &&
+                   memcmp(e->sess.master, sess.master, sizeof(sess.master)) == 0);
+    int changed = !resumed;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    // Server may have renewed the ticket while resuming
+    if( !changed && (e->sess.ticket_len != sess.ticket_len ||
+                     (sess.ticket_len > 0 && memcmp(e->sess.ticket, sess.ticket, sess.ticket_len) != 0)) )
+        changed = 1;
+#endif // MBEDTLS_SSL_SESSION_TICKETS
+    e->used = rt_getTime();
+    if( !changed ) {
+        mbedtls_ssl_session_free(&sess);
+        return resumed;
+    }
+    mbedtls_ssl_session_free(&e->sess);
+    e->sess = sess;
+    e->credset = cred_set;
+    snprintf(e->peer, sizeof(e->peer), "%s", peer);
+    persistSessions(cred_cat);
+    return resumed;
+}
+
+
+void tls_dropSession (int cred_cat, const char* peer) {
+    if( cred_cat < 0 || cred_cat >= SYS_CRED_MAX || sessCache[cred_cat] == NULL )
+        return;
+    tlssess_t* cache = sessCache[cred_cat];
+    int dirty = 0;
+    for( int i=0; i < TLS_SESS_SLOTS; i++ ) {
+        if( cache[i].used && (peer == NULL || strcmp(cache[i].peer, peer) == 0) ) {
+            mbedtls_ssl_session_free(&cache[i].sess);
+            mbedtls_ssl_session_init(&cache[i].sess);
+            cache[i].used = 0;
+            dirty = 1;
+        }
+    }
+    if( dirty )
+        persistSessions(cred_cat);
+}
+
+
 int tls_write(mbedtls_net_context* netctx, tlsctx_p tlsctx, const u1_t* p, size_t sz) {
     if( tlsctx )
         return mbedtls_ssl_write(tlsctx, p, sz);
@@ -45,6 +45,11 @@ int        tls_setTrustedCAs (tlsconf_t* conf, const char* file_or_data, int len
 tlsctx_p   tls_makeSession   (tlsconf_t* conf, const char* servername);
 void       tls_freeSession   (tlsctx_p tlsctx);
 
+// Session resumption - cached per credential category (SYS_CRED_CUPS/TC) and peer (host:port)
+int        tls_resumeSession (tlsctx_p tlsctx, int cred_cat, int cred_set, const char* peer);  // 1=cached session offered
+int        tls_saveSession   (tlsctx_p tlsctx, int cred_cat, int cred_set, const char* peer);  // 1=handshake was resumed
+void       tls_dropSession   (int cred_cat, const char* peer);                                 // peer==NULL: all of cred_cat
+
 int tls_read  (mbedtls_net_context* netctx, tlsctx_p tlsctx,       u1_t* p, size_t sz);
 int tls_write (mbedtls_net_context* netctx, tlsctx_p tlsctx, const u1_t* p, size_t sz);
 
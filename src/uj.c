@@ -28,6 +28,12 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "uj.h"
 #include "xq.h"     // %J - txjob only
 #include "kwcrc.h"
@@ -45,8 +51,75 @@ static void backChar (ujdec_t* dec) {
     dec->read_pos -= 1;
 }
 
+// Bulk scanning - 16 bytes at a time where the CPU has vectors.
+// Never reads beyond p+n.
+
+#if defined(__SSE2__)
+static int vecMask (__m128i m) {
+    return _mm_movemask_epi8(m);
+}
+#define VEC_T           __m128i
+#define VEC_LOAD(p)     _mm_loadu_si128((const __m128i*)(p))
+#define VEC_SET(c)      _mm_set1_epi8(c)
+#define VEC_EQ(a,b)     _mm_cmpeq_epi8(a,b)
+#define VEC_OR(a,b)     _mm_or_si128(a,b)
+#define VEC_MASK_T      int
+#define VEC_ALL         0xFFFF
+#define VEC_FIRST(m)    __builtin_ctz(m)
+#elif defined(__ARM_NEON)
+static uint64_t vecMask (uint8x16_t m) {
+    // 4 bits per byte
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+#define VEC_T           uint8x16_t
+#define VEC_LOAD(p)     vld1q_u8((const uint8_t*)(p))
+#define VEC_SET(c)      vdupq_n_u8(c)
+#define VEC_EQ(a,b)     vceqq_u8(a,b)
+#define VEC_OR(a,b)     vorrq_u8(a,b)
+#define VEC_MASK_T      uint64_t
+#define VEC_ALL         (~(uint64_t)0)
+#define VEC_FIRST(m)    (__builtin_ctzll(m) >> 2)
+#endif
+
+// Number of leading string characters not needing attention: no quote, backslash or NUL
+static int plainRun (const char* p, int n) {
+    int i = 0;
+#if defined(VEC_T)
+    const VEC_T q = VEC_SET('"'), bs = VEC_SET('\\'), z = VEC_SET(0);
+    for( ; i+16 <= n; i += 16 ) {
+        VEC_T v = VEC_LOAD(p+i);
+        VEC_MASK_T m = vecMask(VEC_OR(VEC_OR(VEC_EQ(v,q), VEC_EQ(v,bs)), VEC_EQ(v,z)));
+        if( m )
+            return i + VEC_FIRST(m);
+    }
+#endif
+    while( i < n && p[i] != '"' && p[i] != '\\' && p[i] != 0 )
+        i++;
+    return i;
+}
+
+// Number of leading whitespace characters
+static int wspRun (const char* p, int n) {
+    int i = 0;
+#if defined(VEC_T)
+    const VEC_T sp = VEC_SET(' '), nl = VEC_SET('\n'), cr = VEC_SET('\r'), tab = VEC_SET('\t');
+    for( ; i+16 <= n; i += 16 ) {
+        VEC_T v = VEC_LOAD(p+i);
+        VEC_MASK_T m = VEC_ALL ^ vecMask(VEC_OR(VEC_OR(VEC_EQ(v,sp), VEC_EQ(v,nl)), VEC_OR(VEC_EQ(v,cr), VEC_EQ(v,tab))));
+        if( m )
+            return i + VEC_FIRST(m);
+    }
+#endif
+    while( i < n && (p[i] == ' ' || p[i] == '\n' || p[i] == '\r' || p[i] == '\t') )
+        i++;
+    return i;
+}
+
 static int skipWsp (ujdec_t* dec) {
     while(1) {
+        char* rp = dec->read_pos;
+        if( rp < dec->json_end-1 && rp[0] <= ' ' && rp[1] <= ' ' )  // longer runs, e.g. indentation
+            dec->read_pos += wspRun(rp, dec->json_end - rp);
         int c = nextChar(dec);
         switch( c ) {
         case '\t':
@@ -89,10 +162,26 @@ static void nextLit (ujdec_t* dec, const char* s) {
 
 static void parseString (ujdec_t* dec) {
     ujcrc_t crc = 0;
+    int hleft = UJ_CRC_MAXLEN;   // long strings are never keywords - hash only their start
     char* wp = (dec->mode & UJ_MODE_SKIP) ? NULL : dec->read_pos;
     dec->str.beg = dec->read_pos;
     assert(dec->read_pos[-1] == '"');
     while(1) {
+        char* rp = dec->read_pos;
+        if( rp < dec->json_end ) {
+            // Bulk of string - no escapes, no end
+            int n = plainRun(rp, dec->json_end - rp);
+            int h = min(n, hleft);
+            for( int i=0; i<h; i++ )
+                crc = UJ_UPDATE_CRC(crc, rp[i]);
+            hleft -= h;
+            if( wp ) {
+                if( wp != rp )
+                    memmove(wp, rp, n);
+                wp += n;
+            }
+            dec->read_pos = rp + n;
+        }
         int c = nextChar(dec);
         switch( c ) {
         case 0: {
@@ -138,7 +227,10 @@ static void parseString (ujdec_t* dec) {
                     }
                     for(; ci < 2; ci++ ) {
                         if( wp ) *wp++ = cu[ci];
-                        crc = UJ_UPDATE_CRC(crc,cu[ci]);
+                        if( hleft > 0 ) {
+                            hleft -= 1;
+                            crc = UJ_UPDATE_CRC(crc,cu[ci]);
+                        }
                     }
                     c = 0x80|(c&0x3F);  // encode 6 bits
                 }
@@ -151,7 +243,10 @@ static void parseString (ujdec_t* dec) {
         }
         }
         if( wp ) *wp++ = c;
-        crc = UJ_UPDATE_CRC(crc,c);
+        if( hleft > 0 ) {
+            hleft -= 1;
+            crc = UJ_UPDATE_CRC(crc,c);
+        }
     }
 }
 
@@ -646,6 +741,123 @@ ujcrc_t uj_msgtype(ujdec_t* dec) {
 
 #define snXp(b, fmt, ...) ((b)->pos += snprintf((b)->buf + (b)->pos, (b)->bufsize - (b)->pos, fmt, ##__VA_ARGS__))
 
+// --------------------------------------------------------------------------------
+// Number formatting without libc printf - output identical to %d/%u/%.Nf/%g
+
+enum { MAX_NUM_SIZE = 32 };  // chars produced by fmtUint/fmtInt/fmtFix/fmtG
+
+static const char DIGITS2[] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+static int fmtUint (char* buf, uL_t v) {
+    char tmp[20];
+    char* p = tmp+sizeof(tmp);
+    while( v >= 100 ) {
+        const char* d = &DIGITS2[(v % 100)*2];
+        v /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if( v >= 10 ) {
+        *--p = DIGITS2[v*2+1];
+        *--p = DIGITS2[v*2];
+    } else {
+        *--p = '0' + v;
+    }
+    int n = tmp+sizeof(tmp)-p;
+    memcpy(buf, p, n);
+    return n;
+}
+
+static int fmtInt (char* buf, sL_t v) {
+    if( v >= 0 )
+        return fmtUint(buf, v);
+    buf[0] = '-';
+    return 1 + fmtUint(buf+1, -(uL_t)v);
+}
+
+// Fixed point with frac (<=9) decimals - rounded on the exact binary value,
+// ties to even, like printf. Returns 0 if not handled (caller uses snprintf).
+static int fmtFix (char* buf, double v, int frac) {
+    if( !(fabs(v) < 1e18) || frac < 0 || frac > 9 )
+        return 0;  // also NaN
+    int n = 0;
+    if( signbit(v) ) {
+        buf[n++] = '-';
+        v = -v;
+    }
+    double ip = floor(v);
+    double f  = v - ip;              // exact
+    double s  = POW10[frac];
+    double p  = f * s;
+    double e  = fma(f, s, -p);       // rounding error of p
+    double q  = floor(p);
+    double r  = p - q;               // exact - multiple of ulp(p)
+    uL_t ii = (uL_t)ip;
+    uL_t fi = (uL_t)q;
+    if( r > 0.5 || (r == 0.5 && (e > 0 || (e == 0 && ((frac ? fi : ii) & 1)))) ) {
+        if( frac == 0 )
+            ii += 1;
+        else if( ++fi == (uL_t)s ) {
+            fi = 0;
+            ii += 1;
+        }
+    }
+    n += fmtUint(buf+n, ii);
+    if( frac ) {
+        buf[n++] = '.';
+        for( int i=frac; --i >= 0; fi /= 10 )
+            buf[n+i] = '0' + fi % 10;
+        n += frac;
+    }
+    return n;
+}
+
+// Like %g for the common range - 6 significant digits, no exponent.
+// Returns 0 if not handled (caller uses snprintf).
+static int fmtG (char* buf, double v) {
+    double a = fabs(v);
+    if( a == 0 ) {
+        if( signbit(v) ) {
+            memcpy(buf, "-0", 2);
+            return 2;
+        }
+        buf[0] = '0';
+        return 1;
+    }
+    if( !(a >= 1e-4 && a < 999999.5) )
+        return 0;  // exponent format - also NaN/Inf
+    int x;  // decimal exponent
+    if( a >= 1 ) {
+        char tmp[8];
+        x = fmtUint(tmp, (uL_t)a) - 1;
+    } else {
+        x = a >= 1e-1 ? -1 : a >= 1e-2 ? -2 : a >= 1e-3 ? -3 : -4;
+    }
+    int n = fmtFix(buf, v, 5-x);
+    if( x < 5 ) {
+        while( buf[n-1] == '0' )
+            n--;
+        if( buf[n-1] == '.' )
+            n--;
+    }
+    return n;
+}
+
+// Store like snprintf - truncate to buffer but report full length
+static int putNum (char* pb, int bl, const char* s, int n) {
+    if( bl > 0 ) {
+        int k = min(n, bl-1);
+        memcpy(pb, s, k);
+        pb[k] = 0;
+    }
+    return n;
+}
+
 static int lastChar (ujbuf_t* b) {
     if( !b->pos )
         return -1;
@@ -667,7 +879,7 @@ static void addHex2 (ujbuf_t* b, int v) {
 // Add string - n<=0 add string until \0
 //            - n>0  at most n chars
 void xputs (ujbuf_t* b, const char* s, int n) {
-    while( *s && n != 0 ) {
+    while( n != 0 && *s ) {
         if( b->pos >= b->bufsize )
             break;
         b->buf[b->pos++] = *s++;
@@ -675,6 +887,31 @@ void xputs (ujbuf_t* b, const char* s, int n) {
     }
 }
 
+// Decimal zero padded to at least w digits - date/time fields
+static void addDec (ujbuf_t* b, uL_t v, int w) {
+    char tmp[MAX_NUM_SIZE];
+    int n = fmtUint(tmp, v);
+    for( ; w > n; w-- )
+        addChar(b, '0');
+    xputs(b, tmp, n);
+}
+
+static void addDate (ujbuf_t* b, const struct datetime* dt) {
+    addDec(b, dt->year, 4);
+    addChar(b, '-');
+    addDec(b, dt->month, 2);
+    addChar(b, '-');
+    addDec(b, dt->day, 2);
+}
+
+static void addTime (ujbuf_t* b, const struct datetime* dt) {
+    addDec(b, dt->hour, 2);
+    addChar(b, ':');
+    addDec(b, dt->minute, 2);
+    addChar(b, ':');
+    addDec(b, dt->second, 2);
+}
+
 static const char* B64 = ("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                           "abcdefghijklmnopqrstuvwxyz"
                           "0123456789+/");
@@ -764,23 +1001,37 @@ void uj_encBool(ujbuf_t* b, int val) {
 
 void uj_encInt(ujbuf_t* b, sL_t val) {
     anotherValue(b);
-    xprintf(b, "%ld", val);
+    char tmp[MAX_NUM_SIZE];
+    int n = fmtInt(tmp, val);
+    b->pos += putNum(b->buf + b->pos, b->bufsize - b->pos, tmp, n);
 }
 
 void uj_encUint(ujbuf_t* b, uL_t val) {
     anotherValue(b);
-    xprintf(b, "%lu", val);
+    char tmp[MAX_NUM_SIZE];
+    int n = fmtUint(tmp, val);
+    b->pos += putNum(b->buf + b->pos, b->bufsize - b->pos, tmp, n);
 }
 
 void uj_encNum(ujbuf_t* b, double val) {
     anotherValue(b);
-    int n = snprintf(b->buf + b->pos, b->bufsize - b->pos, "%g", val);
+    char tmp[MAX_NUM_SIZE];
+    int n = fmtG(tmp, val);
+    if( n )
+        n = putNum(b->buf + b->pos, b->bufsize - b->pos, tmp, n);
+    else
+        n = snprintf(b->buf + b->pos, b->bufsize - b->pos, "%g", val);
     b->pos += n;
 }
 
 void uj_encTime(ujbuf_t* b, double val) {
     anotherValue(b);
-    int n = snprintf(b->buf + b->pos, b->bufsize - b->pos, "%.6f", val);
+    char tmp[MAX_NUM_SIZE];
+    int n = fmtFix(tmp, val, 6);
+    if( n )
+        n = putNum(b->buf + b->pos, b->bufsize - b->pos, tmp, n);
+    else
+        n = snprintf(b->buf + b->pos, b->bufsize - b->pos, "%.6f", val);
     b->pos += n;
 }
 
@@ -844,8 +1095,9 @@ void uj_encMac(ujbuf_t* b, uL_t mac) {
 
 static void encDate(ujbuf_t* b, uL_t tm) {
     struct datetime dt = rt_datetime(tm);
-    snXp(b, "%04d-%02d-%02d ", dt.year, dt.month, dt.day);
-    snXp(b, "%02d:%02d:%02d", dt.hour, dt.minute, dt.second);
+    addDate(b, &dt);
+    addChar(b, ' ');
+    addTime(b, &dt);
 }
 
 void uj_encDate(ujbuf_t* b, uL_t tm) {
@@ -1066,8 +1318,8 @@ static void approxTimeSpan (ujbuf_t* b, ustime_t span) {
     int ui=0;
     while( span < TSPAN_UNITS_VAL[ui] ) ui++;
     do {
-        int v = span / TSPAN_UNITS_VAL[ui+k];
-        snXp(b, "%d%s", v, TSPAN_UNITS_NAME[ui+k]);
+        addDec(b, span / TSPAN_UNITS_VAL[ui+k], 0);
+        xputs(b, TSPAN_UNITS_NAME[ui+k], -1);
         span %= TSPAN_UNITS_VAL[ui];
         ++k;
     } while ( k < 2 && span != 0 && TSPAN_UNITS_VAL[ui+k] != 0 );
@@ -1198,8 +1450,38 @@ int vxprintf(ujbuf_t* b, const char* fmt, va_list args) {
             case 'g':
             case 's':
             case 'p': {
-                
-                
+                if( width == 0 && stars == 0 && padding == 0 && extra == 0 && (c=='d' || c=='u' || c=='f' || c=='g') ) {
+                    // Plain numeric elements - format without libc printf
+                    char tmp[MAX_NUM_SIZE];
+                    int n = 0;
+                    if( c == 'd' && pi == &width ) {
+                        n = fmtInt(tmp, longFlag ? va_arg(args, sL_t) : va_arg(args, int));
+                    }
+                    else if( c == 'u' && pi == &width ) {
+                        n = fmtUint(tmp, longFlag ? va_arg(args, uL_t) : (unsigned)va_arg(args, int));
+                    }
+                    else if( c == 'f' && (pi == &width || frac <= 9) ) {
+                        double v = va_arg(args, double);
+                        int prec = pi == &width ? 6 : frac;
+                        if( (n = fmtFix(tmp, v, prec)) == 0 ) {
+                            b->pos += max(0, snprintf(b->buf + b->pos, b->bufsize - b->pos, "%.*f", prec, v));
+                            goto doneElem;
+                        }
+                    }
+                    else if( c == 'g' && pi == &width ) {
+                        double v = va_arg(args, double);
+                        if( (n = fmtG(tmp, v)) == 0 ) {
+                            b->pos += max(0, snprintf(b->buf + b->pos, b->bufsize - b->pos, "%g", v));
+                            goto doneElem;
+                        }
+                    }
+                    else {
+                        goto slowNum;
+                    }
+                    b->pos += putNum(b->buf + b->pos, b->bufsize - b->pos, tmp, n);
+                    goto doneElem;
+                }
+              slowNum: {}
                 char fmt2[MAX_FMT_SIZE+3];
                 memcpy(fmt2, fmt-1, fmtoff+2);
                 if( sizeof(long) == 4 && fmt2[fmtoff] == 'l' ) {
@@ -1292,11 +1574,11 @@ int vxprintf(ujbuf_t* b, const char* fmt, va_list args) {
                 }
                 struct datetime dt = rt_datetime(tm);
                 if( padding != '>' )
-                    snXp(b, "%04d-%02d-%02d", dt.year, dt.month, dt.day);
+                    addDate(b, &dt);
                 if( padding == 0 )
                     addChar(b, extra==0 ? ' ' : extra);
                 if( padding != '<' ) {
-                    snXp(b, "%02d:%02d:%02d", dt.hour, dt.minute, dt.second);
+                    addTime(b, &dt);
                     if( frac ) {
                         addChar(b, '.');
                         while( --frac >= 0 ) {
@@ -1348,7 +1630,275 @@ int vxprintf(ujbuf_t* b, const char* fmt, va_list args) {
             } // switch
         } // while(1)
     doneElem:
+        // snprintf reports the untruncated length - don't let the next element write past the end
+        if( b->pos > b->bufsize )
+            b->pos = b->bufsize;
         fmt += fmtoff+1;
     }
     return xeos(b);
 }
+
+
+// --------------------------------------------------------------------------------
+// Capture the arguments of an xprintf call into a flat buffer and replay them later.
+// Used by deferred logging. Arguments are stored in 8 byte slots in the order
+// vxprintf consumes them. Memory referenced by %s, %H, %B, and %J is copied.
+// The format string itself is not copied and must outlive the captured data.
+
+typedef union { uL_t u; sL_t i; double d; const void* p; } xslot_t;
+
+typedef struct xelem {
+    u1_t len;       // chars following '%' incl. conversion char
+    char conv;      // conversion char - 0 if vxprintf emits a literal '%' instead
+    char longFlag;
+    char nstars;
+    char starFrac;  // which star (1-based) supplies the precision - 0 if none
+    char hasFrac;
+    int  frac;      // literal precision
+} xelem_t;
+
+// Parse one element after '%' exactly like vxprintf does
+static void scanElem (const char* fmt, xelem_t* e) {
+    memset(e, 0, sizeof(*e));
+    for( int off=0; fmt[off] && off < MAX_FMT_SIZE; off++ ) {
+        switch( fmt[off] ) {
+        case '*': {
+            e->nstars += 1;
+            if( e->hasFrac )
+                e->starFrac = e->nstars;
+            break;
+        }
+        case '.': {
+            e->hasFrac = 1;
+            break;
+        }
+        case 'l': {
+            e->longFlag = 1;
+            break;
+        }
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': {
+            if( e->hasFrac )
+                e->frac = e->frac*10 + fmt[off] - '0';
+            break;
+        }
+        case 'c': case 'd': case 'u': case 'x': case 'X': case 'f': case 'g': case 's': case 'p':
+        case 'H': case 'B': case 'M': case 'E': case 'T': case 'F': case 'R': case 'J': {
+            e->len = off+1;
+            e->conv = fmt[off];
+            return;
+        }
+        }
+    }
+}
+
+static int putSlot (u1_t* dst, int dstsize, int pos, xslot_t v) {
+    if( pos < 0 || pos + 8 > dstsize )
+        return -1;
+    memcpy(dst+pos, &v, 8);
+    return pos+8;
+}
+
+// Length slot (-1 for NULL) followed by data, a NUL, and padding to 8 bytes
+static int putBytes (u1_t* dst, int dstsize, int pos, const void* p, int n) {
+    if( (pos = putSlot(dst, dstsize, pos, (xslot_t){ .i = p ? n : -1 })) < 0 || !p )
+        return pos;
+    int end = pos + ((n+8) & ~7);
+    if( end > dstsize )
+        return -1;
+    memcpy(dst+pos, p, n);
+    memset(dst+pos+n, 0, end-pos-n);
+    return end;
+}
+
+int vxprintf_capture (u1_t* dst, int dstsize, const char* fmt, va_list args) {
+    int pos = 0;
+    while( (fmt = strchr(fmt, '%')) != NULL ) {
+        fmt++;
+        if( fmt[0] == '%' ) {
+            fmt++;
+            continue;
+        }
+        xelem_t e;
+        scanElem(fmt, &e);
+        int prec = e.hasFrac ? e.frac : -1;
+        for( int i=1; i <= e.nstars; i++ ) {
+            int v = va_arg(args, int);
+            if( i == e.starFrac )
+                prec = v;
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .i = v });
+        }
+        if( e.conv == 0 )
+            continue;  // literal '%' - stars have been consumed nonetheless
+        fmt += e.len;
+        switch( e.conv ) {
+        case 'c': case 'd': case 'u': case 'x': case 'X': {
+            xslot_t v = { .u = e.longFlag ? va_arg(args, uL_t) : (uL_t)va_arg(args, int) };
+            pos = putSlot(dst, dstsize, pos, v);
+            break;
+        }
+        case 'f': case 'g': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .d = va_arg(args, double) });
+            break;
+        }
+        case 'p': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .p = va_arg(args, void*) });
+            break;
+        }
+        case 's': {
+            const char* s = va_arg(args, const char*);
+            int n = s == NULL ? 0 : prec >= 0 ? strnlen(s, prec) : strlen(s);
+            pos = putBytes(dst, dstsize, pos, s, n);
+            break;
+        }
+        case 'H': case 'B': {
+            int n = va_arg(args, int);
+            const u1_t* p = va_arg(args, const u1_t*);
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .i = n });
+            pos = putBytes(dst, dstsize, pos, p, max(n,0));
+            break;
+        }
+        case 'M': case 'E': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .u = va_arg(args, uL_t) });
+            break;
+        }
+        case 'T': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .i = va_arg(args, ustime_t) });
+            break;
+        }
+        case 'F': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .u = va_arg(args, unsigned) });
+            break;
+        }
+        case 'R': {
+            pos = putSlot(dst, dstsize, pos, (xslot_t){ .i = va_arg(args, int) });
+            break;
+        }
+        case 'J': {
+            pos = putBytes(dst, dstsize, pos, va_arg(args, txjob_t*), sizeof(txjob_t));
+            break;
+        }
+        }
+        if( pos < 0 )
+            return -1;
+    }
+    return pos;
+}
+
+static int getSlot (const u1_t* data, int len, int* ppos, xslot_t* v) {
+    if( *ppos + 8 > len )
+        return 0;
+    memcpy(v, data + *ppos, 8);
+    *ppos += 8;
+    return 1;
+}
+
+static const void* getBytes (const u1_t* data, int len, int* ppos, int* ok) {
+    xslot_t n;
+    if( !getSlot(data, len, ppos, &n) || n.i > len - *ppos ) {
+        *ok = 0;
+        return NULL;
+    }
+    if( n.i < 0 )
+        return NULL;
+    const void* p = data + *ppos;
+    *ppos += (n.i+8) & ~7;
+    return p;
+}
+
+int xprintf_replay (ujbuf_t* b, const char* fmt, const u1_t* data, int len) {
+    int pos = 0;
+    while(1) {
+        const char* pct = strchr(fmt, '%');
+        if( pct == NULL ) {
+            xputs(b, fmt, -1);
+            break;
+        }
+        xputs(b, fmt, pct-fmt);
+        fmt = pct+1;
+        if( fmt[0] == '%' ) {
+            fmt++;
+            addChar(b, '%');
+            continue;
+        }
+        xelem_t e;
+        scanElem(fmt, &e);
+        // Rebuild element with star arguments inlined
+        char efmt[MAX_FMT_SIZE + 2*12 + 2];
+        int ei = 0, star = 0;
+        efmt[ei++] = '%';
+        for( int i=0; i < e.len; i++ ) {
+            if( fmt[i] != '*' ) {
+                efmt[ei++] = fmt[i];
+                continue;
+            }
+            xslot_t v;
+            if( !getSlot(data, len, &pos, &v) )
+                return xeos(b);
+            if( ++star == e.starFrac && v.i < 0 ) {
+                ei -= 1;  // negative precision - as if omitted
+                continue;
+            }
+            ei += fmtInt(&efmt[ei], (int)v.i);
+        }
+        efmt[ei] = 0;
+        if( e.conv == 0 ) {
+            // Consume stars vxprintf consumed before printing a literal '%'
+            for( ; star < e.nstars; star++ )
+                pos += 8;
+            addChar(b, '%');
+            continue;
+        }
+        fmt += e.len;
+        xslot_t v;
+        int ok = 1;
+        switch( e.conv ) {
+        case 's': {
+            const void* s = getBytes(data, len, &pos, &ok);
+            if( ok )
+                xprintf(b, efmt, s);
+            break;
+        }
+        case 'H': case 'B': {
+            if( (ok = getSlot(data, len, &pos, &v)) ) {
+                const void* p = getBytes(data, len, &pos, &ok);
+                if( ok )
+                    xprintf(b, efmt, (int)v.i, p);
+            }
+            break;
+        }
+        case 'J': {
+            const void* p = getBytes(data, len, &pos, &ok);
+            if( ok && p ) {
+                txjob_t txjob;
+                memcpy(&txjob, p, sizeof(txjob));
+                xprintf(b, efmt, &txjob);
+            }
+            break;
+        }
+        default: {
+            if( !(ok = getSlot(data, len, &pos, &v)) )
+                break;
+            switch( e.conv ) {
+            case 'c': case 'd': case 'u': case 'x': case 'X': {
+                if( e.longFlag )
+                    xprintf(b, efmt, v.u);
+                else
+                    xprintf(b, efmt, (int)v.i);
+                break;
+            }
+            case 'f': case 'g': { xprintf(b, efmt, v.d);           break; }
+            case 'p':           { xprintf(b, efmt, v.p);           break; }
+            case 'M': case 'E': { xprintf(b, efmt, v.u);           break; }
+            case 'T':           { xprintf(b, efmt, (ustime_t)v.i); break; }
+            case 'F':           { xprintf(b, efmt, (unsigned)v.u); break; }
+            case 'R':           { xprintf(b, efmt, (int)v.i);      break; }
+            }
+            break;
+        }
+        }
+        if( !ok )
+            break;
+    }
+    return xeos(b);
+}
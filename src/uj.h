@@ -40,6 +40,7 @@ typedef u4_t   ujcrc_t;
 enum { UJ_MAX_NEST = 8 };
 enum { UJ_N_ARY = 0, UJ_N_OBJ=1 };  // type of nesting
 enum { UJ_MODE_SKIP = 1 };
+enum { UJ_CRC_MAXLEN = 64 };        // str.crc covers only this many leading chars - longer strings are no keywords
 
 typedef enum {
     UJ_UNDEF,
@@ -139,4 +140,9 @@ void xputs  (ujbuf_t* buf, const char* s, int n);
 int  xprintf(ujbuf_t* buf, const char* fmt, ...);
 int vxprintf(ujbuf_t* buf, const char* fmt, va_list args);
 
+// Store arguments of a vxprintf call and render them later - fmt must stay valid.
+// Returns number of bytes stored or -1 if dst is too small.
+int vxprintf_capture (u1_t* dst, int dstsize, const char* fmt, va_list args);
+int xprintf_replay   (ujbuf_t* buf, const char* fmt, const u1_t* data, int len);
+
 #endif // _uj_h_
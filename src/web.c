@@ -31,6 +31,8 @@
 #include "sys.h"
 #include "uj.h"
 #include "kwcrc.h"
+#include "fs.h"
+#include "metrics.h"
 
 static web_t* WEB;
 
@@ -73,7 +75,7 @@ void web_free (web_t* web) {
     rt_free(web);
 }
 
-static int web_route(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* buf) {
+static int web_route(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* buf, int* fd, struct stat* st) {
     char* path = pstate->path;
     LOG(MOD_WEB|VERBOSE, "Requested Path: %s (crc=0x%08x) [%s]",
         path, pstate->pathcrc, pstate->meth);
@@ -82,12 +84,17 @@ static int web_route(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* buf) {
         path = "index.html";
         pstate->contentType = "text/html";
     }
-    *buf = sys_webFile(path);
-
-    if ( buf->buf != NULL) {
-        if( buf->pos >= 4 && (rt_rlsbf4((u1_t*)buf->buf) & 0x00ffffff) == 0x088b1f ) {
+    if( (*fd = sys_webOpen(path, st)) >= 0 ) {
+        // Static files are streamed - only peek at the start to detect precompressed content
+        u1_t magic[4];
+        if( st->st_size >= 4 && fs_read(*fd, magic, 4) == 4 && (rt_rlsbf4(magic) & 0x00ffffff) == 0x088b1f ) {
             pstate->contentEnc = "gzip";
         }
+        if( fs_lseek(*fd, 0, SEEK_SET) == -1 ) {
+            fs_close(*fd);
+            *fd = -1;
+            return 500;
+        }
         return 200;
     }
 
@@ -103,9 +110,52 @@ static int web_route(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* buf) {
     return 404;
 }
 
+// HTTP/1.1 connections persist unless the client says otherwise
+static int keepAlive (httpd_pstate_t* pstate, char* hdr) {
+    char* v = http_findHeader(hdr, "connection");
+    if( v && http_icaseCmp(v, "close") )
+        return 0;
+    if( v && http_icaseCmp(v, "keep-alive") )
+        return 1;
+    return pstate->httpVersion >= HTTT_1_1;
+}
+
+// Does If-None-Match list etag - or is it just "*"?
+// Value is "*" or a comma separated list of quoted entity tags, optionally weak (W/).
+// We only serve strong tags but If-None-Match uses weak comparison, hence W/ is ignored.
+static int etagMatches (char* hdr, str_t etag) {
+    char* v = http_findHeader(hdr, "if-none-match");
+    if( v == NULL )
+        return 0;
+    if( *v == '*' ) {
+        v = http_skipWsp(v+1);
+        return *v == '\r' || *v == '\n' || *v == 0;
+    }
+    int elen = strlen(etag);
+    while( *v != '\r' && *v != '\n' && *v != 0 ) {
+        if( v[0] == 'W' && v[1] == '/' )
+            v += 2;
+        if( *v != '"' )
+            return 0;   // malformed
+        char* e = v+1;
+        while( *e != '"' ) {
+            if( *e == '\r' || *e == '\n' || *e == 0 )
+                return 0;
+            e++;
+        }
+        if( e+1-v == elen && strncmp(v, etag, elen) == 0 )
+            return 1;
+        v = http_skipWsp(e+1);
+        if( *v == ',' )
+            v = http_skipWsp(v+1);
+        else if( *v != '\r' && *v != '\n' && *v != 0 )
+            return 0;
+    }
+    return 0;
+}
+
 static void web_onev (conn_t* _conn, int ev) {
-    web_t* web = conn2web(_conn);
-    httpd_t* hd = &web->hd;
+    httpd_t* hd = conn2httpd(_conn);
     LOG(MOD_WEB|XDEBUG, "Web Event: %d", ev);
     switch(ev) {
     
@@ -117,15 +167,28 @@ static void web_onev (conn_t* _conn, int ev) {
         LOG(MOD_WEB|XDEBUG, "Client request: content-length=%d\n%.*s", hd->extra.clen, hdr.bufsize, hdr.buf);
         httpd_pstate_t pstate;
         int r = 500;
-        // Note: writing to respbuf overwrites hdr!
-        dbuf_t respbuf = httpd_getRespbuf(hd);
         dbuf_t fbuf = {0};
+        int fd = -1;
+        struct stat st;
+        char etag[40];
+        char etaghdr[56] = "";
         if( !httpd_parseReqLine(&pstate, &hdr) ) {
             LOG(MOD_WEB|ERROR, "Failed to parse request header");
             r = 400;
         } else {
-            r = web_route(&pstate, hd, &fbuf);
+            r = web_route(&pstate, hd, &fbuf, &fd, &st);
         }
+        // Inspect request headers now - writing to respbuf overwrites hdr!
+        hd->resp.keepalive = r != 400 && keepAlive(&pstate, hdr.buf);
+        if( fd >= 0 ) {
+            snprintf(etag, sizeof(etag), "\"%lx-%lx\"",
+                     (unsigned long)(st.st_mtime ? st.st_mtime : st.st_ctime), (unsigned long)st.st_size);
+            if( etagMatches(hdr.buf, etag) )
+                r = 304;
+            snprintf(etaghdr, sizeof(etaghdr), "ETag: %s\r\n", etag);
+        }
+        str_t connhdr = hd->resp.keepalive ? "" : "Connection: close\r\n";
+        dbuf_t respbuf = httpd_getRespbuf(hd);
         char* path = rt_strdup(pstate.path);
         switch(r) {
         case 200:
@@ -133,36 +196,43 @@ static void web_onev (conn_t* _conn, int ev) {
                     "HTTP/1.1 200 OK\r\n"
                     "Content-Type: %s\r\n"
                     "Content-Encoding: %s\r\n"
-                    "\r\n", pstate.contentType, (pstate.contentEnc && pstate.contentEnc[0] != 0) ? pstate.contentEnc : "identity" );
-            if( respbuf.bufsize - respbuf.pos < fbuf.pos ) {
-                LOG(MOD_WEB|ERROR, "Too big: %s (size=%d, bufsize=%d)", path, fbuf.pos, respbuf.bufsize - respbuf.pos);
-                respbuf.pos = 0;
-                xprintf(&respbuf,
-                        "HTTP/1.1 507 Insufficient Storage\r\n\r\n"
-                        "Resource too big!\r\n");
-            } else {
-                LOG(MOD_WEB|VERBOSE, "Sending response: %s (%d bytes)", path, fbuf.pos);
-                memcpy(respbuf.buf + respbuf.pos, fbuf.buf, fbuf.pos);
-                respbuf.pos += fbuf.pos;
+                    "Content-Length: %d\r\n"
+                    "%s%s"
+                    "\r\n", pstate.contentType, (pstate.contentEnc && pstate.contentEnc[0] != 0) ? pstate.contentEnc : "identity",
+                    fd >= 0 ? (int)st.st_size : fbuf.pos, etaghdr, connhdr);
+            if( fd >= 0 ) {
+                LOG(MOD_WEB|VERBOSE, "Sending response: %s (%d bytes)", path, (int)st.st_size);
+                free(path);
+                httpd_sendFile(hd, &respbuf, fd, st.st_size);
+                return;
             }
-            rt_free((void*)fbuf.buf);
+            // Generated content is streamed as well - size is not limited by the connection buffer
+            LOG(MOD_WEB|VERBOSE, "Sending response: %s (%d bytes)", path, fbuf.pos);
+            free(path);
+            httpd_sendBody(hd, &respbuf, &fbuf);
+            return;
+        case 304:
+            fs_close(fd);
+            xprintf(&respbuf, "HTTP/1.1 304 Not Modified\r\n%s%s\r\n", etaghdr, connhdr);
             break;
         case 400:
-            xprintf(&respbuf, "HTTP/1.1 400 Bad Request\r\n\r\n");
+            xprintf(&respbuf, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n%s\r\n", connhdr);
             break;
         case 401:
-            xprintf(&respbuf, "HTTP/1.1 401 Unauthorized\r\n\r\n");
+            xprintf(&respbuf, "HTTP/1.1 401 Unauthorized\r\nContent-Length: 0\r\n%s\r\n", connhdr);
             break;
         case 404:
             xprintf(&respbuf,
-                        "HTTP/1.1 404 Not Found\r\n\r\n"
-                        "Resource not found!\r\n");
+                        "HTTP/1.1 404 Not Found\r\n"
+                        "Content-Length: 21\r\n"
+                        "%s\r\n"
+                        "Resource not found!\r\n", connhdr);
             break;
         case 405:
-            xprintf(&respbuf, "HTTP/1.1 405 Method Not Allowed\r\n\r\n");
+            xprintf(&respbuf, "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\n%s\r\n", connhdr);
             break;
         case 500:
-            xprintf(&respbuf, "HTTP/1.1 500 Internal Server Error\r\n\r\n");
+            xprintf(&respbuf, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n%s\r\n", connhdr);
             break;
         }
         free(path);
@@ -176,7 +246,7 @@ static void web_onev (conn_t* _conn, int ev) {
     }
     case HTTPDEV_CLOSED: {
         LOG(MOD_WEB|DEBUG, "Web client closed");
-        web->hd.c.evcb = (evcb_t)web_onev; // http_close sets ecvb to default nil-cb
+        hd->c.evcb = (evcb_t)web_onev; // http_close sets ecvb to default nil-cb
         break;
     }
     default: {
@@ -192,7 +262,7 @@ static void web_start (web_t* web) {
     char port[10];
     snprintf(port, sizeof(port), "%d", sys_webPort);
 
-    if( !httpd_listen(&web->hd, port) ) {
+    if( !httpd_listen(&web->hd, port, WEB_MAX_CONNS, WEB_IDLE_TIMEOUT) ) {
         LOG(MOD_WEB|ERROR, "Web listen failed on port %d", sys_webPort);
         goto errexit;
     }
@@ -248,8 +318,27 @@ int handle_version(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* b) {
     return 200;
 }
 
+int handle_metrics(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* b) {
+    if ( pstate->method != HTTP_GET )
+        return 405; // Method not allowed
+
+    // Output grows with histograms/gauges - render again into a bigger buffer until it fits
+    for( int sz = 4096; ; sz *= 2 ) {
+        b->buf = _rt_malloc(sz,0);
+        b->bufsize = sz;
+        b->pos = 0;
+        metrics_render(b);
+        if( b->pos < b->bufsize )
+            break;
+        rt_free(b->buf);
+    }
+    pstate->contentType = "text/plain; version=0.0.4";
+    return 200;
+}
+
 static const web_handler_t HANDLERS[] = {
     { J_api,     handle_api     },
     { J_version, handle_version },
+    { J_metrics, handle_metrics },
     { 0,         NULL           },
 };
@@ -29,6 +29,7 @@
 #ifndef _web_h_
 #define _web_h_
 
+#include <sys/stat.h>
 #include "httpd.h"
 
 #define WEB_PORT "8080"
@@ -60,7 +61,7 @@ extern web_handler_t AUTH_HANDLERS[];
 
 void web_authini();
 
-dbuf_t sys_webFile (str_t filename);
+int sys_webOpen (str_t filename, struct stat* st);  // static resource below web_dir - fd or -1
 
 #define timeout2web(p) memberof(web_t, p, timeout)
 #define conn2web(p)    memberof(web_t, p, hd.c)
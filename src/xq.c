@@ -111,7 +111,14 @@ void txq_freeJob (txq_t* txq, txjob_t* j) {
 // Caller starts filling data but can walk away without having
 // to free anything. Data is preserver only if commitJob() is called later.
 txjob_t* txq_reserveJob (txq_t* txq) {
-    txidx_t idx = txq->freeJobs;
+    return txq_reserveNextJob(txq, NULL);
+}
+
+
+// Like txq_reserveJob but returns the free txjob following prev (NULL: first free txjob).
+// This allows filling a batch of txjobs which are later committed in the same order.
+txjob_t* txq_reserveNextJob (txq_t* txq, txjob_t* prev) {
+    txidx_t idx = prev ? prev->next : txq->freeJobs;
     assert(idx != TXIDX_NIL);
     if( idx == TXIDX_END )
         return NULL;  // no more job available
@@ -149,6 +156,28 @@ void txq_commitJob (txq_t* txq, txjob_t*j) {
 }
 
 
+// Commit data placed via txq_reserveData without attaching it to a txjob.
+// Returns the offset of the data which must be handed to txq_commitJobData.
+txoff_t txq_commitData (txq_t* txq, txoff_t len) {
+    assert(len <= MAX_TXDATA - txq->txdataInUse);
+    txoff_t off = txq->txdataInUse;
+    txq->txdataInUse += len;
+    return off;
+}
+
+
+// Commit a txjob which refers to already committed data (j->len set by caller).
+// Several txjobs may share the same data - it is released with the last of them.
+void txq_commitJobData (txq_t* txq, txjob_t* j, txoff_t off) {
+    assert(j == &txq->txjobs[txq->freeJobs]);
+    assert(j->off == TXOFF_NIL);
+    assert(off + j->len <= txq->txdataInUse);
+    txq->freeJobs = j->next;
+    j->next = TXIDX_NIL;
+    j->off = off;
+}
+
+
 
 
 void txq_freeData (txq_t* txq, txjob_t* j) {
@@ -158,6 +187,15 @@ void txq_freeData (txq_t* txq, txjob_t* j) {
     if( freeOff == TXOFF_NIL )
         return;
     u1_t freeLen = j->len;
+    for( txidx_t idx=0; idx<MAX_TXJOBS && freeLen; idx++ ) {
+        txjob_t* other = &txq->txjobs[idx];
+        if( other != j && other->off == freeOff && other->len == freeLen ) {
+            // Data still referenced by another txjob - see txq_commitJobData
+            j->off = TXOFF_NIL;
+            j->len = 0;
+            return;
+        }
+    }
     for( txidx_t idx=0; idx<MAX_TXJOBS; idx++ ) {
         txjob_t* fixjob = &txq->txjobs[idx];
         if( fixjob->off != TXOFF_NIL && fixjob->off >= freeOff )
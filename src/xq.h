@@ -85,8 +85,11 @@ void     txq_insJob   (txq_t* txq, txidx_t* pi, txjob_t* j);
 void     txq_freeJob  (txq_t* txq, txjob_t* j);
 void     txq_freeData (txq_t* txq, txjob_t* j);
 txjob_t* txq_reserveJob  (txq_t* txq);
+txjob_t* txq_reserveNextJob (txq_t* txq, txjob_t* prev);
 u1_t*    txq_reserveData (txq_t* txq, txoff_t maxlen);
 void     txq_commitJob   (txq_t* txq, txjob_t*j);
+txoff_t  txq_commitData  (txq_t* txq, txoff_t len);
+void     txq_commitJobData (txq_t* txq, txjob_t* j, txoff_t off);
 
 
 typedef u2_t rxoff_t;